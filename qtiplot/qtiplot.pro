@@ -218,6 +218,15 @@ contains(SCRIPTING_LANGS, Python) {
 
 ###############################################################
 
+# check if we have FFTW
+!isEmpty(FFTW_LIBS) {
+	DEFINES += HAVE_FFTW
+	INCLUDEPATH += $$FFTW_INCLUDEPATH
+	LIBS        += $$FFTW_LIBS
+}
+
+###############################################################
+
 #At the very end: add global include- and lib path
 unix:INCLUDEPATH += $$SYS_INCLUDEPATH
 unix:LIBS += $$SYS_LIBS
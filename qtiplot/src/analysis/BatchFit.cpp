@@ -0,0 +1,329 @@
+/***************************************************************************
+	File                 : BatchFit.cpp
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Fits the same model to many data sets in parallel
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#include "BatchFit.h"
+#include "fit_gsl.h"
+#include <ApplicationWindow.h>
+#include <Table.h>
+#include <MyParser.h>
+
+#include <QApplication>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QThread>
+#include <QTimer>
+#if QT_VERSION >= 0x040400
+#include <QtConcurrentRun>
+#include <QFuture>
+#endif
+
+#include <qwt_plot_curve.h>
+#include <gsl/gsl_math.h>
+
+BatchFit::BatchFit(Fit *model)
+	: QObject(model->parent()),
+	d_model(model),
+	d_weighting(model->d_weighting),
+	d_weighting_dataset(model->weighting_dataset),
+	d_warm_start(false),
+	d_threads(1)
+{
+}
+
+BatchFit::~BatchFit()
+{
+	qDeleteAll(d_data_sets);
+}
+
+bool BatchFit::addDataSet(Table *t, const QString& xColName, const QString& yColName, int from, int to)
+{
+	if (!d_model->setDataFromTable(t, xColName, yColName, from, to))
+		return false;
+
+	return addModelData(yColName);
+}
+
+bool BatchFit::addDataSet(QwtPlotCurve *c, double start, double end)
+{
+	if (!c || !d_model->setDataFromCurve(c, start, end))
+		return false;
+
+	return addModelData(c->title().text());
+}
+
+bool BatchFit::addModelData(const QString& name)
+{
+	Fit *m = d_model;
+	switch(d_weighting){
+		case Fit::NoWeighting:
+			for (int i = 0; i < m->d_n; i++)
+				m->d_w[i] = 1.0;
+			break;
+		case Fit::Instrumental:
+			// the weights were read from the error bars of the curve
+			break;
+		default:
+			if (!m->setWeightingData(d_weighting, d_weighting_dataset))
+				return false;
+			break;
+	}
+	// loading a curve with error bars switches the model to instrumental weighting
+	m->d_weighting = d_weighting;
+	m->weighting_dataset = d_weighting_dataset;
+
+	if (!m->removeDataSingularities())
+		return false;
+
+	int n = m->d_n;
+	DataSet *ds = new DataSet;
+	ds->name = name;
+	ds->x.resize(n);
+	ds->y.resize(n);
+	ds->w.resize(n);
+	for (int i = 0; i < n; i++){
+		ds->x[i] = m->d_x[i];
+		ds->y[i] = m->d_y[i];
+		ds->w[i] = m->d_w[i];
+	}
+	ds->results = QVector<double>(m->d_p, GSL_NAN);
+	ds->errors = QVector<double>(m->d_p, GSL_NAN);
+	ds->chi2 = GSL_NAN;
+	ds->iterations = 0;
+	ds->status = GSL_FAILURE;
+	d_data_sets << ds;
+	return true;
+}
+
+void BatchFit::fitDataSets(BatchFit *batch, int thread)
+{
+	Fit *model = batch->d_model;
+	int p = model->d_p;
+	int count = batch->d_data_sets.size();
+
+	int first = 0, last = count;
+	if (batch->d_warm_start){
+		first = thread*count/batch->d_threads;
+		last = (thread + 1)*count/batch->d_threads;
+	}
+
+	gsl_vector *init = gsl_vector_alloc(p);
+	gsl_matrix *cov = gsl_matrix_alloc(p, p);
+	DataSet *previous = 0;
+	for (int k = first; !batch->d_canceled; k++){
+		int index = batch->d_warm_start ? k : batch->d_next.fetchAndAddOrdered(1);
+		if (index >= last)
+			break;
+
+		DataSet *ds = batch->d_data_sets.at(index);
+		int n = ds->x.size();
+		if (n > p){
+			if (previous && previous->status == GSL_SUCCESS){
+				for (int i = 0; i < p; i++)
+					gsl_vector_set(init, i, previous->results[i]);
+			} else
+				gsl_vector_memcpy(init, model->d_param_init);
+
+			// the covariance matrix is reused: reset it, since failed or simplex fits may leave it untouched
+			gsl_matrix_set_all(cov, GSL_NAN);
+			struct FitData data = {n, p, ds->x.data(), ds->y.data(), ds->w.data(), model, batch->d_evaluators[thread]};
+			if (model->d_robust_loss != Fit::LeastSquares){
+				int passes;
+				ds->status = model->robustSolve(&data, init, ds->results.data(), cov, ds->chi2, ds->iterations, passes, false);
+			} else
+				ds->status = model->solve(&data, init, ds->results.data(), cov, ds->chi2, ds->iterations, false);
+
+			double chi_2_dof = ds->chi2/(n - p);
+			for (int i = 0; i < p; i++){
+				double var = gsl_matrix_get(cov, i, i);
+				if (ds->status != GSL_SUCCESS || !gsl_finite(var))
+					ds->errors[i] = GSL_NAN;
+				else if (model->d_scale_errors)
+					ds->errors[i] = sqrt(chi_2_dof*var);
+				else
+					ds->errors[i] = sqrt(var);
+			}
+		} else
+			ds->status = GSL_EINVAL;
+
+		previous = ds;
+		batch->d_done.ref();
+	}
+	gsl_vector_free(init);
+	gsl_matrix_free(cov);
+}
+
+bool BatchFit::run()
+{
+	ApplicationWindow *app = (ApplicationWindow *)parent();
+	if (d_data_sets.isEmpty()){
+		QMessageBox::critical(app, tr("QtiPlot - Fit Error"),
+				tr("You didn't specify a valid data set for this fit operation. Operation aborted!"));
+		return false;
+	}
+
+	Fit *model = d_model;
+	// updates the model functions (see NonLinearFit::prepareModel())
+	model->compiledModel();
+	if (!model->is_non_linear || !model->d_f || !model->d_p){
+		QMessageBox::critical(app, tr("QtiPlot - Fit Error"),
+				tr("Batch fits are only available for non-linear fit models. Operation aborted!"));
+		return false;
+	}
+
+	int count = d_data_sets.size();
+	d_threads = 1;
+#if QT_VERSION >= 0x040400
+	if (model->isThreadSafe())
+		d_threads = qMax(1, qMin(QThread::idealThreadCount(), count));
+#endif
+
+	//the evaluators are created in the GUI thread, since MyParser reads the locale of the application widgets
+	struct FitData data = {0, model->d_p, 0, 0, 0, model, 0};
+	d_evaluators = QVector<void *>(d_threads, (void *)0);
+	try {
+		for (int i = 0; i < d_threads; i++)
+			d_evaluators[i] = fit_evaluator_alloc(&data, model->d_f);
+	} catch (mu::ParserError &e) {
+		QMessageBox::critical(app, tr("QtiPlot - Input function error"), QString::fromStdString(e.GetMsg()));
+		foreach(void *evaluator, d_evaluators)
+			fit_evaluator_free(evaluator);
+		d_evaluators.clear();
+		return false;
+	}
+
+	d_next = 0;
+	d_done = 0;
+	d_canceled = 0;
+
+#if QT_VERSION >= 0x040400
+	if (d_threads > 1){
+		QList<QFuture<void> > futures;
+		for (int i = 0; i < d_threads; i++)
+			futures << QtConcurrent::run(fitDataSets, this, i);
+
+		QProgressDialog progress(app);
+		progress.setWindowTitle(tr("QtiPlot") + " - " + tr("Batch fit"));
+		progress.setLabelText(tr("Fitting %1 data sets...").arg(count));
+		progress.setWindowModality(Qt::ApplicationModal);
+		progress.setRange(0, count);
+
+		QTimer timer;
+		timer.start(100);
+		foreach(QFuture<void> future, futures){
+			while (!future.isFinished()){
+				if (progress.wasCanceled())
+					d_canceled = 1;
+				progress.setValue(d_done);
+				qApp->processEvents(QEventLoop::WaitForMoreEvents);
+			}
+		}
+		progress.setValue(count);
+	} else
+#endif
+	{
+		QApplication::setOverrideCursor(Qt::WaitCursor);
+		fitDataSets(this, 0);
+		QApplication::restoreOverrideCursor();
+	}
+
+	foreach(void *evaluator, d_evaluators)
+		fit_evaluator_free(evaluator);
+	d_evaluators.clear();
+
+	customizeResults();
+	return !d_canceled;
+}
+
+void BatchFit::customizeResults()
+{
+	// applies the model specific transformations of the results (e.g. for exponential growth)
+	Fit *model = d_model;
+	int p = model->d_p;
+	QVector<double> modelResults(p);
+	for (int i = 0; i < p; i++)
+		modelResults[i] = model->d_results[i];
+	foreach(DataSet *ds, d_data_sets){
+		for (int i = 0; i < p; i++)
+			model->d_results[i] = ds->results[i];
+		model->customizeFitResults();
+		for (int i = 0; i < p; i++)
+			ds->results[i] = model->d_results[i];
+	}
+	for (int i = 0; i < p; i++)
+		model->d_results[i] = modelResults[i];
+}
+
+Table* BatchFit::resultsTable(const QString& name)
+{
+	ApplicationWindow *app = (ApplicationWindow *)parent();
+	Fit *model = d_model;
+	int p = model->d_p;
+	int rows = d_data_sets.size();
+	int cols = 2*p + 5;
+
+	Table *t = app->newTable(app->generateUniqueName(name, false), rows, cols);
+	QStringList header = QStringList() << tr("DataSet");
+	for (int i = 0; i < p; i++)
+		header << model->d_param_names[i] << model->d_param_names[i] + "Err";
+	header << "Chi2" << "Chi2doF" << tr("Iterations") << tr("Status");
+	t->setHeader(header);
+
+	t->setColumnType(0, Table::Text);
+	t->setColPlotDesignation(0, Table::X);
+	for (int i = 0; i < p; i++)
+		t->setColPlotDesignation(2*i + 2, Table::yErr);
+	t->setColumnType(cols - 1, Table::Text);
+	t->setColPlotDesignation(cols - 1, Table::None);
+
+	// the cells are filled without notifications, the table is updated only once at the end
+	for (int row = 0; row < rows; row++){
+		DataSet *ds = d_data_sets[row];
+		t->setText(row, 0, ds->name);
+		if (ds->status == GSL_EINVAL){
+			t->setText(row, cols - 1, tr("not enough data points"));
+			continue;
+		}
+
+		for (int i = 0; i < p; i++){
+			t->setCell(row, 2*i + 1, ds->results[i]);
+			t->setCell(row, 2*i + 2, ds->errors[i]);
+		}
+		int n = ds->x.size();
+		t->setCell(row, 2*p + 1, ds->chi2);
+		t->setCell(row, 2*p + 2, ds->chi2/(n - p));
+		t->setCell(row, 2*p + 3, ds->iterations);
+		t->setText(row, cols - 1, gsl_strerror(ds->status));
+	}
+	t->notifyChanges();
+
+	for (int i = 0; i < cols; i++)
+		t->table()->adjustColumn(i);
+
+	t->showNormal();
+	return t;
+}
@@ -0,0 +1,116 @@
+/***************************************************************************
+	File                 : BatchFit.h
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Fits the same model to many data sets in parallel
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef BATCHFIT_H
+#define BATCHFIT_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QList>
+#include <QVector>
+
+#include "Fit.h"
+
+class Table;
+class QwtPlotCurve;
+
+//! Fits the same model to many data sets in parallel
+/**
+ * The model is an already configured Fit object: its function, initial guesses, parameter ranges,
+ * algorithm, tolerance, weighting method and error scaling are used for all the data sets.
+ * The data sets are read by addDataSet() in the GUI thread and fitted concurrently by run(),
+ * each thread using its own solver workspace. No curves or log entries are created for the
+ * individual fits: all the results are written to a single table by resultsTable().
+ *
+ * When warm start is enabled, each data set is fitted starting from the results obtained for the
+ * previous data set, which speeds up the fits of series of similar curves. Each thread then
+ * processes a contiguous range of data sets.
+ *
+ * Only the non-linear models (fitted by Fit::fit()) are supported.
+ */
+class BatchFit : public QObject
+{
+	Q_OBJECT
+
+public:
+	BatchFit(Fit *model);
+	virtual ~BatchFit();
+
+	//! Adds a data set read from a table
+	bool addDataSet(Table *t, const QString& xColName, const QString& yColName, int from = 1, int to = -1);
+	//! Adds the points of a curve having start <= x <= end
+	bool addDataSet(QwtPlotCurve *c, double start, double end);
+	int dataSetsCount(){return d_data_sets.size();};
+
+	void setWarmStart(bool on = true){d_warm_start = on;};
+
+	//! Fits all the data sets, returns false if the fits could not be performed or were canceled
+	virtual bool run();
+
+	//! Writes the parameters, their errors and the chi^2 of all the fits to a new table
+	Table* resultsTable(const QString& name = QString("BatchFit"));
+
+	double* results(int dataSet){return d_data_sets[dataSet]->results.data();};
+	double* errors(int dataSet){return d_data_sets[dataSet]->errors.data();};
+	double chiSquare(int dataSet){return d_data_sets[dataSet]->chi2;};
+	int status(int dataSet){return d_data_sets[dataSet]->status;};
+
+protected:
+	struct DataSet
+	{
+		QString name;
+		QVector<double> x, y, w;
+		QVector<double> results, errors;
+		double chi2;
+		int iterations;
+		int status;
+	};
+
+	//! Copies the data set currently loaded by the model
+	bool addModelData(const QString& name);
+	//! Applies the model specific transformations (see Fit::customizeFitResults()) to the results of all data sets
+	void customizeResults();
+	//! Fits the data sets assigned to a thread
+	static void fitDataSets(BatchFit *batch, int thread);
+
+	Fit *d_model;
+	Fit::WeightingMethod d_weighting;
+	QString d_weighting_dataset;
+	bool d_warm_start;
+	QList<DataSet *> d_data_sets;
+
+	int d_threads;
+	//! Evaluators of the model used by the threads (see fit_evaluator_alloc())
+	QVector<void *> d_evaluators;
+	//! Index of the next data set to be fitted, used when warm start is disabled
+	QAtomicInt d_next;
+	QAtomicInt d_done;
+	QAtomicInt d_canceled;
+};
+
+#endif
@@ -29,10 +29,10 @@
 #include "Convolution.h"
 #include <PlotCurve.h>
 #include <ColorBox.h>
+#include "FFTPlan.h"
 
 #include <QMessageBox>
 #include <QLocale>
-#include <gsl/gsl_fft_halfcomplex.h>
 
 Convolution::Convolution(ApplicationWindow *parent, Table *t, const QString& signalColName, const QString& responseColName)
 : Filter(parent, t)
@@ -180,42 +180,45 @@ void Convolution::convlv(double *sig, int n, double *dres, int m, int sign)
 		res[m2]=dres[m-1];
 
 	// calculate ffts
-	gsl_fft_real_radix2_transform(res,1,n);
-	gsl_fft_real_radix2_transform(sig,1,n);
+	FFTPlan fft(FFTPlan::Real, n);
+	fft.execute(res);
+	fft.execute(sig);
+
+	// the real terms: offset and Nyquist frequency (for even n)
+	QList<int> real;
+	real << 0;
+	if (n%2 == 0)
+		real << n - 1;
+	foreach(int k, real){
+		if(sign == 1)
+			sig[k] = res[k]*sig[k];
+		else
+			sig[k] = sig[k]/res[k];
+	}
 
 	double re, im, size;
-	for (i=0;i<n/2;i++)
-	{// multiply/divide both ffts
-		if(i==0 || i==n/2-1)
+	for (i=1;2*i<n;i++)
+	{// multiply/divide both ffts, stored in the halfcomplex format: r0, r1, i1, r2, i2, ...
+		int ri = 2*i - 1, ii = 2*i;
+		if(sign == 1)
 		{
-			if(sign == 1)
-				sig[i] = res[i]*sig[i];
-			else
-				sig[i] = sig[i]/res[i];
+			re = res[ri]*sig[ri]-res[ii]*sig[ii];
+			im = res[ri]*sig[ii]+res[ii]*sig[ri];
 		}
 		else
 		{
-			int ni = n-i;
-			if(sign == 1)
-			{
-				re = res[i]*sig[i]-res[ni]*sig[ni];
-				im = res[i]*sig[ni]+res[ni]*sig[i];
-			}
-			else
-			{
-				size = res[i]*res[i]+res[ni]*res[ni];
-				re = res[i]*sig[i]+res[ni]*sig[ni];
-				im = res[i]*sig[ni]-res[ni]*sig[i];
-				re /= size;
-				im /= size;
-			}
-
-			sig[i] = re;
-			sig[ni] = im;
+			size = res[ri]*res[ri]+res[ii]*res[ii];
+			re = res[ri]*sig[ri]+res[ii]*sig[ii];
+			im = res[ri]*sig[ii]-res[ii]*sig[ri];
+			re /= size;
+			im /= size;
 		}
+
+		sig[ri] = re;
+		sig[ii] = im;
 	}
 	delete[] res;
-	gsl_fft_halfcomplex_radix2_inverse(sig,1,n);// inverse fft
+	FFTPlan(FFTPlan::HalfComplexInverse, n).execute(sig);// inverse fft
 }
  /**************************************************************************
  *             Class Deconvolution                                         *
@@ -30,12 +30,11 @@
 #include <MultiLayer.h>
 #include <PlotCurve.h>
 #include <ColorBox.h>
+#include "FFTPlan.h"
 
 #include <QMessageBox>
 #include <QLocale>
 
-#include <gsl/gsl_fft_halfcomplex.h>
-
 Correlation::Correlation(ApplicationWindow *parent, Table *t, const QString& colName1, const QString& colName2, int startRow, int endRow)
 : Filter(parent, t)
 {
@@ -114,27 +113,27 @@ bool Correlation::setDataFromTable(Table *t, const QString& colName1, const QStr
 void Correlation::output()
 {
     // calculate the FFTs of the two functions
-	if( gsl_fft_real_radix2_transform( d_x, 1, d_n ) == 0 &&
-        gsl_fft_real_radix2_transform( d_y, 1, d_n ) == 0)
-	{
-		for(int i=0; i<d_n/2; i++ ){// multiply the FFT by its complex conjugate
-			if( i==0 || i==(d_n/2)-1 )
-				d_x[i] *= d_x[i];
-			else{
-				int ni = d_n-i;
-				double dReal = d_x[i] * d_y[i] + d_x[ni] * d_y[ni];
-				double dImag = d_x[i] * d_y[ni] - d_x[ni] * d_y[i];
-				d_x[i] = dReal;
-				d_x[ni] = dImag;
-			}
+	FFTPlan fft(FFTPlan::Real, d_n);
+	if (fft.execute(d_x) && fft.execute(d_y)){
+		// multiply the FFT by its complex conjugate, the spectra being stored in the halfcomplex format:
+		// r0, r1, i1, r2, i2, ... and the real Nyquist term at the end
+		d_x[0] *= d_y[0];
+		for (int i = 1; 2*i < d_n; i++){
+			int re = 2*i - 1, im = 2*i;
+			double dReal = d_x[re] * d_y[re] + d_x[im] * d_y[im];
+			double dImag = d_x[re] * d_y[im] - d_x[im] * d_y[re];
+			d_x[re] = dReal;
+			d_x[im] = dImag;
 		}
+		if (d_n%2 == 0)
+			d_x[d_n - 1] *= d_y[d_n - 1];
 	} else {
 		QMessageBox::warning((ApplicationWindow *)parent(), tr("QtiPlot") + " - " + tr("Error"),
-                             tr("Error in GSL forward FFT operation!"));
+                             tr("Error in forward FFT operation!"));
 		return;
 	}
 
-	gsl_fft_halfcomplex_radix2_inverse(d_x, 1, d_n );	//inverse FFT
+	FFTPlan(FFTPlan::HalfComplexInverse, d_n).execute(d_x);	//inverse FFT
 
 	addResultCurve();
     d_result_table = d_table;
@@ -32,11 +32,11 @@
 #include <ColorBox.h>
 #include <Matrix.h>
 #include <fft2D.h>
+#include "FFTPlan.h"
 
 #include <QLocale>
 #include <QApplication>
 
-#include <gsl/gsl_fft_complex.h>
 #include <gsl/gsl_fft_halfcomplex.h>
 
 FFT::FFT(ApplicationWindow *parent, Table *t, const QString& realColName, const QString& imagColName, int from, int to)
@@ -118,32 +118,17 @@ void FFT::fftCurve()
 	double df = 1.0/(double)(d_n*d_sampling);//frequency sampling
 	double aMax = 0.0;//max amplitude
 	if(!d_inverse){
-		gsl_fft_real_workspace *work = gsl_fft_real_workspace_alloc(d_n);
-		gsl_fft_real_wavetable *real = gsl_fft_real_wavetable_alloc(d_n);
-
-		if(!work || !real){
+		if (!FFTPlan(FFTPlan::Real, d_n).execute(d_y)){
 			memoryErrorMessage();
 			return;
 		}
-
-		gsl_fft_real_transform(d_y, 1, d_n, real, work);
 		gsl_fft_halfcomplex_unpack (d_y, result, 1, d_n);
-
-		gsl_fft_real_wavetable_free(real);
-		gsl_fft_real_workspace_free(work);
 	} else {
 		gsl_fft_real_unpack (d_y, result, 1, d_n);
-		gsl_fft_complex_wavetable *wavetable = gsl_fft_complex_wavetable_alloc (d_n);
-		gsl_fft_complex_workspace *workspace = gsl_fft_complex_workspace_alloc (d_n);
-
-		if(!workspace || !wavetable){
+		if (!FFTPlan(FFTPlan::ComplexInverse, d_n).execute(result)){
 			memoryErrorMessage();
 			return;
 		}
-
-		gsl_fft_complex_inverse (result, 1, d_n, wavetable, workspace);
-		gsl_fft_complex_wavetable_free (wavetable);
-		gsl_fft_complex_workspace_free (workspace);
 	}
 
 	if (d_shift_order){
@@ -191,23 +176,14 @@ void FFT::fftCurve()
 void FFT::fftTable()
 {
 	double *amp = (double *)malloc(d_n*sizeof(double));
-	gsl_fft_complex_wavetable *wavetable = gsl_fft_complex_wavetable_alloc (d_n);
-	gsl_fft_complex_workspace *workspace = gsl_fft_complex_workspace_alloc (d_n);
-
-	if(!amp || !wavetable || !workspace){
+	if(!amp || !FFTPlan(d_inverse ? FFTPlan::ComplexInverse : FFTPlan::Complex, d_n).execute(d_y)){
+		free(amp);
 		memoryErrorMessage();
 		return;
 	}
 
 	double df = 1.0/(double)(d_n*d_sampling);//frequency sampling
 	double aMax = 0.0;//max amplitude
-	if(d_inverse)
-		gsl_fft_complex_inverse (d_y, 1, d_n, wavetable, workspace);
-	else
-		gsl_fft_complex_forward (d_y, 1, d_n, wavetable, workspace);
-
-	gsl_fft_complex_wavetable_free (wavetable);
-	gsl_fft_complex_workspace_free (workspace);
 
 	if (d_shift_order) {
 		int n2 = d_n/2;
@@ -444,11 +420,14 @@ void FFT::fftMatrix()
 	}
 
 	double **x_int_re = Matrix::allocateMatrixData(rows, cols, true); // real coeff matrix
-	if (!x_int_re)
+	if (!x_int_re){
+		memoryErrorMessage();
 		return;
+	}
 	double **x_int_im = Matrix::allocateMatrixData(rows, cols, true); // imaginary coeff  matrix
 	if (!x_int_im){
 		Matrix::freeMatrixData(x_int_re, rows);
+		memoryErrorMessage();
 		return;
 	}
 
@@ -465,18 +444,25 @@ void FFT::fftMatrix()
 	}
 
 	double **x_fin_re = NULL, **x_fin_im = NULL;
+	bool ok = false;
 	if (d_inverse){
 		x_fin_re = Matrix::allocateMatrixData(rows, cols);
 		x_fin_im = Matrix::allocateMatrixData(rows, cols);
-		if (!x_fin_re || !x_fin_im){
-			Matrix::freeMatrixData(x_int_re, rows);
-			Matrix::freeMatrixData(x_int_im, rows);
-			QApplication::restoreOverrideCursor();
-			return;
-		}
-		fft2d_inv(x_int_re, x_int_im, x_fin_re, x_fin_im, cols, rows, d_shift_order);
+		if (x_fin_re && x_fin_im)
+			ok = fft2d_inv(x_int_re, x_int_im, x_fin_re, x_fin_im, cols, rows, d_shift_order);
 	} else
-		fft2d(x_int_re, x_int_im, cols, rows, d_shift_order);
+		ok = fft2d(x_int_re, x_int_im, cols, rows, d_shift_order);
+
+	if (!ok){
+		Matrix::freeMatrixData(x_int_re, rows);
+		Matrix::freeMatrixData(x_int_im, rows);
+		if (x_fin_re)
+			Matrix::freeMatrixData(x_fin_re, rows);
+		if (x_fin_im)
+			Matrix::freeMatrixData(x_fin_im, rows);
+		memoryErrorMessage();
+		return;
+	}
 
 	d_re_out_matrix = app->newMatrix(rows, cols);
 	QString realCoeffMatrixName = app->generateUniqueName(tr("RealMatrixFFT"));
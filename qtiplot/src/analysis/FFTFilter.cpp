@@ -31,7 +31,7 @@
 #include <QMessageBox>
 #include <QLocale>
 
-#include <gsl/gsl_fft_halfcomplex.h>
+#include "FFTPlan.h"
 
 FFTFilter::FFTFilter(ApplicationWindow *parent, QwtPlotCurve *c, int m)
 : Filter(parent, c)
@@ -134,11 +134,7 @@ void FFTFilter::calculateOutputData(double *x, double *y)
     //double df = 0.5/(double)(d_n*(x[1]-x[0]));//half frequency sampling due to GSL storing
 	double df = 1.0/(double)(d_n*(x[1]-x[0]));
 
-	gsl_fft_real_workspace *work = gsl_fft_real_workspace_alloc(d_n);
-	gsl_fft_real_wavetable *real = gsl_fft_real_wavetable_alloc(d_n);
-
-	gsl_fft_real_transform (y, 1, d_n, real, work);
-	gsl_fft_real_wavetable_free (real);
+	FFTPlan(FFTPlan::Real, d_n).execute(y);
 
     ApplicationWindow *app = (ApplicationWindow *)parent();
     QLocale locale = app->locale();
@@ -198,8 +194,5 @@ void FFTFilter::calculateOutputData(double *x, double *y)
 			break;
 	}
 
-	gsl_fft_halfcomplex_wavetable *hc = gsl_fft_halfcomplex_wavetable_alloc (d_n);
-	gsl_fft_halfcomplex_inverse (y, 1, d_n, hc, work);
-	gsl_fft_halfcomplex_wavetable_free (hc);
-	gsl_fft_real_workspace_free (work);
+	FFTPlan(FFTPlan::HalfComplexInverse, d_n).execute(y);
 }
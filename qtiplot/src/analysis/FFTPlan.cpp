@@ -0,0 +1,356 @@
+/***************************************************************************
+	File                 : FFTPlan.cpp
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Cached plans of the fast Fourier transforms
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#include "FFTPlan.h"
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QThread>
+#include <QAtomicInt>
+
+#ifdef HAVE_FFTW
+#include <fftw3.h>
+#else
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include <gsl/gsl_fft_complex.h>
+#endif
+
+//! Maximum total size of the plans kept in the cache, in data points
+static const int fft_cache_points = 1 << 24;
+
+#ifdef HAVE_FFTW
+//! Transforms with at least this number of points are computed by several threads
+static const int fft_threads_points = 1 << 16;
+#endif
+
+//! Plan of a transform, deleted when the cache and all the FFTPlan objects release it
+struct FFTPlanData
+{
+	FFTPlan::Type type;
+	int n;
+	QAtomicInt ref;
+#ifdef HAVE_FFTW
+	fftw_plan plan;
+#else
+	gsl_fft_real_wavetable *real;
+	gsl_fft_halfcomplex_wavetable *halfcomplex;
+	gsl_fft_complex_wavetable *complex;
+#endif
+};
+
+typedef QPair<int, int> FFTPlanKey;
+
+//! Protects the cache, as well as the FFTW planner which is not thread-safe
+static QMutex fft_plans_mutex;
+static QHash<FFTPlanKey, FFTPlanData *> fft_plans;
+//! Keys of the cached plans, the most recently used being the last
+static QList<FFTPlanKey> fft_plans_used;
+static int fft_cached_points = 0;
+
+static FFTPlanData* createPlan(FFTPlan::Type type, int n)
+{
+	FFTPlanData *d = new FFTPlanData;
+	d->type = type;
+	d->n = n;
+	d->ref = 0;
+	bool ok = false;
+#ifdef HAVE_FFTW
+	static bool threads = false;
+	if (!threads){
+		fftw_init_threads();
+		threads = true;
+	}
+	fftw_plan_with_nthreads(n >= fft_threads_points ? qMax(1, QThread::idealThreadCount()) : 1);
+
+	// the arrays are only used for planning: the plans are executed on the data given to FFTPlan::execute()
+	unsigned flags = FFTW_ESTIMATE | FFTW_UNALIGNED;
+	fftw_complex *c = (fftw_complex *)fftw_malloc(sizeof(fftw_complex)*n);
+	double *r = (double *)fftw_malloc(sizeof(double)*n);
+	d->plan = 0;
+	if (c && r){
+		switch(type){
+			case FFTPlan::Real:
+				d->plan = fftw_plan_dft_r2c_1d(n, r, c, flags);
+				break;
+			case FFTPlan::HalfComplexInverse:
+				d->plan = fftw_plan_dft_c2r_1d(n, c, r, flags);
+				break;
+			case FFTPlan::Complex:
+				d->plan = fftw_plan_dft_1d(n, c, c, FFTW_FORWARD, flags);
+				break;
+			case FFTPlan::ComplexInverse:
+				d->plan = fftw_plan_dft_1d(n, c, c, FFTW_BACKWARD, flags);
+				break;
+		}
+	}
+	fftw_free(c);
+	fftw_free(r);
+	ok = (d->plan != 0);
+#else
+	d->real = 0;
+	d->halfcomplex = 0;
+	d->complex = 0;
+	switch(type){
+		case FFTPlan::Real:
+			d->real = gsl_fft_real_wavetable_alloc(n);
+			ok = (d->real != 0);
+			break;
+		case FFTPlan::HalfComplexInverse:
+			d->halfcomplex = gsl_fft_halfcomplex_wavetable_alloc(n);
+			ok = (d->halfcomplex != 0);
+			break;
+		case FFTPlan::Complex:
+		case FFTPlan::ComplexInverse:
+			d->complex = gsl_fft_complex_wavetable_alloc(n);
+			ok = (d->complex != 0);
+			break;
+	}
+#endif
+	if (!ok){
+		delete d;
+		return 0;
+	}
+	return d;
+}
+
+//! Must be called with fft_plans_mutex locked
+static void destroyPlan(FFTPlanData *d)
+{
+#ifdef HAVE_FFTW
+	fftw_destroy_plan(d->plan);
+#else
+	if (d->real)
+		gsl_fft_real_wavetable_free(d->real);
+	if (d->halfcomplex)
+		gsl_fft_halfcomplex_wavetable_free(d->halfcomplex);
+	if (d->complex)
+		gsl_fft_complex_wavetable_free(d->complex);
+#endif
+	delete d;
+}
+
+//! Must be called with fft_plans_mutex locked
+static void releasePlan(FFTPlanData *d)
+{
+	if (d && !d->ref.deref())
+		destroyPlan(d);
+}
+
+//! Drops the least recently used plans until the cache can take size more points
+static void shrinkCache(int size)
+{
+	while (!fft_plans_used.isEmpty() && fft_cached_points + size > fft_cache_points){
+		FFTPlanData *d = fft_plans.take(fft_plans_used.takeFirst());
+		fft_cached_points -= d->n;
+		releasePlan(d);
+	}
+}
+
+FFTPlan::FFTPlan(Type type, int n)
+	: d(0)
+{
+	if (n < 1)
+		return;
+
+	QMutexLocker locker(&fft_plans_mutex);
+	FFTPlanKey key(type, n);
+	d = fft_plans.value(key);
+	if (d){
+		fft_plans_used.removeAll(key);
+		fft_plans_used << key;
+	} else {
+		d = createPlan(type, n);
+		if (!d)
+			return;
+		if (n <= fft_cache_points){
+			shrinkCache(n);
+			d->ref.ref();
+			fft_plans.insert(key, d);
+			fft_plans_used << key;
+			fft_cached_points += n;
+		}
+	}
+	d->ref.ref();
+}
+
+FFTPlan::FFTPlan(const FFTPlan& plan)
+	: d(plan.d)
+{
+	if (d)
+		d->ref.ref();
+}
+
+FFTPlan::~FFTPlan()
+{
+	if (!d)
+		return;
+
+	QMutexLocker locker(&fft_plans_mutex);
+	releasePlan(d);
+}
+
+FFTPlan& FFTPlan::operator=(const FFTPlan& plan)
+{
+	if (plan.d == d)
+		return *this;
+
+	if (plan.d)
+		plan.d->ref.ref();
+	QMutexLocker locker(&fft_plans_mutex);
+	releasePlan(d);
+	d = plan.d;
+	return *this;
+}
+
+FFTPlan::Type FFTPlan::type() const
+{
+	return d ? d->type : Real;
+}
+
+int FFTPlan::size() const
+{
+	return d ? d->n : 0;
+}
+
+bool FFTPlan::isValid() const
+{
+	return d != 0;
+}
+
+bool FFTPlan::execute(double *data) const
+{
+	if (!d || !data)
+		return false;
+
+	int n = d->n;
+#ifdef HAVE_FFTW
+	switch(d->type){
+		case Real:
+		case HalfComplexInverse:
+		{
+			int n2 = n/2 + 1;
+			fftw_complex *c = (fftw_complex *)fftw_malloc(sizeof(fftw_complex)*n2);
+			if (!c)
+				return false;
+
+			if (d->type == Real){
+				fftw_execute_dft_r2c(d->plan, data, c);
+				// GSL halfcomplex format: r0, r1, i1, r2, i2, ..., r(n/2) for even n
+				data[0] = c[0][0];
+				for (int k = 1; 2*k < n; k++){
+					data[2*k - 1] = c[k][0];
+					data[2*k] = c[k][1];
+				}
+				if (n%2 == 0)
+					data[n - 1] = c[n/2][0];
+			} else {
+				c[0][0] = data[0];
+				c[0][1] = 0.0;
+				for (int k = 1; 2*k < n; k++){
+					c[k][0] = data[2*k - 1];
+					c[k][1] = data[2*k];
+				}
+				if (n%2 == 0){
+					c[n/2][0] = data[n - 1];
+					c[n/2][1] = 0.0;
+				}
+				fftw_execute_dft_c2r(d->plan, c, data);
+				double scale = 1.0/n;
+				for (int i = 0; i < n; i++)
+					data[i] *= scale;
+			}
+			fftw_free(c);
+			break;
+		}
+		case Complex:
+			fftw_execute_dft(d->plan, (fftw_complex *)data, (fftw_complex *)data);
+			break;
+		case ComplexInverse:
+		{
+			fftw_execute_dft(d->plan, (fftw_complex *)data, (fftw_complex *)data);
+			double scale = 1.0/n;
+			for (int i = 0; i < 2*n; i++)
+				data[i] *= scale;
+			break;
+		}
+	}
+	return true;
+#else
+	// the workspaces are allocated for each transform, so that a plan can be used by several threads
+	int status = GSL_ENOMEM;
+	switch(d->type){
+		case Real:
+		case HalfComplexInverse:
+		{
+			gsl_fft_real_workspace *work = gsl_fft_real_workspace_alloc(n);
+			if (!work)
+				return false;
+			if (d->type == Real)
+				status = gsl_fft_real_transform(data, 1, n, d->real, work);
+			else
+				status = gsl_fft_halfcomplex_inverse(data, 1, n, d->halfcomplex, work);
+			gsl_fft_real_workspace_free(work);
+			break;
+		}
+		case Complex:
+		case ComplexInverse:
+		{
+			gsl_fft_complex_workspace *work = gsl_fft_complex_workspace_alloc(n);
+			if (!work)
+				return false;
+			if (d->type == Complex)
+				status = gsl_fft_complex_forward(data, 1, n, d->complex, work);
+			else
+				status = gsl_fft_complex_inverse(data, 1, n, d->complex, work);
+			gsl_fft_complex_workspace_free(work);
+			break;
+		}
+	}
+	return status == GSL_SUCCESS;
+#endif
+}
+
+void FFTPlan::clearCache()
+{
+	QMutexLocker locker(&fft_plans_mutex);
+	shrinkCache(fft_cache_points + 1);
+}
+
+const char* FFTPlan::backend()
+{
+#ifdef HAVE_FFTW
+	return "FFTW";
+#else
+	return "GSL";
+#endif
+}
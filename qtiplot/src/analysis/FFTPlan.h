@@ -0,0 +1,75 @@
+/***************************************************************************
+	File                 : FFTPlan.h
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Cached plans of the fast Fourier transforms
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef FFTPLAN_H
+#define FFTPLAN_H
+
+struct FFTPlanData;
+
+//! Plan of a one dimensional fast Fourier transform, shared through a cache of plans
+/**
+ * The transforms are computed by FFTW when QtiPlot is built with it (HAVE_FFTW), using several threads for
+ * large data sets, otherwise by the mixed-radix routines of GSL. The data are always stored in the GSL format:
+ * the real transforms store their result in the halfcomplex format of gsl_fft_real_transform(), the complex
+ * data are packed as pairs of real and imaginary parts, and the inverse transforms are normalized by 1/n.
+ *
+ * Plans are identified by their type and size: the cache keeps the most recently used ones, so that the
+ * trigonometric tables are computed only once when the same transform is applied several times.
+ * A plan can be executed concurrently by several threads.
+ */
+class FFTPlan
+{
+public:
+	enum Type{Real, HalfComplexInverse, Complex, ComplexInverse};
+
+	//! Gets the plan of the transform from the cache, creating it if needed
+	FFTPlan(Type type, int n);
+	FFTPlan(const FFTPlan& plan);
+	~FFTPlan();
+
+	FFTPlan& operator=(const FFTPlan& plan);
+
+	Type type() const;
+	int size() const;
+
+	//! Returns false if the plan couldn't be created (e.g. not enough memory)
+	bool isValid() const;
+
+	//! Computes the transform of data in place, returns false on failure
+	bool execute(double *data) const;
+
+	//! Releases the plans kept in the cache
+	static void clearCache();
+	//! Name of the library computing the transforms
+	static const char* backend();
+
+private:
+	FFTPlanData *d;
+};
+
+#endif
@@ -29,6 +29,7 @@
 #include "Fit.h"
 #include "FitModelHandler.h"
 #include "fit_gsl.h"
+#include <MyParser.h>
 #include <Table.h>
 #include <Matrix.h>
 #include <ErrorBarsCurve.h>
@@ -39,12 +40,25 @@
 #include <gsl/gsl_statistics.h>
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_cdf.h>
+#include <gsl/gsl_math.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_randist.h>
 
 #include <QApplication>
 #include <QMessageBox>
 #include <QDateTime>
 #include <QLocale>
 #include <QTextStream>
+#include <QProgressDialog>
+#include <QThread>
+#include <QTimer>
+#include <QPair>
+#include <QVector>
+#include <QAtomicInt>
+#if QT_VERSION >= 0x040400
+#include <QtConcurrentRun>
+#include <QFuture>
+#endif
 
 Fit::Fit( ApplicationWindow *parent, QwtPlotCurve *c)
 : Filter( parent, c)
@@ -101,9 +115,14 @@ void Fit::init()
 	d_fit_type = BuiltIn;
 	d_param_range_left = 0;
 	d_param_range_right = 0;
+	d_global_starts = 0;
+	d_robust_loss = LeastSquares;
+	d_robust_tuning = 0.0;
+	d_robust_passes = 0;
+	d_evaluator = 0;
 }
 
-gsl_multifit_fdfsolver * Fit::fitGSL(gsl_multifit_function_fdf f, int &iterations, int &status)
+gsl_multifit_fdfsolver * Fit::fitGSL(gsl_multifit_function_fdf f, const gsl_vector *init, double *results, gsl_matrix *cov, int &iterations, int &status) const
 {
 	const gsl_multifit_fdfsolver_type *T;
 	if (d_solver)
@@ -113,24 +132,31 @@ gsl_multifit_fdfsolver * Fit::fitGSL(gsl_multifit_function_fdf f, int &iteration
 
 	gsl_set_error_handler_off();
 
-	gsl_multifit_fdfsolver *s = gsl_multifit_fdfsolver_alloc (T, d_n, d_p);
-	status = gsl_multifit_fdfsolver_set (s, &f, d_param_init);
+	gsl_multifit_fdfsolver *s = gsl_multifit_fdfsolver_alloc (T, f.n, f.p);
+	status = iterateGSL(s, &f, init, results, cov, iterations);
+	return s;
+}
+
+int Fit::iterateGSL(gsl_multifit_fdfsolver *s, gsl_multifit_function_fdf *f, const gsl_vector *init, double *results, gsl_matrix *cov, int &iterations) const
+{
+	int p = f->p;
+	int status = gsl_multifit_fdfsolver_set (s, f, init);
 
 	size_t iter = 0;
 	bool inRange = true;
-	for (int i=0; i<d_p; i++){
-		double p = gsl_vector_get(d_param_init, i);
-		d_results[i] = p;
-		if (p < d_param_range_left[i] || p > d_param_range_right[i]){
+	for (int i=0; i<p; i++){
+		double par = gsl_vector_get(init, i);
+		results[i] = par;
+		if (par < d_param_range_left[i] || par > d_param_range_right[i]){
 			inRange = false;
 			break;
 		}
 	}
 
 	if (status){
-	    gsl_multifit_covar (s->J, 0.0, covar);
+	    gsl_multifit_covar (s->J, 0.0, cov);
 	    iterations = 0;
-	    return s;
+	    return status;
 	}
 
 	do{
@@ -139,9 +165,9 @@ gsl_multifit_fdfsolver * Fit::fitGSL(gsl_multifit_function_fdf f, int &iteration
 		if (status)
 			break;
 
-		for (int i=0; i<d_p; i++){
-			double p = gsl_vector_get(s->x, i);
-			if (p < d_param_range_left[i] || p > d_param_range_right[i]){
+		for (int i=0; i<p; i++){
+			double par = gsl_vector_get(s->x, i);
+			if (par < d_param_range_left[i] || par > d_param_range_right[i]){
 				inRange = false;
 				break;
 			}
@@ -149,19 +175,19 @@ gsl_multifit_fdfsolver * Fit::fitGSL(gsl_multifit_function_fdf f, int &iteration
 		if (!inRange)
 			break;
 
-		for (int i = 0; i < d_p; i++)
-			d_results[i] = gsl_vector_get(s->x, i);
+		for (int i = 0; i < p; i++)
+			results[i] = gsl_vector_get(s->x, i);
 
 		status = gsl_multifit_test_delta (s->dx, s->x, d_tolerance, d_tolerance);
 	} while (inRange && status == GSL_CONTINUE && (int)iter < d_max_iterations);
 
-	gsl_multifit_covar (s->J, 0.0, covar);
+	gsl_multifit_covar (s->J, 0.0, cov);
 
 	iterations = iter;
-	return s;
+	return status;
 }
 
-gsl_multimin_fminimizer * Fit::fitSimplex(gsl_multimin_function f, int &iterations, int &status)
+gsl_multimin_fminimizer * Fit::fitSimplex(gsl_multimin_function f, const gsl_vector *init, double *results, int &iterations, int &status) const
 {
 	const gsl_multimin_fminimizer_type *T = gsl_multimin_fminimizer_nmsimplex2;
 
@@ -175,15 +201,16 @@ gsl_multimin_fminimizer * Fit::fitSimplex(gsl_multimin_function f, int &iteratio
 	gsl_set_error_handler_off();
 
 	gsl_multimin_fminimizer *s_min = gsl_multimin_fminimizer_alloc (T, f.n);
-	status = gsl_multimin_fminimizer_set (s_min, &f, d_param_init, ss);
+	status = gsl_multimin_fminimizer_set (s_min, &f, init, ss);
 
+	int p = f.n;
 	double size;
 	size_t iter = 0;
 	bool inRange = true;
-	for (int i=0; i<d_p; i++){
-		double p = gsl_vector_get(d_param_init, i);
-		d_results[i] = p;
-		if (p < d_param_range_left[i] || p > d_param_range_right[i]){
+	for (int i=0; i<p; i++){
+		double par = gsl_vector_get(init, i);
+		results[i] = par;
+		if (par < d_param_range_left[i] || par > d_param_range_right[i]){
 			inRange = false;
 			break;
 		}
@@ -202,9 +229,9 @@ gsl_multimin_fminimizer * Fit::fitSimplex(gsl_multimin_function f, int &iteratio
 		if (status)
 			break;
 
-        for (int i=0; i<d_p; i++){
-			double p = gsl_vector_get(s_min->x, i);
-			if (p < d_param_range_left[i] || p > d_param_range_right[i]){
+        for (int i=0; i<p; i++){
+			double par = gsl_vector_get(s_min->x, i);
+			if (par < d_param_range_left[i] || par > d_param_range_right[i]){
 				inRange = false;
 				break;
 			}
@@ -212,8 +239,8 @@ gsl_multimin_fminimizer * Fit::fitSimplex(gsl_multimin_function f, int &iteratio
 		if (!inRange)
 			break;
 
-		for (int i=0; i<d_p; i++)
-			d_results[i] = gsl_vector_get(s_min->x, i);
+		for (int i=0; i<p; i++)
+			results[i] = gsl_vector_get(s_min->x, i);
 
 		size = gsl_multimin_fminimizer_size (s_min);
 		status = gsl_multimin_test_size (size, d_tolerance);
@@ -225,6 +252,145 @@ gsl_multimin_fminimizer * Fit::fitSimplex(gsl_multimin_function f, int &iteratio
 	return s_min;
 }
 
+int Fit::solve(struct FitData *data, const gsl_vector *init, double *results, gsl_matrix *cov,
+				double& chi2, int& iterations, bool parallel) const
+{
+	// large data sets are split in blocks evaluated by several threads
+	ParallelFitData *pd = parallel ? parallel_fit_alloc(data, d_f, d_df, d_fdf, d_fsimplex) : 0;
+	void *params = pd ? (void *)pd : (void *)data;
+
+	int status;
+	if(d_solver == NelderMeadSimplex){
+		gsl_multimin_function f;
+		f.f = pd ? parallel_fit_d : d_fsimplex;
+		f.n = data->p;
+		f.params = params;
+		gsl_multimin_fminimizer *s_min = fitSimplex(f, init, results, iterations, status);
+
+		if (!status) {
+		     // allocate memory and calculate covariance matrix based on residuals
+		     gsl_matrix *J = gsl_matrix_alloc(data->n, data->p);
+		     (pd ? parallel_fit_df : d_df)(s_min->x, params, J);
+		     gsl_multifit_covar (J, 0.0, cov);
+		     chi2 = s_min->fval;
+
+		     // free previousely allocated memory
+		     gsl_matrix_free (J);
+		}
+		gsl_multimin_fminimizer_free (s_min);
+	} else {
+		gsl_multifit_function_fdf f;
+		f.f = pd ? parallel_fit_f : d_f;
+		f.df = pd ? parallel_fit_df : d_df;
+		f.fdf = pd ? parallel_fit_fdf : d_fdf;
+		f.n = data->n;
+		f.p = data->p;
+		f.params = params;
+
+		gsl_multifit_fdfsolver *s = fitGSL(f, init, results, cov, iterations, status);
+
+		chi2 = pow(gsl_blas_dnrm2(s->f), 2.0);
+		gsl_multifit_fdfsolver_free(s);
+	}
+	parallel_fit_free(pd);
+	return status;
+}
+
+//! Maximum number of reweighting passes of a robust fit
+static const int robust_fit_passes = 50;
+
+int Fit::robustSolve(struct FitData *data, const gsl_vector *init, double *results, gsl_matrix *cov,
+				double& chi2, int& iterations, int& passes, bool parallel) const
+{
+	int n = data->n, p = data->p;
+	double *w = data->sigma;
+	// the model is fitted with the robust weights rw, the residuals being evaluated with the initial weights w
+	QVector<double> rw(n), r(n);
+	for (int i = 0; i < n; i++)
+		rw[i] = w[i];
+	data->sigma = rw.data();
+
+	// the residuals of large data sets are evaluated by several threads
+	ParallelFitData *pd = parallel ? parallel_fit_alloc(data, d_f, d_df, d_fdf, d_fsimplex) : 0;
+
+	gsl_vector *x = gsl_vector_alloc(p);
+	gsl_vector_memcpy(x, init);
+	gsl_vector_view res = gsl_vector_view_array(results, p);
+	gsl_vector_view residuals = gsl_vector_view_array(r.data(), n);
+
+	int status = GSL_SUCCESS;
+	iterations = 0;
+	for (passes = 1; passes <= robust_fit_passes; passes++){
+		// each pass uses the solver of the model, e.g. the sparse solver of multi-peak fits
+		int iter;
+		status = solve(data, x, results, cov, chi2, iter, parallel);
+		iterations += iter;
+		if (status != GSL_SUCCESS && status != GSL_CONTINUE)
+			break;
+
+		bool converged = passes > 1;
+		for (int i = 0; i < p && converged; i++){
+			double dx = fabs(results[i] - gsl_vector_get(x, i));
+			converged = dx < d_tolerance*(1.0 + fabs(results[i]));
+		}
+		gsl_vector_memcpy(x, &res.vector);
+		if (converged || passes == robust_fit_passes)
+			break;
+
+		data->sigma = w;
+		int err = pd ? parallel_fit_f(&res.vector, pd, &residuals.vector) : d_f(&res.vector, data, &residuals.vector);
+		data->sigma = rw.data();
+		if (err){
+			status = err;
+			break;
+		}
+
+		if (robust_weights(d_robust_loss, d_robust_tuning, r.data(), w, rw.data(), n) == 0.0)
+			break;// exact fit
+	}
+	passes = qMin(passes, robust_fit_passes);
+
+	gsl_vector_free(x);
+	parallel_fit_free(pd);
+	data->sigma = w;
+	return status;
+}
+
+int Fit::polynomialSolve(int p, double *c, gsl_matrix *cov, double& chi2)
+{
+	const double *w = (d_weighting == NoWeighting) ? 0 : d_w;
+	d_robust_passes = 0;
+	if (d_robust_loss == LeastSquares)
+		return polynomial_fit(d_x, d_y, w, d_n, p, c, cov, &chi2);
+
+	QVector<double> rw(d_n), r(d_n), previous(p);
+	int status = polynomial_fit(d_x, d_y, w, d_n, p, c, cov, &chi2);
+	for (d_robust_passes = 1; status == GSL_SUCCESS && d_robust_passes < robust_fit_passes; d_robust_passes++){
+		polynomial_residuals(d_x, d_y, w, d_n, p, c, r.data());
+		if (robust_weights(d_robust_loss, d_robust_tuning, r.data(), w, rw.data(), d_n) == 0.0)
+			break;// exact fit
+
+		for (int i = 0; i < p; i++)
+			previous[i] = c[i];
+		status = polynomial_fit(d_x, d_y, rw.data(), d_n, p, c, cov, &chi2);
+
+		bool converged = true;
+		for (int i = 0; i < p && converged; i++)
+			converged = fabs(c[i] - previous[i]) < d_tolerance*(1.0 + fabs(c[i]));
+		if (converged){
+			d_robust_passes++;
+			break;
+		}
+	}
+
+	// the covariance of unweighted fits is scaled by chi^2/doF, as for gsl_multifit_linear
+	if (status != GSL_SUCCESS)
+		d_robust_passes = 0;// the caller falls back to an ordinary least squares fit
+	else if (!w && d_robust_passes > 1 && d_n > p)
+		gsl_matrix_scale(cov, chi2/(d_n - p));
+	return status;
+}
+
 bool Fit::setDataFromTable(Table *t, const QString& xColName, const QString& yColName, int from, int to, bool sort)
 {
 	if (Filter::setDataFromTable(t, xColName, yColName, from, to, sort)){
@@ -341,6 +507,18 @@ QString Fit::logFitInfo(int iterations, int status)
 			info+=tr("Scaled Levenberg-Marquardt");
 
 		info+=tr(" algorithm with tolerance = ") + locale.toString(d_tolerance)+"\n";
+		if (d_global_starts > 1)
+			info += tr("Global search from %1 starting points").arg(d_global_starts) + "\n";
+	}
+	if (d_robust_loss != LeastSquares){
+		QString loss = tr("Huber");
+		if (d_robust_loss == Cauchy)
+			loss = tr("Cauchy");
+		else if (d_robust_loss == Tukey)
+			loss = tr("Tukey biweight");
+		double tuning = (d_robust_tuning > 0.0) ? d_robust_tuning : robust_fit_tuning(d_robust_loss);
+		info += tr("Robust fit with the %1 loss function (tuning constant = %2), %3 reweighting passes")
+				.arg(loss).arg(locale.toString(tuning)).arg(d_robust_passes) + "\n";
 	}
 
 	info += tr("From x")+" = "+locale.toString(d_x[0], 'e', d_prec)+" "+tr("to x")+" = "+locale.toString(d_x[d_n-1], 'e', d_prec)+"\n";
@@ -684,104 +862,7 @@ QwtPlotCurve* Fit::showResiduals()
 
 void Fit::showConfidenceLimits(double confidenceLevel)
 {
-	if (!d_graphics_display)
-		return;
-
-	if (!d_n){
-		QMessageBox::critical((ApplicationWindow *)parent(), tr("QtiPlot - Fit Error"),
-				tr("Please perform a fit first!"));
-		return;
-	}
-
-	int points = d_n;
-	double *X = NULL;
-	if (d_gen_function){
-		X = (double *)malloc(d_points*sizeof(double));
-		if (!X){
-			QMessageBox::critical((ApplicationWindow *)parent(), tr("QtiPlot - Memory Allocation Error"),
-			tr("Not enough memory!"));
-			return;
-		}
-		points = d_points;
-		double X0 = d_from;
-		double step = fabs(d_from - d_to)/(points - 1);
-		for (int i = 0; i < points; i++)
-			X[i] = X0 + i*step;
-	} else
-		X = d_x;
-
-	double *lcl = (double *)malloc(d_points*sizeof(double));
-	if (!lcl){
-		QMessageBox::critical((ApplicationWindow *)parent(), tr("QtiPlot - Memory Allocation Error"),
-		tr("Not enough memory!"));
-		return;
-	}
-	double *ucl = (double *)malloc(d_points*sizeof(double));
-	if (!ucl){
-		QMessageBox::critical((ApplicationWindow *)parent(), tr("QtiPlot - Memory Allocation Error"),
-		tr("Not enough memory!"));
-		return;
-	}
-
-	ApplicationWindow *app = (ApplicationWindow *)parent();
-	Table *outputTable = app->newTable(points, 3, app->generateUniqueName(tr("FitStats"), true), tr("Confidence Limits of %1").arg(d_explanation));
-	if (!outputTable)
-		return;
-
-	outputTable->setColComment(0, tr("Independent Variable"));
-	outputTable->setColName(1, tr("LCL"));
-	outputTable->setColComment(1, tr("Lower %1 Confidence Limit").arg(confidenceLevel));
-	outputTable->setColName(2, tr("UCL"));
-	outputTable->setColComment(2, tr("Upper %1 Confidence Limit").arg(confidenceLevel));
-
-	double dof = d_n - d_p;
-	double t = gsl_cdf_tdist_Pinv(1 - 0.5*(1 - confidenceLevel), dof);
-	double x_mean = gsl_stats_mean(d_x, 1, d_n);
-	double sxx = 0.0;//gsl_stats_tss (d_x, 1, d_n);
-	for (int i = 0; i < d_n; i++){
-		double dx = d_x[i] - x_mean;
-		sxx += dx*dx;
-	}
-	double mse = d_rss/dof;
-
-	for (int i = 0; i < points; i++){
-		double x = X[i];
-		double dx = x - x_mean;
-		double aux = t*sqrt(mse*(1.0/(double)d_n + dx*dx/sxx));
-
-		outputTable->setCell(i, 0, x);
-		double y = eval(d_results, x);
-		double lowLimit = y - aux;
-		outputTable->setCell(i, 1, lowLimit);
-		lcl[i] = lowLimit;
-		double upLimit = y + aux;
-		outputTable->setCell(i, 2, upLimit);
-		ucl[i] = upLimit;
-	}
-
-	for (int i = 0; i < outputTable->numCols(); i++)
-		outputTable->table()->adjustColumn(i);
-	app->hideWindow(outputTable);
-
-	if (!d_output_graph)
-		createOutputGraph();
-
-	QString tableName = outputTable->objectName();
-	DataCurve *c = new DataCurve(outputTable, tableName + "_1", tableName + "_LCL");
-	c->setData(X, lcl, points);
-	c->setPen(QPen(ColorBox::color(ColorBox::colorIndex(d_curveColor) + 2), 1));
-	d_output_graph->insertPlotItem(c, Graph::Line);
-
-	c = new DataCurve(outputTable, tableName + "_1", tableName + "_UCL");
-	c->setData(X, ucl, points);
-	c->setPen(QPen(ColorBox::color(ColorBox::colorIndex(d_curveColor) + 2), 1));
-	d_output_graph->insertPlotItem(c, Graph::Line);
-
-    d_output_graph->updatePlot();
-	free (lcl);
-	free (ucl);
-	if (d_gen_function)
-		free (X);
+	showBands(confidenceLevel, false);
 }
 
 double Fit::lcl(int parIndex, double confidenceLevel)
@@ -805,6 +886,34 @@ double Fit::ucl(int parIndex, double confidenceLevel)
 }
 
 void Fit::showPredictionLimits(double confidenceLevel)
+{
+	showBands(confidenceLevel, true);
+}
+
+void Fit::modelGradient(double *X, int points, double *Y, gsl_matrix *G)
+{
+	QVector<double> par(d_p);
+	for (int j = 0; j < d_p; j++)
+		par[j] = d_results[j];
+
+	double *P = par.data();
+	for (int i = 0; i < points; i++){
+		double x = X[i];
+		Y[i] = eval(P, x);
+		for (int j = 0; j < d_p; j++){
+			double pj = P[j];
+			double h = GSL_ROOT3_DBL_EPSILON*(pj != 0.0 ? fabs(pj) : 1.0);
+			P[j] = pj + h;
+			double up = eval(P, x);
+			P[j] = pj - h;
+			double down = eval(P, x);
+			P[j] = pj;
+			gsl_matrix_set(G, i, j, 0.5*(up - down)/h);
+		}
+	}
+}
+
+void Fit::showBands(double confidenceLevel, bool prediction)
 {
 	if (!d_graphics_display)
 		return;
@@ -815,94 +924,120 @@ void Fit::showPredictionLimits(double confidenceLevel)
 		return;
 	}
 
-	int points = d_n;
-	double *X = NULL;
+	int points = d_gen_function ? d_points : d_n;
+	gsl_matrix *G = gsl_matrix_alloc(points, d_p);
+	if (!G){
+		QMessageBox::critical((ApplicationWindow *)parent(), tr("QtiPlot - Memory Allocation Error"),
+		tr("Not enough memory!"));
+		return;
+	}
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+
+	QVector<double> X(points), Y(points), lcl(points), ucl(points);
 	if (d_gen_function){
-		X = (double *)malloc(d_points*sizeof(double));
-		if (!X){
-			QMessageBox::critical((ApplicationWindow *)parent(), tr("QtiPlot - Memory Allocation Error"),
-			tr("Not enough memory!"));
-			return;
-		}
-		points = d_points;
 		double X0 = d_from;
 		double step = fabs(d_to - d_from)/(points - 1);
 		for (int i = 0; i < points; i++)
 			X[i] = X0 + i*step;
-	} else
-		X = d_x;
+	} else {
+		for (int i = 0; i < points; i++)
+			X[i] = d_x[i];
+	}
 
-	double *lcl = (double *)malloc(d_points*sizeof(double));
-	if (!lcl){
-		QMessageBox::critical((ApplicationWindow *)parent(), tr("QtiPlot - Memory Allocation Error"),
-		tr("Not enough memory!"));
-		return;
+	// the values and the gradients of the model are calculated for all the points in a single pass
+	modelGradient(X.data(), points, Y.data(), G);
+
+	// the variance of the fitted value at x is g^T C g, g being the gradient of the model and C the covariance matrix.
+	// Only instrumental weights give absolute variances, otherwise the variance of unit weight is estimated by chi^2/dof.
+	// The covariance of unweighted linear fits is already scaled by chi^2/dof.
+	double dof = d_n - d_p;
+	double t = gsl_cdf_tdist_Pinv(1 - 0.5*(1 - confidenceLevel), dof);
+	double s2 = (d_scale_errors || d_weighting != Instrumental) ? chi_2/dof : 1.0;
+	double scale = (!is_non_linear && d_weighting == NoWeighting) ? 1.0 : s2;
+
+	// the prediction bands also include the variance of the data, s2/w: the mean value is used for generated points
+	QVector<double> var(points, 0.0);
+	if (prediction){
+		double mean = 0.0;
+		int count = 0;
+		for (int i = 0; i < d_n; i++){
+			if (d_w[i] > 0.0){
+				mean += 1.0/d_w[i];
+				count++;
+			}
+		}
+		mean = count ? s2*mean/count : s2;
+		for (int i = 0; i < points; i++)
+			var[i] = (!d_gen_function && d_w[i] > 0.0) ? s2/d_w[i] : mean;
 	}
-	double *ucl = (double *)malloc(d_points*sizeof(double));
-	if (!ucl){
-		QMessageBox::critical((ApplicationWindow *)parent(), tr("QtiPlot - Memory Allocation Error"),
-		tr("Not enough memory!"));
-		return;
+
+	// the products G*C are calculated by blocks of rows, in order to limit the memory usage
+	const int block = 4096;
+	gsl_matrix *GC = gsl_matrix_alloc(qMin(block, points), d_p);
+	for (int start = 0; start < points; start += block){
+		int size = qMin(block, points - start);
+		gsl_matrix_view g = gsl_matrix_submatrix(G, start, 0, size, d_p);
+		gsl_matrix_view gc = gsl_matrix_submatrix(GC, 0, 0, size, d_p);
+		gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, &g.matrix, covar, 0.0, &gc.matrix);
+		for (int i = 0; i < size; i++){
+			gsl_vector_view gi = gsl_matrix_row(&g.matrix, i);
+			gsl_vector_view gci = gsl_matrix_row(&gc.matrix, i);
+			double q;
+			gsl_blas_ddot(&gi.vector, &gci.vector, &q);
+			double aux = t*sqrt(scale*q + var[start + i]);
+			double y = Y[start + i];
+			lcl[start + i] = y - aux;
+			ucl[start + i] = y + aux;
+		}
 	}
+	gsl_matrix_free(GC);
+	gsl_matrix_free(G);
 
 	ApplicationWindow *app = (ApplicationWindow *)parent();
-	Table *outputTable = app->newTable(points, 3, app->generateUniqueName(tr("FitStats"), true), tr("Prediction Limits of %1").arg(d_explanation));
-	if (!outputTable)
+	QString title = prediction ? tr("Prediction Limits of %1") : tr("Confidence Limits of %1");
+	Table *outputTable = app->newTable(points, 3, app->generateUniqueName(tr("FitStats"), true), title.arg(d_explanation));
+	if (!outputTable){
+		QApplication::restoreOverrideCursor();
 		return;
+	}
 
+	QString lowName = prediction ? tr("LPL") : tr("LCL");
+	QString upName = prediction ? tr("UPL") : tr("UCL");
 	outputTable->setColComment(0, tr("Independent Variable"));
-	outputTable->setColName(1, tr("LPL"));
-	outputTable->setColComment(1, tr("Lower %1 Prediction Limit").arg(confidenceLevel));
-	outputTable->setColName(2, tr("UPL"));
-	outputTable->setColComment(2, tr("Upper %1 Prediction Limit").arg(confidenceLevel));
-
-	double dof = d_n - d_p;
-	double t = gsl_cdf_tdist_Pinv(1 - 0.5*(1 - confidenceLevel), dof);
-	double x_mean = gsl_stats_mean(d_x, 1, d_n);
-	double sxx = 0.0;
-	for (int i = 0; i < d_n; i++){
-		double dx = d_x[i] - x_mean;
-		sxx += dx*dx;
-	}
-	double mse = d_rss/dof;
-	for (int i = 0; i < points; i++){
-		double x = X[i];
-		double dx = x - x_mean;
-		double aux = t*sqrt(mse*(1 + 1.0/(double)d_n + dx*dx/sxx));
-
-		outputTable->setCell(i, 0, x);
-		double y = eval(d_results, x);
-		double lowLimit = y - aux;
-		outputTable->setCell(i, 1, lowLimit);
-		lcl[i] = lowLimit;
-		double upLimit = y + aux;
-		outputTable->setCell(i, 2, upLimit);
-		ucl[i] = upLimit;
+	outputTable->setColName(1, lowName);
+	outputTable->setColName(2, upName);
+	if (prediction){
+		outputTable->setColComment(1, tr("Lower %1 Prediction Limit").arg(confidenceLevel));
+		outputTable->setColComment(2, tr("Upper %1 Prediction Limit").arg(confidenceLevel));
+	} else {
+		outputTable->setColComment(1, tr("Lower %1 Confidence Limit").arg(confidenceLevel));
+		outputTable->setColComment(2, tr("Upper %1 Confidence Limit").arg(confidenceLevel));
 	}
 
-	for (int i = 0; i < outputTable->numCols(); i++)
-		outputTable->table()->adjustColumn(i);
+	outputTable->setColumnValues(0, X.data(), points);
+	outputTable->setColumnValues(1, lcl.data(), points);
+	outputTable->setColumnValues(2, ucl.data(), points);
+	// the columns are not adjusted to their contents, which would mean reading all the rows of the hidden table
 	app->hideWindow(outputTable);
 
 	if (!d_output_graph)
 		createOutputGraph();
 
+	QColor color = ColorBox::color(ColorBox::colorIndex(d_curveColor) + (prediction ? 3 : 2));
 	QString tableName = outputTable->objectName();
-	DataCurve *c = new DataCurve(outputTable, tableName + "_1", tableName + "_LPL");
-	c->setData(X, lcl, points);
-	c->setPen(QPen(ColorBox::color(ColorBox::colorIndex(d_curveColor) + 3), 1));
+	DataCurve *c = new DataCurve(outputTable, tableName + "_1", tableName + "_" + lowName);
+	c->setData(X.data(), lcl.data(), points);
+	c->setPen(QPen(color, 1));
 	d_output_graph->insertPlotItem(c, Graph::Line);
 
-	c = new DataCurve(outputTable, tableName + "_1", tableName + "_UPL");
-	c->setData(X, ucl, points);
-	c->setPen(QPen(ColorBox::color(ColorBox::colorIndex(d_curveColor) + 3), 1));
+	c = new DataCurve(outputTable, tableName + "_1", tableName + "_" + upName);
+	c->setData(X.data(), ucl.data(), points);
+	c->setPen(QPen(color, 1));
 	d_output_graph->insertPlotItem(c, Graph::Line);
 
-    d_output_graph->updatePlot();
-	free (lcl);
-	free (ucl);
-	if (d_gen_function)
-		free (X);
+	d_output_graph->updatePlot();
+	QApplication::restoreOverrideCursor();
 }
 
 void Fit::fit()
@@ -936,49 +1071,276 @@ void Fit::fit()
 
 	QApplication::setOverrideCursor(Qt::WaitCursor);
 
-	struct FitData d_data = {d_n, d_p, d_x, d_y, d_w, this};
+	struct FitData d_data = {d_n, d_p, d_x, d_y, d_w, this, compiledModel()};
+	int iterations = d_max_iterations;
+	int status;
+	d_robust_passes = 0;
+	if (d_global_starts > 1)
+		status = globalSearch(&d_data, d_results, covar, chi_2, iterations);
+	else if (d_robust_loss == LeastSquares)
+		status = solve(&d_data, d_param_init, d_results, covar, chi_2, iterations);
+
+	if (d_robust_loss != LeastSquares){
+		// the robust fit starts from the result of the global search
+		gsl_vector *init = d_param_init;
+		if (d_global_starts > 1){
+			init = gsl_vector_alloc(d_p);
+			for (int i = 0; i < d_p; i++)
+				gsl_vector_set(init, i, d_results[i]);
+		}
+		int iter;
+		status = robustSolve(&d_data, init, d_results, covar, chi_2, iter, d_robust_passes);
+		iterations = (d_global_starts > 1) ? iterations + iter : iter;
+		if (init != d_param_init)
+			gsl_vector_free(init);
+	}
 
-	int status, iterations = d_max_iterations;
-	if(d_solver == NelderMeadSimplex){
-		gsl_multimin_function f;
-		f.f = d_fsimplex;
-		f.n = d_p;
-		f.params = &d_data;
-		gsl_multimin_fminimizer *s_min = fitSimplex(f, iterations, status);
+	generateFitCurve();
 
-		if (!status) {
-		     // allocate memory and calculate covariance matrix based on residuals
-		     gsl_matrix *J = gsl_matrix_alloc(d_n, d_p);
-		     d_df(s_min->x,(void*)f.params, J);
-		     gsl_multifit_covar (J, 0.0, covar);
-		     chi_2 = s_min->fval;
+	ApplicationWindow *app = (ApplicationWindow *)parent();
+	if (app->writeFitResultsToLog())
+		app->updateLog(logFitInfo(iterations, status));
 
-		     // free previousely allocated memory
-		     gsl_matrix_free (J);
+	QApplication::restoreOverrideCursor();
+}
+
+//! Shared state of the threads of a global search (see Fit::globalSearch())
+struct MultiStartSearch
+{
+	struct Job
+	{
+		QVector<double> start;
+		QVector<double> results;
+		double chi2;
+		int status;
+		bool fitted;
+	};
+
+	struct FitData data;
+	//! Evaluators of the model used by the threads (see fit_evaluator_alloc())
+	QVector<void *> evaluators;
+	//! Jobs of the current stage: only the chi^2 of the starting points is computed if localFits is false
+	Job *jobs;
+	int count;
+	bool localFits;
+
+	QAtomicInt next;
+	QAtomicInt done;
+	QAtomicInt canceled;
+};
+
+void Fit::searchStarts(MultiStartSearch *search, int thread)
+{
+	const Fit *fit = search->data.fitter;
+	int p = search->data.p;
+	struct FitData data = search->data;
+	data.evaluator = search->evaluators[thread];
+
+	gsl_vector *x = gsl_vector_alloc(p);
+	gsl_matrix *cov = gsl_matrix_alloc(p, p);
+	while (!search->canceled){
+		int index = search->next.fetchAndAddOrdered(1);
+		if (index >= search->count)
+			break;
+
+		MultiStartSearch::Job *job = search->jobs + index;
+		for (int i = 0; i < p; i++)
+			gsl_vector_set(x, i, job->start[i]);
+
+		if (search->localFits){
+			int iterations = 0;
+			job->status = fit->solve(&data, x, job->results.data(), cov, job->chi2, iterations, false);
+			job->fitted = true;
+		} else
+			job->chi2 = fit->d_fsimplex(x, &data);
+
+		if (!gsl_finite(job->chi2))
+			job->chi2 = GSL_POSINF;
+		search->done.ref();
+	}
+	gsl_vector_free(x);
+	gsl_matrix_free(cov);
+}
+
+bool Fit::runSearchJobs(MultiStartSearch *search, const QString& label)
+{
+	search->next = 0;
+	search->done = 0;
+
+#if QT_VERSION >= 0x040400
+	int threads = search->evaluators.size();
+	if (threads > 1){
+		QList<QFuture<void> > futures;
+		for (int i = 0; i < threads; i++)
+			futures << QtConcurrent::run(searchStarts, search, i);
+
+		QProgressDialog progress((ApplicationWindow *)parent());
+		progress.setWindowTitle(tr("QtiPlot") + " - " + tr("Global search"));
+		progress.setLabelText(label);
+		progress.setWindowModality(Qt::ApplicationModal);
+		progress.setRange(0, search->count);
+
+		QTimer timer;
+		timer.start(100);
+		foreach(QFuture<void> future, futures){
+			while (!future.isFinished()){
+				if (progress.wasCanceled())
+					search->canceled = 1;
+				progress.setValue(search->done);
+				qApp->processEvents(QEventLoop::WaitForMoreEvents);
+			}
 		}
-		gsl_multimin_fminimizer_free (s_min);
-	} else {
-		gsl_multifit_function_fdf f;
-		f.f = d_f;
-		f.df = d_df;
-		f.fdf = d_fdf;
-		f.n = d_n;
-		f.p = d_p;
-		f.params = &d_data;
+		progress.setValue(search->count);
+	} else
+#endif
+		searchStarts(search, 0);
 
-		gsl_multifit_fdfsolver *s = fitGSL(f, iterations, status);
+	return !search->canceled;
+}
 
-		chi_2 = pow(gsl_blas_dnrm2(s->f), 2.0);
-		gsl_multifit_fdfsolver_free(s);
+int Fit::globalSearch(struct FitData *data, double *results, gsl_matrix *cov, double& chi2, int& iterations)
+{
+	int p = d_p;
+	int starts = d_global_starts;
+
+	int threads = 1;
+#if QT_VERSION >= 0x040400
+	if (isThreadSafe())
+		threads = qMax(1, qMin(QThread::idealThreadCount(), starts));
+#endif
+
+	MultiStartSearch search;
+	search.data = *data;
+	search.evaluators = QVector<void *>(threads, (void *)0);
+	search.canceled = 0;
+	//the evaluators are created in the GUI thread, since MyParser reads the locale of the application widgets
+	try {
+		for (int i = 0; i < threads; i++)
+			search.evaluators[i] = fit_evaluator_alloc(data, d_f);
+	} catch (mu::ParserError &) {
+		foreach(void *evaluator, search.evaluators)
+			fit_evaluator_free(evaluator);
+		// the error is reported by the local fit
+		return solve(data, d_param_init, results, cov, chi2, iterations);
 	}
 
-	generateFitCurve();
+	// the search box is given by the parameter ranges, unbounded ranges are replaced by an interval around the initial guess;
+	// ranges of positive values spanning several decades (e.g. decay times) are sampled on a logarithmic scale
+	QVector<double> lo(p), hi(p);
+	QVector<bool> logScale(p);
+	for (int i = 0; i < p; i++){
+		double init = gsl_vector_get(d_param_init, i);
+		double span = 10.0*qMax(fabs(init), 1.0);
+		double left = d_param_range_left[i];
+		double right = d_param_range_right[i];
+		lo[i] = left > -DBL_MAX ? left : qMin(init, right) - span;
+		hi[i] = right < DBL_MAX ? right : qMax(init, left) + span;
+		logScale[i] = lo[i] > 0.0 && hi[i] >= 100.0*lo[i];
+	}
 
-	ApplicationWindow *app = (ApplicationWindow *)parent();
-	if (app->writeFitResultsToLog())
-		app->updateLog(logFitInfo(iterations, status));
+	// the first job starts from the initial guesses, the other ones from a Latin hypercube sample of the search box:
+	// the range of each parameter is divided in starts - 1 strata, each of them holding exactly one point.
+	// A fixed seed is used, so that the fit results are reproducible.
+	QVector<MultiStartSearch::Job> jobs(starts);
+	for (int k = 0; k < starts; k++){
+		jobs[k].start.resize(p);
+		jobs[k].results.resize(p);
+		jobs[k].chi2 = GSL_POSINF;
+		jobs[k].status = GSL_FAILURE;
+		jobs[k].fitted = false;
+	}
+	for (int i = 0; i < p; i++)
+		jobs[0].start[i] = gsl_vector_get(d_param_init, i);
+
+	gsl_rng *r = gsl_rng_alloc(gsl_rng_mt19937);
+	int m = starts - 1;
+	QVector<int> strata(m);
+	for (int i = 0; i < p; i++){
+		for (int k = 0; k < m; k++)
+			strata[k] = k;
+		gsl_ran_shuffle(r, strata.data(), m, sizeof(int));
+		for (int k = 0; k < m; k++){
+			double u = (strata[k] + gsl_rng_uniform(r))/m;
+			if (logScale[i])
+				jobs[k + 1].start[i] = lo[i]*pow(hi[i]/lo[i], u);
+			else
+				jobs[k + 1].start[i] = lo[i] + u*(hi[i] - lo[i]);
+		}
+	}
+	gsl_rng_free(r);
 
+	// screening of the starting points
+	search.jobs = jobs.data();
+	search.count = starts;
+	search.localFits = false;
 	QApplication::restoreOverrideCursor();
+	bool finished = runSearchJobs(&search, tr("Evaluating %1 starting points...").arg(starts));
+
+	QList<QPair<double, int> > ranking;
+	for (int k = 0; k < starts; k++)
+		ranking << qMakePair(jobs[k].chi2, k);
+	qSort(ranking);
+
+	// local fits from the best starting points
+	int localFits = qMin(starts, qMax(4, starts/5));
+	QVector<MultiStartSearch::Job> best(localFits);
+	for (int k = 0; k < localFits; k++)
+		best[k] = jobs[ranking[k].second];
+
+	if (finished){
+		search.jobs = best.data();
+		search.count = localFits;
+		search.localFits = true;
+		runSearchJobs(&search, tr("Fitting from the %1 best starting points...").arg(localFits));
+	}
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+
+	foreach(void *evaluator, search.evaluators)
+		fit_evaluator_free(evaluator);
+
+	// if the search was canceled, the best point found so far is polished
+	int bestFit = 0;
+	for (int k = 0; k < localFits; k++){
+		if (!best[k].fitted)
+			best[k].results = best[k].start;
+		if (best[k].chi2 < best[bestFit].chi2)
+			bestFit = k;
+	}
+
+	// the best local result is polished by the Levenberg-Marquardt algorithm
+	gsl_vector *init = gsl_vector_alloc(p);
+	for (int i = 0; i < p; i++)
+		gsl_vector_set(init, i, best[bestFit].results[i]);
+
+	Algorithm solver = d_solver;
+	if (d_solver == NelderMeadSimplex)
+		d_solver = ScaledLevenbergMarquardt;
+	int status = solve(data, init, results, cov, chi2, iterations);
+	d_solver = solver;
+
+	gsl_vector_free(init);
+	return status;
+}
+
+void* Fit::compiledModel()
+{
+	QString key = compiledModelKey();
+	if (!d_evaluator_key.isNull() && key == d_evaluator_key)
+		return d_evaluator;
+
+	fit_evaluator_free(d_evaluator);
+	d_evaluator = 0;
+
+	prepareModel();
+	// the key can depend on the state of the prepared model (e.g. a plugin loaded by NonLinearFit)
+	d_evaluator_key = compiledModelKey();
+	struct FitData data = {0, d_p, 0, 0, 0, this, 0};
+	try {
+		d_evaluator = fit_evaluator_alloc(&data, d_f);
+	} catch (mu::ParserError &) {
+		// the error is reported when the model is evaluated
+	}
+	return d_evaluator;
 }
 
 void Fit::generateFitCurve()
@@ -1185,6 +1547,7 @@ void Fit::freeMemory()
 Fit::~Fit()
 {
 	freeMemory();
+	fit_evaluator_free(d_evaluator);
 
 	if (!d_p)
 		return;
@@ -39,11 +39,15 @@
 
 class Table;
 class Matrix;
+struct FitData;
+struct MultiStartSearch;
 
 //! Fit base class
 class Fit : public Filter
 {
 	Q_OBJECT
+	friend class BatchFit;
+	friend class GlobalFit;
 
 	public:
 
@@ -55,6 +59,8 @@ class Fit : public Filter
 		enum Algorithm{ScaledLevenbergMarquardt, UnscaledLevenbergMarquardt, NelderMeadSimplex};
 		enum WeightingMethod{NoWeighting, Instrumental, Statistical, Dataset, Direct};
         enum FitType{BuiltIn = 0, Plugin = 1, User = 2};
+		//! Loss functions of the robust fits, the points with large residuals being down-weighted
+		enum RobustLoss{LeastSquares = 0, Huber = 1, Cauchy = 2, Tukey = 3};
 
 		Fit(ApplicationWindow *parent, QwtPlotCurve *c);
 		Fit(ApplicationWindow *parent, Graph *g = 0, const QString& name = QString());
@@ -89,6 +95,19 @@ class Fit : public Filter
 		void setParameterRange(int parIndex, double left, double right);
 		void setAlgorithm(Algorithm s){d_solver = s;};
 
+		/*! Enables a multi-start global search using the given number of starting points, sampled
+		 * within the parameter ranges. The search is disabled if starts < 2.
+		 */
+		void setGlobalSearch(int starts){d_global_starts = starts;};
+		int globalSearchStarts(){return d_global_starts;};
+
+		/*! Fits the model minimizing the robust loss function instead of the sum of squares, by iteratively
+		 * reweighted least squares. The residuals are scaled by their median absolute deviation multiplied by
+		 * the tuning constant; the default constant of the loss function is used if tuning <= 0.
+		 */
+		void setRobustLoss(RobustLoss loss, double tuning = 0.0){d_robust_loss = loss; d_robust_tuning = tuning;};
+		RobustLoss robustLoss(){return d_robust_loss;};
+
 		//! Specifies weather the result of the fit is a function curve
 		void generateFunction(bool yes, int points = 100);
 
@@ -149,14 +168,19 @@ class Fit : public Filter
         //! Calculates the data for the output fit curve
         virtual double eval(double *, double){return 0.0;};
 
+		//! Returns false if the model functions must not be called by several threads at once (see PluginFit)
+		virtual bool isThreadSafe() const {return true;};
+
 	private:
 		void init();
 
 		//! Pointer to the GSL multifit minimizer (for simplex algorithm)
-		gsl_multimin_fminimizer * fitSimplex(gsl_multimin_function f, int &iterations, int &status);
+		gsl_multimin_fminimizer * fitSimplex(gsl_multimin_function f, const gsl_vector *init, double *results, int &iterations, int &status) const;
 
 		//! Pointer to the GSL multifit solver
-		gsl_multifit_fdfsolver * fitGSL(gsl_multifit_function_fdf f, int &iterations, int &status);
+		gsl_multifit_fdfsolver * fitGSL(gsl_multifit_function_fdf f, const gsl_vector *init, double *results, gsl_matrix *cov, int &iterations, int &status) const;
+		//! Iterates the GSL solver s from init, returns the GSL status
+		int iterateGSL(gsl_multifit_fdfsolver *s, gsl_multifit_function_fdf *f, const gsl_vector *init, double *results, gsl_matrix *cov, int &iterations) const;
 
 		//! Customs and stores the fit results according to the derived class specifications. Used by exponential fits.
 		virtual void customizeFitResults(){};
@@ -164,7 +188,41 @@ class Fit : public Filter
 		//! Removes any data singularities before fitting
 		virtual bool removeDataSingularities(){return true;};
 
+		/*! Multi-start global search: the initial guesses and a Latin hypercube sample of the parameter ranges
+		 * are screened by their chi^2, local fits are started concurrently from the best points and the best
+		 * local result is polished by the Levenberg-Marquardt algorithm. Returns the GSL status of the final fit.
+		 */
+		int globalSearch(struct FitData *data, double *results, gsl_matrix *cov, double& chi2, int& iterations);
+		//! Runs the jobs of the current stage of a global search, returns false if the search was canceled
+		bool runSearchJobs(MultiStartSearch *search, const QString& label);
+		//! Processes the jobs of a global search assigned to a thread
+		static void searchStarts(MultiStartSearch *search, int thread);
+
 	protected:
+		/*! Fits the model to data starting from the parameters init and returns the GSL status.
+		 * Only reads the state of the fitter, so that several data sets can be fitted concurrently (see BatchFit).
+		 * If parallel is true, large data sets are evaluated by several threads.
+		 */
+		virtual int solve(struct FitData *data, const gsl_vector *init, double *results, gsl_matrix *cov,
+				double& chi2, int& iterations, bool parallel = true) const;
+		/*! Robust fit of the model by iteratively reweighted least squares (see setRobustLoss()): the model is fitted
+		 * again with the weights of the robust loss function until the parameters converge, each pass calling solve().
+		 * Returns the GSL status of the last pass and the number of passes.
+		 */
+		int robustSolve(struct FitData *data, const gsl_vector *init, double *results, gsl_matrix *cov,
+				double& chi2, int& iterations, int& passes, bool parallel = true) const;
+		/*! Least squares fit of a polynomial with p coefficients to the data (see polynomial_fit()), robust if a loss
+		 * function was set. Returns GSL_ESING if the problem is rank deficient.
+		 */
+		int polynomialSolve(int p, double *c, gsl_matrix *cov, double& chi2);
+
+		//! Returns the compiled evaluator of the model, which is kept between fits as long as compiledModelKey() doesn't change
+		void* compiledModel();
+		//! Identifies the compiled model: formula and parameter names
+		virtual QString compiledModelKey(){return d_formula + ";" + d_param_names.join(",");};
+		//! Called by compiledModel() when the model changed, before its evaluator is allocated
+		virtual void prepareModel(){};
+
 		//! Allocates the memory for the fit workspace
 		void initWorkspace(int par);
 		//! Frees the memory allocated for the fit workspace
@@ -180,6 +238,13 @@ class Fit : public Filter
         //! Calculates the data for the output fit curve and store itin the X an Y vectors
 		virtual void calculateFitCurveData(double *X, double *Y) {Q_UNUSED(X) Q_UNUSED(Y)};
 
+		/*! Calculates the values Y of the fitted model at the abscissae X and its gradients with respect
+		 * to the parameters (one row of G for each point). The default implementation uses central differences of eval().
+		 */
+		virtual void modelGradient(double *X, int points, double *Y, gsl_matrix *G);
+		//! Writes the confidence or prediction bands of the fitted model to a new table and adds them to the output graph
+		void showBands(double confidenceLevel, bool prediction);
+
 		//! Output string added to the result log
 		virtual QString logFitInfo(int iterations, int status);
 
@@ -266,6 +331,19 @@ class Fit : public Filter
 
 		//! Stores the right limits of the research interval for the result parameters
 		double *d_param_range_right;
+
+		//! Number of starting points of the global search (disabled if < 2)
+		int d_global_starts;
+
+		//! Robust loss function and its tuning constant (see setRobustLoss())
+		RobustLoss d_robust_loss;
+		double d_robust_tuning;
+		//! Number of reweighting passes of the last robust fit
+		int d_robust_passes;
+
+		//! Compiled evaluator of the model (see fit_evaluator_alloc()) and the key it was built for
+		void *d_evaluator;
+		QString d_evaluator_key;
 };
 
 #endif
@@ -0,0 +1,370 @@
+/***************************************************************************
+	File                 : FitCompiler.cpp
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Compiles user defined fit models into native fit plugins
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#include "FitCompiler.h"
+#include "NonLinearFit.h"
+#include <MyParser.h>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QProcess>
+#include <QSet>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+#if QT_VERSION >= 0x040400
+#include <QtConcurrentRun>
+#endif
+
+#include <map>
+#include <string>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+//! Maximum duration of a compilation, in milliseconds
+static const int compiler_timeout = 60000;
+
+//! Protects the state of the compilations, which run in worker threads
+static QMutex compiler_mutex;
+//! Set when the compiler can't be started, so that it is not tried for each fit
+static bool no_compiler = false;
+//! Libraries being compiled, ready to be loaded and which could not be compiled
+static QSet<QString> compiling_plugins, compiled_plugins, failed_plugins;
+
+//! Escapes a string written in a C string literal
+static QString cString(const QString& s)
+{
+	QString res = s;
+	res.replace("\\", "\\\\");
+	res.replace("\"", "\\\"");
+	res.replace("\n", "\\n");
+	return res;
+}
+
+QString FitCompiler::compiler()
+{
+	QString cc = QString::fromLocal8Bit(qgetenv("CC"));
+	if (!cc.isEmpty())
+		return cc;
+#ifdef Q_OS_WIN
+	return "gcc";
+#else
+	return "cc";
+#endif
+}
+
+QString FitCompiler::cacheFolder()
+{
+	// the libraries are loaded in the application, so they are never stored in a folder shared with other users
+	QString folder = QString::fromLocal8Bit(qgetenv("XDG_CACHE_HOME"));
+	if (folder.isEmpty())
+		folder = QDir::homePath() + "/.cache";
+	return folder + "/qtiplot/fit-plugins";
+}
+
+//! Returns true if the file belongs to the current user and can't be modified by other users
+static bool isPrivate(const QFileInfo& fi)
+{
+	if (!fi.exists() || fi.isSymLink())
+		return false;
+#ifdef Q_OS_UNIX
+	if (fi.ownerId() != (uint)getuid())
+		return false;
+	if (fi.permissions() & (QFile::WriteGroup | QFile::WriteOther))
+		return false;
+#endif
+	return true;
+}
+
+//! Creates the cache folder, readable only by the current user (0700), returns false if it can't be trusted
+static bool createCacheFolder(const QString& path)
+{
+	QDir dir(path);
+	if (!dir.exists() && !dir.mkpath(path))
+		return false;
+
+	QFile::setPermissions(path, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner);
+	QFileInfo fi(path);
+	if (!isPrivate(fi) || !fi.isDir())
+		return false;
+#ifdef Q_OS_UNIX
+	if (fi.permissions() & (QFile::ReadGroup | QFile::ExeGroup | QFile::ReadOther | QFile::ExeOther))
+		return false;
+#endif
+	return true;
+}
+
+QString FitCompiler::source(NonLinearFit *fit)
+{
+	QStringList params = fit->parameterNames();
+	int p = params.size();
+	if (!p || fit->formula().isEmpty())
+		return QString();
+
+	// the variables are defined as for the parser evaluating the model during the fit
+	MyParser parser;
+	double x = 0.0;
+	QVector<double> values(p, 1.0);
+	double *par = values.data();
+	std::map<double *, std::string> names;
+	parser.DefineVar("x", &x);
+	names[&x] = "x";
+	for (int i = 0; i < p; i++){
+		parser.DefineVar(params[i].toStdString(), &par[i]);
+		names[&par[i]] = QString("p[%1]").arg(i).toStdString();
+	}
+
+	QMapIterator<QString, double> it(fit->constants());
+	while (it.hasNext()){
+		it.next();
+		parser.DefineConst(it.key().toStdString(), it.value());
+	}
+
+	std::string model;
+	std::vector<std::string> derivatives(p);
+	try {
+		parser.SetExpr(fit->formula().toStdString());
+		if (!parser.compiledSource(names, model))
+			return QString();
+		// the derivatives which can't be written are approximated numerically
+		for (int i = 0; i < p; i++){
+			if (!parser.compiledSource(names, derivatives[i], &par[i]))
+				derivatives[i].clear();
+		}
+	} catch (mu::ParserError &) {
+		return QString();
+	}
+
+	QString formula = fit->formula();
+	QString code;
+	QTextStream out(&code);
+	out << "/* Fit plugin generated by QtiPlot for the model: " << QString(formula).replace("*/", "* /") << " */\n";
+	out << "#include <math.h>\n#include <float.h>\n#include <stddef.h>\n\n";
+	out << "/* layout of the GSL vectors and matrices, so that the GSL headers are not needed */\n";
+	out << "typedef struct {size_t size; size_t stride; double *data; void *block; int owner;} gsl_vector;\n";
+	out << "typedef struct {size_t size1; size_t size2; size_t tda; double *data; void *block; int owner;} gsl_matrix;\n\n";
+	out << "struct data {int n; int p; double *X; double *Y; double *sigma;};\n\n";
+	out << "typedef double (*model_function)(double, const double *);\n\n";
+	out << "#define P " << p << "\n";
+	out << "#define GSL_SUCCESS 0\n#define GSL_ESING 21\n";
+	out << "#ifndef NAN\n#define NAN (0.0/0.0)\n#endif\n\n";
+	out << QString::fromStdString(CompiledExpression::cFunctions()) << "\n";
+
+	out << "char *name(){return \"" << cString(fit->objectName()) << "\";}\n";
+	out << "char *function(){return \"" << cString(formula) << "\";}\n";
+	out << "char *parameters(){return \"" << cString(params.join(",")) << "\";}\n\n";
+
+	out << "static double model(double x, const double *p){return " << QString::fromStdString(model) << ";}\n\n";
+
+	out << "static int is_finite(double v){return v == v && v - v == 0.0;}\n\n";
+	// same rules as MyParser::EvalRemoveSingularity(): the callers map NaN values to GSL_ESING
+	out << "/* removable singularities are evaluated as the mean of the neighbouring values, poles give NaN */\n";
+	out << "static double regular(model_function f, double x, const double *p)\n{\n";
+	out << "\tdouble y = f(x, p), yp, ym, h;\n\tint e;\n";
+	out << "\tif (is_finite(y))\n\t\treturn y;\n";
+	out << "\tif (y == y)\n\t\treturn NAN;\n";
+	out << "\tfrexp(x, &e);\n\th = ldexp(DBL_EPSILON, e);\n";
+	out << "\typ = f(x + h, p);\n\tym = f(x - h, p);\n";
+	out << "\tif (!is_finite(yp) || !is_finite(ym))\n\t\treturn NAN;\n";
+	out << "\treturn 0.5*(yp + ym);\n}\n\n";
+
+	for (int i = 0; i < p; i++){
+		if (!derivatives[i].empty()){
+			out << "static double model_d" << i << "(double x, const double *p){return " << QString::fromStdString(derivatives[i]) << ";}\n\n";
+			continue;
+		}
+		out << "static double model_d" << i << "(double x, const double *p)\n{\n";
+		out << "\tdouble q[P], h, f1, f2, f3, f4;\n\tint i;\n";
+		out << "\tfor (i = 0; i < P; i++)\n\t\tq[i] = p[i];\n";
+		out << "\th = (p[" << i << "] == 0) ? 1e-10 : 1e-7*p[" << i << "];\n";
+		out << "\tq[" << i << "] = p[" << i << "] + 2*h;\n\tf1 = regular(model, x, q);\n";
+		out << "\tq[" << i << "] = p[" << i << "] + h;\n\tf2 = regular(model, x, q);\n";
+		out << "\tq[" << i << "] = p[" << i << "] - h;\n\tf3 = regular(model, x, q);\n";
+		out << "\tq[" << i << "] = p[" << i << "] - 2*h;\n\tf4 = regular(model, x, q);\n";
+		out << "\treturn (-f1 + 8*f2 - 8*f3 + f4)/(12*h);\n}\n\n";
+	}
+
+	out << "static const model_function derivatives[P] = {";
+	for (int i = 0; i < p; i++)
+		out << (i ? ", " : "") << "model_d" << i;
+	out << "};\n\n";
+
+	out << "static void read_parameters(const gsl_vector *params, double *p)\n{\n\tint i;\n";
+	out << "\tfor (i = 0; i < P; i++)\n\t\tp[i] = params->data[i*params->stride];\n}\n\n";
+
+	out << "double function_eval(double x, double *p){return regular(model, x, p);}\n\n";
+
+	// residuals and Jacobian weighted as by the parser (see UserFitParser)
+	out << "int function_f(const gsl_vector *params, void *void_data, gsl_vector *f)\n{\n";
+	out << "\tstruct data *d = (struct data *)void_data;\n\tdouble p[P];\n\tint i;\n";
+	out << "\tread_parameters(params, p);\n";
+	out << "\tfor (i = 0; i < d->n; i++){\n";
+	out << "\t\tdouble y = regular(model, d->X[i], p);\n";
+	out << "\t\tif (y != y)\n\t\t\treturn GSL_ESING;\n";
+	out << "\t\tf->data[i*f->stride] = (y - d->Y[i])*sqrt(d->sigma[i]);\n\t}\n";
+	out << "\treturn GSL_SUCCESS;\n}\n\n";
+
+	out << "double function_d(const gsl_vector *params, void *void_data)\n{\n";
+	out << "\tstruct data *d = (struct data *)void_data;\n\tdouble p[P], chi2 = 0.0;\n\tint i;\n";
+	out << "\tread_parameters(params, p);\n";
+	out << "\tfor (i = 0; i < d->n; i++){\n";
+	out << "\t\tdouble r = regular(model, d->X[i], p) - d->Y[i];\n";
+	out << "\t\tif (r != r)\n\t\t\treturn HUGE_VAL;\n";
+	out << "\t\tchi2 += r*r*d->sigma[i];\n\t}\n";
+	out << "\treturn chi2;\n}\n\n";
+
+	out << "int function_df(const gsl_vector *params, void *void_data, gsl_matrix *J)\n{\n";
+	out << "\tstruct data *d = (struct data *)void_data;\n\tdouble p[P];\n\tint i, j;\n";
+	out << "\tread_parameters(params, p);\n";
+	out << "\tfor (i = 0; i < d->n; i++){\n";
+	out << "\t\tdouble w = sqrt(d->sigma[i]);\n\t\tdouble *row = J->data + i*J->tda;\n";
+	out << "\t\tfor (j = 0; j < P; j++){\n";
+	out << "\t\t\tdouble v = regular(derivatives[j], d->X[i], p);\n";
+	out << "\t\t\tif (v != v)\n\t\t\t\treturn GSL_ESING;\n";
+	out << "\t\t\trow[j] = v*w;\n\t\t}\n\t}\n";
+	out << "\treturn GSL_SUCCESS;\n}\n\n";
+
+	out << "int function_fdf(const gsl_vector *params, void *void_data, gsl_vector *f, gsl_matrix *J)\n{\n";
+	out << "\tint status = function_f(params, void_data, f);\n";
+	out << "\treturn status ? status : function_df(params, void_data, J);\n}\n";
+	out.flush();
+	return code;
+}
+
+//! Compiles the plugin \a lib, in a worker thread; the library is written to \a output and renamed when complete
+static void compilePlugin(const QString& cc, const QStringList& args, const QString& output, const QString& lib)
+{
+	QProcess process;
+	process.start(cc, args);
+	bool started = process.waitForStarted();
+	bool compiled = started && process.waitForFinished(compiler_timeout) &&
+					process.exitStatus() == QProcess::NormalExit && !process.exitCode();
+	if (started && !compiled){
+		process.kill();
+		process.waitForFinished();
+	}
+
+	if (compiled && !QFile::rename(output, lib))
+		compiled = false;
+	if (!compiled)
+		QFile::remove(output);
+
+	QMutexLocker locker(&compiler_mutex);
+	compiling_plugins.remove(lib);
+	if (!started)
+		no_compiler = true;
+	else if (compiled && isPrivate(QFileInfo(lib)))
+		compiled_plugins << lib;
+	else
+		failed_plugins << lib;
+}
+
+QString FitCompiler::plugin(NonLinearFit *fit)
+{
+	compiler_mutex.lock();
+	bool noCompiler = no_compiler;
+	compiler_mutex.unlock();
+	if (noCompiler)
+		return QString();
+
+	QString code = source(fit);
+	if (code.isEmpty())
+		return QString();
+
+	QStringList args;
+	args << "-O2" << "-shared";
+#ifndef Q_OS_WIN
+	args << "-fPIC";
+#endif
+
+	QString cc = compiler();
+	QString key = QCryptographicHash::hash((cc + " " + args.join(" ") + "\n" + code).toUtf8(), QCryptographicHash::Md5).toHex();
+#if defined(Q_OS_WIN)
+	QString suffix = ".dll";
+#elif defined(Q_OS_MAC)
+	QString suffix = ".dylib";
+#else
+	QString suffix = ".so";
+#endif
+
+	QMutexLocker locker(&compiler_mutex);
+	QDir dir(cacheFolder());
+	if (no_compiler || !createCacheFolder(dir.absolutePath()))
+		return QString();
+
+	// failures are remembered, so that they are not repeated for each fit
+	QString lib = dir.absoluteFilePath("fit_" + key + suffix);
+	if (failed_plugins.contains(lib))
+		return QString();
+	if (compiling_plugins.contains(lib) || compiled_plugins.contains(lib))
+		return lib;
+	if (QFile::exists(lib)){
+		if (!isPrivate(QFileInfo(lib)))
+			return QString();
+		compiled_plugins << lib;
+		return lib;
+	}
+
+	// the folder is private, but left-overs of an interrupted compilation are never reused
+	QString sourceFile = dir.absoluteFilePath("fit_" + key + ".c");
+	QString output = lib + ".tmp";
+	QFile::remove(sourceFile);
+	QFile::remove(output);
+
+	QFile f(sourceFile);
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)){
+		failed_plugins << lib;
+		return QString();
+	}
+	f.write(code.toUtf8());
+	f.close();
+
+	// the library is written under a temporary name, so that other instances never load an incomplete file
+	args << "-o" << output << sourceFile << "-lm";
+
+	compiling_plugins << lib;
+#if QT_VERSION >= 0x040400
+	// the user interface is not blocked: the model is evaluated by the parser until the library is ready
+	QtConcurrent::run(compilePlugin, cc, args, output, lib);
+#else
+	locker.unlock();
+	compilePlugin(cc, args, output, lib);
+#endif
+	return lib;
+}
+
+bool FitCompiler::isCompiled(const QString& lib)
+{
+	QMutexLocker locker(&compiler_mutex);
+	return compiled_plugins.contains(lib);
+}
@@ -0,0 +1,69 @@
+/***************************************************************************
+	File                 : FitCompiler.h
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Compiles user defined fit models into native fit plugins
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef FITCOMPILER_H
+#define FITCOMPILER_H
+
+#include <QString>
+
+class NonLinearFit;
+
+//! Compiles user defined fit models into native fit plugins
+/**
+ * The formula of the model and its exact derivatives are translated into C (see MyParser::compiledSource()),
+ * using the interface of the fit plugins loaded by PluginFit. The source is compiled with the system C compiler
+ * into a shared library stored in a private cache folder of the user (only accessible by its owner), under a name
+ * derived from the hash of the source, so that each model is compiled only once. Libraries which don't belong to
+ * the user, or which other users can modify, are never loaded. The compilation runs in a worker thread, the model
+ * is evaluated by the parser until the library is ready.
+ *
+ * Models calling functions which are not available in the C math library (e.g. the special functions of GSL)
+ * and systems without a C compiler are not supported: the model is then evaluated by the parser.
+ */
+class FitCompiler
+{
+public:
+	//! Returns the file name of the plugin compiled for the model of fit, or an empty string if it can't be compiled
+	/**
+	 * If the library doesn't exist yet, its compilation is started in the background and the file
+	 * name is returned immediately: use isCompiled() to know when it can be loaded.
+	 */
+	static QString plugin(NonLinearFit *fit);
+	//! Returns true if the plugin \a lib returned by plugin() is compiled and can be loaded
+	static bool isCompiled(const QString& lib);
+	//! Folder where the compiled plugins are stored, in the cache folder of the user
+	static QString cacheFolder();
+	//! The C compiler, given by the CC environment variable
+	static QString compiler();
+
+private:
+	//! Returns the C source of the plugin, or an empty string if the formula can't be translated
+	static QString source(NonLinearFit *fit);
+};
+
+#endif
@@ -0,0 +1,495 @@
+/***************************************************************************
+	File                 : GlobalFit.cpp
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Global fit of several data sets with shared parameters
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#include "GlobalFit.h"
+#include "fit_gsl.h"
+#include <ApplicationWindow.h>
+#include <MyParser.h>
+
+#include <QApplication>
+#include <QMessageBox>
+
+#include <gsl/gsl_math.h>
+#include <gsl/gsl_blas.h>
+#include <gsl/gsl_linalg.h>
+#include <gsl/gsl_multifit_nlin.h>
+
+//! Normal equations of the global fit, having an arrow structure
+/**
+ * With the shared parameters first, the matrix J^T J of the global problem is made of
+ * a dense s x s block A, the s x l blocks B_k coupling the shared parameters to the local
+ * parameters of the data set k and the l x l diagonal blocks C_k. Only these blocks are stored.
+ */
+class GlobalFit::NormalEquations
+{
+public:
+	NormalEquations(int s, int l, int m);
+	~NormalEquations();
+
+	void clear();
+	//! Adds the contribution of data set k, Js and Jl being the shared and the local columns of its Jacobian
+	void add(int k, const gsl_matrix *Js, const gsl_matrix *Jl, const gsl_vector *f);
+	//! Solves (J^T J + lambda*diag(J^T J))*delta = -J^T f, returns false if the matrix is singular
+	bool solve(double lambda, gsl_vector *delta);
+	//! Computes the diagonal of (J^T J)^-1
+	bool variances(gsl_vector *var);
+
+private:
+	static void damp(gsl_matrix *m, const gsl_matrix *h, double lambda);
+
+	int d_s, d_l, d_m;
+	gsl_matrix *d_A, *d_S;
+	gsl_vector *d_gs, *d_r;
+	//! Factorized damped local block
+	gsl_matrix *d_C_chol;
+	QVector<gsl_matrix *> d_B, d_C;
+	QVector<gsl_vector *> d_gl;
+	//! C_k^-1 B_k^T and C_k^-1 gl_k, computed by solve()
+	QVector<gsl_matrix *> d_W;
+	QVector<gsl_vector *> d_w;
+};
+
+GlobalFit::NormalEquations::NormalEquations(int s, int l, int m)
+	: d_s(s), d_l(l), d_m(m), d_C_chol(0)
+{
+	d_A = gsl_matrix_alloc(s, s);
+	d_S = gsl_matrix_alloc(s, s);
+	d_gs = gsl_vector_alloc(s);
+	d_r = gsl_vector_alloc(s);
+	if (!l)
+		return;
+
+	d_C_chol = gsl_matrix_alloc(l, l);
+	for (int k = 0; k < m; k++){
+		d_B << gsl_matrix_alloc(s, l);
+		d_C << gsl_matrix_alloc(l, l);
+		d_gl << gsl_vector_alloc(l);
+		d_W << gsl_matrix_alloc(l, s);
+		d_w << gsl_vector_alloc(l);
+	}
+}
+
+GlobalFit::NormalEquations::~NormalEquations()
+{
+	gsl_matrix_free(d_A);
+	gsl_matrix_free(d_S);
+	gsl_vector_free(d_gs);
+	gsl_vector_free(d_r);
+	if (d_C_chol)
+		gsl_matrix_free(d_C_chol);
+	for (int k = 0; k < d_B.size(); k++){
+		gsl_matrix_free(d_B[k]);
+		gsl_matrix_free(d_C[k]);
+		gsl_vector_free(d_gl[k]);
+		gsl_matrix_free(d_W[k]);
+		gsl_vector_free(d_w[k]);
+	}
+}
+
+void GlobalFit::NormalEquations::clear()
+{
+	gsl_matrix_set_zero(d_A);
+	gsl_vector_set_zero(d_gs);
+}
+
+void GlobalFit::NormalEquations::add(int k, const gsl_matrix *Js, const gsl_matrix *Jl, const gsl_vector *f)
+{
+	gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, Js, Js, 1.0, d_A);
+	gsl_blas_dgemv(CblasTrans, 1.0, Js, f, 1.0, d_gs);
+	if (!d_l)
+		return;
+
+	gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, Js, Jl, 0.0, d_B[k]);
+	gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, Jl, Jl, 0.0, d_C[k]);
+	gsl_blas_dgemv(CblasTrans, 1.0, Jl, f, 0.0, d_gl[k]);
+}
+
+void GlobalFit::NormalEquations::damp(gsl_matrix *m, const gsl_matrix *h, double lambda)
+{
+	gsl_matrix_memcpy(m, h);
+	for (int i = 0; i < (int)m->size1; i++){
+		double d = gsl_matrix_get(h, i, i);
+		gsl_matrix_set(m, i, i, d + lambda*(d > 0.0 ? d : 1.0));
+	}
+}
+
+bool GlobalFit::NormalEquations::solve(double lambda, gsl_vector *delta)
+{
+	// eliminates the local parameters: S = A - sum(B_k C_k^-1 B_k^T), r = gs - sum(B_k C_k^-1 gl_k)
+	damp(d_S, d_A, lambda);
+	gsl_vector_memcpy(d_r, d_gs);
+	for (int k = 0; k < d_B.size(); k++){
+		damp(d_C_chol, d_C[k], lambda);
+		if (gsl_linalg_cholesky_decomp(d_C_chol))
+			return false;
+
+		for (int j = 0; j < d_s; j++){
+			gsl_vector_const_view row = gsl_matrix_const_row(d_B[k], j);
+			gsl_vector_view col = gsl_matrix_column(d_W[k], j);
+			gsl_linalg_cholesky_solve(d_C_chol, &row.vector, &col.vector);
+		}
+		gsl_linalg_cholesky_solve(d_C_chol, d_gl[k], d_w[k]);
+
+		gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, -1.0, d_B[k], d_W[k], 1.0, d_S);
+		gsl_blas_dgemv(CblasNoTrans, -1.0, d_B[k], d_w[k], 1.0, d_r);
+	}
+
+	if (gsl_linalg_cholesky_decomp(d_S))
+		return false;
+
+	gsl_vector_view ds = gsl_vector_subvector(delta, 0, d_s);
+	gsl_linalg_cholesky_solve(d_S, d_r, &ds.vector);
+	gsl_vector_scale(&ds.vector, -1.0);
+
+	// back substitution: delta_k = -C_k^-1 (gl_k + B_k^T delta_s)
+	for (int k = 0; k < d_B.size(); k++){
+		gsl_vector_view dl = gsl_vector_subvector(delta, d_s + k*d_l, d_l);
+		gsl_vector_memcpy(&dl.vector, d_w[k]);
+		gsl_blas_dgemv(CblasNoTrans, 1.0, d_W[k], &ds.vector, 1.0, &dl.vector);
+		gsl_vector_scale(&dl.vector, -1.0);
+	}
+	return true;
+}
+
+bool GlobalFit::NormalEquations::variances(gsl_vector *var)
+{
+	// factorizes the undamped equations
+	if (!solve(0.0, var))
+		return false;
+
+	// the shared block of the inverse is S^-1
+	gsl_linalg_cholesky_invert(d_S);
+	for (int j = 0; j < d_s; j++)
+		gsl_vector_set(var, j, gsl_matrix_get(d_S, j, j));
+	if (!d_l)
+		return true;
+
+	// the local blocks of the inverse are C_k^-1 + W_k S^-1 W_k^T
+	gsl_matrix *T = gsl_matrix_alloc(d_l, d_s);
+	bool singular = false;
+	for (int k = 0; k < d_B.size() && !singular; k++){
+		gsl_matrix_memcpy(d_C_chol, d_C[k]);
+		if (gsl_linalg_cholesky_decomp(d_C_chol)){
+			singular = true;
+			break;
+		}
+		gsl_linalg_cholesky_invert(d_C_chol);
+		gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, d_W[k], d_S, 0.0, T);
+		for (int i = 0; i < d_l; i++){
+			gsl_vector_const_view t = gsl_matrix_const_row(T, i);
+			gsl_vector_const_view w = gsl_matrix_const_row(d_W[k], i);
+			double v;
+			gsl_blas_ddot(&t.vector, &w.vector, &v);
+			gsl_vector_set(var, d_s + k*d_l + i, gsl_matrix_get(d_C_chol, i, i) + v);
+		}
+	}
+	gsl_matrix_free(T);
+	return !singular;
+}
+
+GlobalFit::GlobalFit(Fit *model)
+	: BatchFit(model),
+	d_shared(model->d_p, false),
+	d_evaluator(0),
+	d_model_params(0),
+	d_residuals(0),
+	d_jacobian(0),
+	d_ordered_jacobian(0),
+	d_chi2(GSL_NAN),
+	d_iterations(0),
+	d_status(GSL_FAILURE)
+{
+}
+
+void GlobalFit::setSharedParameter(int index, bool on)
+{
+	if (index >= 0 && index < d_shared.size())
+		d_shared[index] = on;
+}
+
+bool GlobalFit::setSharedParameter(const QString& name, bool on)
+{
+	int index = d_model->d_param_names.indexOf(name);
+	if (index < 0)
+		return false;
+
+	d_shared[index] = on;
+	return true;
+}
+
+int GlobalFit::globalParametersCount()
+{
+	int s = d_shared.count(true);
+	return s + d_data_sets.size()*(d_shared.size() - s);
+}
+
+void GlobalFit::modelParameters(int k, const gsl_vector *params, gsl_vector *modelParams)
+{
+	int s = d_shared_params.size();
+	int l = d_local_params.size();
+	for (int j = 0; j < s; j++)
+		gsl_vector_set(modelParams, d_shared_params[j], gsl_vector_get(params, j));
+	for (int j = 0; j < l; j++)
+		gsl_vector_set(modelParams, d_local_params[j], gsl_vector_get(params, s + k*l + j));
+}
+
+void GlobalFit::applyRanges(gsl_vector *params)
+{
+	Fit *model = d_model;
+	int s = d_shared_params.size();
+	int l = d_local_params.size();
+	for (int i = 0; i < (int)params->size; i++){
+		int index = i < s ? d_shared_params[i] : d_local_params[(i - s) % l];
+		double val = gsl_vector_get(params, i);
+		if (val < model->d_param_range_left[index])
+			gsl_vector_set(params, i, model->d_param_range_left[index]);
+		else if (val > model->d_param_range_right[index])
+			gsl_vector_set(params, i, model->d_param_range_right[index]);
+	}
+}
+
+double GlobalFit::evaluate(const gsl_vector *params, NormalEquations *eq)
+{
+	Fit *model = d_model;
+	int p = model->d_p;
+	int s = d_shared_params.size();
+	int l = d_local_params.size();
+	if (eq)
+		eq->clear();
+
+	double chi2 = 0.0;
+	for (int k = 0; k < d_data_sets.size(); k++){
+		DataSet *ds = d_data_sets[k];
+		int n = ds->x.size();
+		struct FitData data = {n, p, ds->x.data(), ds->y.data(), ds->w.data(), model, d_evaluator};
+		modelParameters(k, params, d_model_params);
+
+		gsl_vector_view f = gsl_vector_subvector(d_residuals, 0, n);
+		if (model->d_f(d_model_params, &data, &f.vector))
+			return GSL_NAN;
+
+		double chi2_k;
+		gsl_blas_ddot(&f.vector, &f.vector, &chi2_k);
+		if (!gsl_finite(chi2_k))
+			return GSL_NAN;
+		chi2 += chi2_k;
+		// trial parameters, which may be rejected, leave the results of the data sets untouched
+		if (!eq)
+			continue;
+
+		ds->chi2 = chi2_k;
+
+		gsl_matrix_view J = gsl_matrix_submatrix(d_jacobian, 0, 0, n, p);
+		if (model->d_df(d_model_params, &data, &J.matrix))
+			return GSL_NAN;
+
+		// reorders the columns: shared parameters first
+		gsl_matrix_view Jo = gsl_matrix_submatrix(d_ordered_jacobian, 0, 0, n, p);
+		for (int j = 0; j < s; j++){
+			gsl_vector_view col = gsl_matrix_column(&J.matrix, d_shared_params[j]);
+			gsl_matrix_set_col(&Jo.matrix, j, &col.vector);
+		}
+		for (int j = 0; j < l; j++){
+			gsl_vector_view col = gsl_matrix_column(&J.matrix, d_local_params[j]);
+			gsl_matrix_set_col(&Jo.matrix, s + j, &col.vector);
+		}
+
+		gsl_matrix_view Js = gsl_matrix_submatrix(&Jo.matrix, 0, 0, n, s);
+		if (l){
+			gsl_matrix_view Jl = gsl_matrix_submatrix(&Jo.matrix, 0, s, n, l);
+			eq->add(k, &Js.matrix, &Jl.matrix, &f.vector);
+		} else
+			eq->add(k, &Js.matrix, 0, &f.vector);
+	}
+	return chi2;
+}
+
+bool GlobalFit::run()
+{
+	ApplicationWindow *app = (ApplicationWindow *)parent();
+	if (d_data_sets.isEmpty()){
+		QMessageBox::critical(app, tr("QtiPlot - Fit Error"),
+				tr("You didn't specify a valid data set for this fit operation. Operation aborted!"));
+		return false;
+	}
+
+	Fit *model = d_model;
+	// updates the model functions (see NonLinearFit::prepareModel())
+	model->compiledModel();
+	if (!model->is_non_linear || !model->d_f || !model->d_df || !model->d_p){
+		QMessageBox::critical(app, tr("QtiPlot - Fit Error"),
+				tr("Global fits are only available for non-linear fit models. Operation aborted!"));
+		return false;
+	}
+
+	int p = model->d_p;
+	d_shared_params.clear();
+	d_local_params.clear();
+	for (int i = 0; i < p; i++){
+		if (d_shared[i])
+			d_shared_params << i;
+		else
+			d_local_params << i;
+	}
+
+	int s = d_shared_params.size();
+	int l = d_local_params.size();
+	int m = d_data_sets.size();
+	if (!s){// the data sets are independent
+		bool ok = BatchFit::run();
+		d_chi2 = 0.0;
+		foreach(DataSet *ds, d_data_sets)
+			d_chi2 += ds->chi2;
+		d_iterations = 0;
+		d_status = GSL_SUCCESS;
+		return ok;
+	}
+
+	int P = s + m*l;
+	int N = 0, nmax = 0;
+	foreach(DataSet *ds, d_data_sets){
+		N += ds->x.size();
+		nmax = qMax(nmax, ds->x.size());
+	}
+	if (N <= P){
+		QMessageBox::critical(app, tr("QtiPlot - Fit Error"),
+				tr("The data sets have less points than the %1 parameters of the global fit. Operation aborted!").arg(P));
+		return false;
+	}
+
+	struct FitData data = {0, p, 0, 0, 0, model, 0};
+	try {
+		d_evaluator = fit_evaluator_alloc(&data, model->d_f);
+	} catch (mu::ParserError &e) {
+		QMessageBox::critical(app, tr("QtiPlot - Input function error"), QString::fromStdString(e.GetMsg()));
+		return false;
+	}
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	gsl_set_error_handler_off();
+
+	d_model_params = gsl_vector_alloc(p);
+	d_residuals = gsl_vector_alloc(nmax);
+	d_jacobian = gsl_matrix_alloc(nmax, p);
+	d_ordered_jacobian = gsl_matrix_alloc(nmax, p);
+	NormalEquations eq(s, l, m);
+
+	gsl_vector *params = gsl_vector_alloc(P);
+	gsl_vector *trial = gsl_vector_alloc(P);
+	gsl_vector *delta = gsl_vector_alloc(P);
+	for (int j = 0; j < s; j++)
+		gsl_vector_set(params, j, gsl_vector_get(model->d_param_init, d_shared_params[j]));
+	for (int k = 0; k < m; k++){
+		for (int j = 0; j < l; j++)
+			gsl_vector_set(params, s + k*l + j, gsl_vector_get(model->d_param_init, d_local_params[j]));
+	}
+	applyRanges(params);
+
+	double tolerance = model->d_tolerance;
+	double lambda = 1e-3;
+	d_chi2 = evaluate(params, &eq);
+	d_iterations = 0;
+	d_status = gsl_finite(d_chi2) ? GSL_CONTINUE : GSL_EBADFUNC;
+	while (d_status == GSL_CONTINUE && d_iterations < model->d_max_iterations){
+		d_iterations++;
+		// Levenberg-Marquardt step: the damping grows until the chi^2 decreases
+		while (true){
+			if (eq.solve(lambda, delta)){
+				gsl_vector_memcpy(trial, params);
+				gsl_vector_add(trial, delta);
+				applyRanges(trial);
+				gsl_vector_memcpy(delta, trial);
+				gsl_vector_sub(delta, params);
+
+				double chi2 = evaluate(trial, 0);
+				if (gsl_finite(chi2) && chi2 <= d_chi2)
+					break;
+				if (gsl_multifit_test_delta(delta, params, tolerance, tolerance) == GSL_SUCCESS){
+					// no better solution within the tolerance
+					d_status = GSL_SUCCESS;
+					break;
+				}
+			}
+			lambda *= 10.0;
+			if (lambda > 1e16){
+				d_status = GSL_ENOPROG;
+				break;
+			}
+		}
+		if (d_status != GSL_CONTINUE)
+			break;
+
+		d_status = gsl_multifit_test_delta(delta, trial, tolerance, tolerance);
+		gsl_vector_memcpy(params, trial);
+		lambda = qMax(0.1*lambda, 1e-12);
+		d_chi2 = evaluate(params, &eq);
+		if (!gsl_finite(d_chi2))
+			d_status = GSL_EBADFUNC;
+	}
+
+	// the normal equations were computed for the current parameters
+	gsl_vector *var = delta;
+	if (!eq.variances(var))
+		gsl_vector_set_all(var, GSL_NAN);
+
+	double scale = model->d_scale_errors ? d_chi2/(N - P) : 1.0;
+	for (int k = 0; k < m; k++){
+		DataSet *ds = d_data_sets[k];
+		for (int j = 0; j < s; j++){
+			int index = d_shared_params[j];
+			ds->results[index] = gsl_vector_get(params, j);
+			ds->errors[index] = sqrt(scale*gsl_vector_get(var, j));
+		}
+		for (int j = 0; j < l; j++){
+			int index = d_local_params[j];
+			ds->results[index] = gsl_vector_get(params, s + k*l + j);
+			ds->errors[index] = sqrt(scale*gsl_vector_get(var, s + k*l + j));
+		}
+		ds->iterations = d_iterations;
+		ds->status = d_status;
+	}
+
+	gsl_vector_free(params);
+	gsl_vector_free(trial);
+	gsl_vector_free(delta);
+	gsl_vector_free(d_model_params);
+	gsl_vector_free(d_residuals);
+	gsl_matrix_free(d_jacobian);
+	gsl_matrix_free(d_ordered_jacobian);
+	d_model_params = 0;
+	d_residuals = 0;
+	d_jacobian = 0;
+	d_ordered_jacobian = 0;
+
+	fit_evaluator_free(d_evaluator);
+	d_evaluator = 0;
+	QApplication::restoreOverrideCursor();
+
+	customizeResults();
+	return d_status != GSL_EBADFUNC;
+}
@@ -0,0 +1,91 @@
+/***************************************************************************
+	File                 : GlobalFit.h
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Global fit of several data sets with shared parameters
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef GLOBALFIT_H
+#define GLOBALFIT_H
+
+#include "BatchFit.h"
+
+//! Global fit of several data sets with shared parameters
+/**
+ * The parameters of the model are either shared by all the data sets or local to each data set.
+ * All the data sets are fitted simultaneously by a Levenberg-Marquardt solver: with s shared and
+ * l local parameters, the Jacobian of the global problem is block-sparse (each data set only depends
+ * on the shared parameters and on its own local parameters) and the normal equations have an arrow
+ * structure. They are solved by eliminating the local blocks (Schur complement), so that the cost
+ * of an iteration grows linearly with the number of data sets instead of cubically with the total
+ * number of parameters.
+ *
+ * The parameter ranges, tolerance, maximum number of iterations, weighting method and error scaling
+ * of the model are used. The results of each data set (shared parameters included) and their errors
+ * are available as for a batch fit.
+ */
+class GlobalFit : public BatchFit
+{
+	Q_OBJECT
+
+public:
+	GlobalFit(Fit *model);
+
+	void setSharedParameter(int index, bool on = true);
+	bool setSharedParameter(const QString& name, bool on = true);
+	bool isSharedParameter(int index){return d_shared[index];};
+	//! Returns the number of independent parameters of the global fit
+	int globalParametersCount();
+
+	bool run();
+
+	double globalChiSquare(){return d_chi2;};
+	int iterations(){return d_iterations;};
+	int globalStatus(){return d_status;};
+
+private:
+	class NormalEquations;
+
+	//! Sets the parameters of the model for data set k from the global parameters
+	void modelParameters(int k, const gsl_vector *params, gsl_vector *modelParams);
+	//! Returns the global chi^2; if eq is not null, accumulates the normal equations and stores the chi^2 of each data set
+	double evaluate(const gsl_vector *params, NormalEquations *eq);
+	//! Keeps the parameters inside the ranges of the model
+	void applyRanges(gsl_vector *params);
+
+	QVector<bool> d_shared;
+	//! Indices of the shared and local parameters in the model
+	QVector<int> d_shared_params, d_local_params;
+
+	//! Workspace of the model evaluation
+	void *d_evaluator;
+	gsl_vector *d_model_params, *d_residuals;
+	gsl_matrix *d_jacobian, *d_ordered_jacobian;
+
+	double d_chi2;
+	int d_iterations;
+	int d_status;
+};
+
+#endif
@@ -129,25 +129,28 @@ double Integration::trapez()
     return sum;
 }
 
+//! Parameters passed to evalFunction(): the parser is set up once for all the points requested by GSL
+struct IntegrationFunction
+{
+	Integration *integration;
+	MyParser *parser;
+	double *x;
+};
+
 double evalFunction(double x, void *params)
 {
-	if (((Integration *)params)->error())
+	IntegrationFunction *f = (IntegrationFunction *)params;
+	if (f->integration->error())
 		return 0.0;
 
 	double result = 0.0;
-	QString var = ((Integration *)params)->variable();
-	QString formula = ((Integration *)params)->formula();
-
-	MyParser parser;
-	parser.DefineVar(var.ascii(), &x);
-	parser.SetExpr(formula.ascii());
-
+	*f->x = x;
 	try {
-		result = parser.Eval();
+		result = f->parser->Eval();
 	} catch (mu::ParserError &e){
 		QApplication::restoreOverrideCursor();
 		QMessageBox::critical(0, "QtiPlot - Input error", QString::fromStdString(e.GetMsg()));
-		((Integration *)params)->setError();
+		f->integration->setError();
 	}
 
 	return result;
@@ -158,11 +161,18 @@ double Integration::gslIntegration()
 	if (d_init_err)
 		return 0.0;
 
+	double x = d_from;
+	MyParser parser;
+	parser.DefineVar(d_variable.ascii(), &x);
+	parser.SetExpr(d_formula.ascii());
+
+	IntegrationFunction f = {this, &parser, &x};
+
 	gsl_integration_workspace * w = gsl_integration_workspace_alloc (d_workspace_size);
 
 	gsl_function F;
 	F.function = &evalFunction;
-	F.params = this;
+	F.params = &f;
 
 	gsl_integration_qags (&F, d_from, d_to, 0, d_tolerance, d_workspace_size, w, &d_area, &d_error);
 
@@ -34,9 +34,14 @@
 #include <ColorBox.h>
 
 #include <gsl/gsl_statistics.h>
+#include <gsl/gsl_math.h>
+
+#include <algorithm>
 
 #include <QLocale>
 #include <QMessageBox>
+#include <QPair>
+#include <QVector>
 
 MultiPeakFit::MultiPeakFit(ApplicationWindow *parent, Graph *g, PeakProfile profile, int peaks)
 : Fit(parent, g), d_profile(profile)
@@ -217,6 +222,397 @@ void MultiPeakFit::customizeFitResults()
 	}
 }
 
+//! Minimum number of peaks for which the Gaussian fits use the sparse solver
+static const int sparseSolverPeaks = 10;
+//! Half width of the window, in peak widths, outside of which a Gaussian peak is neglected
+static const double peakWindow = 6.0;
+
+//! Symmetric positive definite band matrix, only the lower band is stored
+class BandMatrix
+{
+public:
+	BandMatrix(int size = 0, int bandwidth = 0) : d_size(size), d_bandwidth(bandwidth),
+		d_data(size*(bandwidth + 1), 0.0){};
+
+	int size() const {return d_size;};
+	//! Element (i, j), with j <= i <= j + bandwidth
+	double& operator()(int i, int j){return d_data[i*(d_bandwidth + 1) + i - j];};
+	double operator()(int i, int j) const {return d_data[i*(d_bandwidth + 1) + i - j];};
+
+	//! Adds lambda*H(i, i) (or lambda if H(i, i) is zero) to the diagonal elements
+	void damp(double lambda)
+	{
+		for (int i = 0; i < d_size; i++){
+			double d = (*this)(i, i);
+			(*this)(i, i) = d + lambda*(d > 0.0 ? d : 1.0);
+		}
+	};
+
+	//! Replaces the matrix by its Cholesky factor L, returns false if the matrix is not positive definite
+	bool choleskyDecomp()
+	{
+		for (int i = 0; i < d_size; i++){
+			int first = qMax(0, i - d_bandwidth);
+			for (int j = first; j <= i; j++){
+				double sum = (*this)(i, j);
+				for (int k = first; k < j; k++)
+					sum -= (*this)(i, k)*(*this)(j, k);
+				if (j < i)
+					(*this)(i, j) = sum/(*this)(j, j);
+				else if (sum > 0.0)
+					(*this)(i, i) = sqrt(sum);
+				else
+					return false;
+			}
+		}
+		return true;
+	};
+
+	//! Solves L L^T x = b in place, after choleskyDecomp()
+	void choleskySolve(double *b) const
+	{
+		for (int i = 0; i < d_size; i++){
+			double sum = b[i];
+			for (int k = qMax(0, i - d_bandwidth); k < i; k++)
+				sum -= (*this)(i, k)*b[k];
+			b[i] = sum/(*this)(i, i);
+		}
+		for (int i = d_size - 1; i >= 0; i--){
+			double sum = b[i];
+			int last = qMin(d_size - 1, i + d_bandwidth);
+			for (int k = i + 1; k <= last; k++)
+				sum -= (*this)(k, i)*b[k];
+			b[i] = sum/(*this)(i, i);
+		}
+	};
+
+private:
+	int d_size, d_bandwidth;
+	QVector<double> d_data;
+};
+
+//! Levenberg-Marquardt solver for Gaussian multi-peak fits with many peaks
+/**
+ * Each peak is only evaluated in a window of a few widths around its center, so that each column of the
+ * Jacobian only has the few non zero elements corresponding to the data points in the window of its peak.
+ * With the peaks ordered by the position of their windows, the normal equations J^T J of the peak parameters
+ * form a band matrix, whose bandwidth is given by the number of overlapping peaks, bordered by the row of the offset.
+ * They are solved by a band Cholesky factorization, the offset being eliminated by its Schur complement.
+ * The cost of an iteration grows linearly with the number of peaks, instead of the dense QR factorization
+ * of the n x p Jacobian used by the GSL solvers.
+ */
+class GaussPeaksSolver
+{
+public:
+	GaussPeaksSolver(const struct FitData *data, const double *rangeLeft, const double *rangeRight);
+
+	//! Fits the parameters in place and returns the GSL status
+	int solve(double *params, double tolerance, int maxIterations, gsl_matrix *cov, double& chi2, int& iterations);
+
+private:
+	//! Calculates the residuals and returns the chi^2, the non zero Jacobian elements are calculated if jacobian is true
+	double evaluate(const QVector<double>& params, bool jacobian);
+	//! Calculates the normal equations J^T J and J^T f from the last evaluation
+	void normalEquations();
+	//! Factorizes the damped normal equations
+	bool factorize(double lambda);
+	//! Solves the factorized normal equations in place, b being in the order of the band matrix
+	void solveFactorized(double *b) const;
+	//! Index in the parameters vector of the row i of the normal equations
+	int parameterIndex(int i) const {return i < d_m ? 3*d_slots[i/3] + i%3 : d_p - 1;};
+	void applyRanges(QVector<double>& params) const;
+	bool testDelta(const QVector<double>& delta, const QVector<double>& params, double tolerance) const;
+
+	int d_n, d_p, d_peaks;
+	//! Number of peak parameters
+	int d_m;
+	const double *d_range_left, *d_range_right;
+	//! Data points sorted by x and square roots of the weights
+	QVector<double> d_x, d_y, d_sw;
+	QVector<double> d_f;
+
+	//! First and last + 1 data points in the window of each peak
+	QVector<int> d_first, d_last;
+	//! Non zero elements of the Jacobian for each peak, 3 values per data point in the window
+	QVector<QVector<double> > d_jacobian;
+	//! Peaks sorted by the position of their windows
+	QVector<int> d_slots;
+
+	//! Normal equations: band matrix of the peak parameters, offset column, offset diagonal element and J^T f
+	BandMatrix d_H;
+	QVector<double> d_h, d_g;
+	double d_c;
+
+	//! Factorized damped normal equations
+	BandMatrix d_L;
+	QVector<double> d_y_border;
+	double d_schur;
+};
+
+GaussPeaksSolver::GaussPeaksSolver(const struct FitData *data, const double *rangeLeft, const double *rangeRight)
+	: d_n(data->n), d_p(data->p), d_peaks((data->p - 1)/3), d_m(3*d_peaks),
+	d_range_left(rangeLeft), d_range_right(rangeRight),
+	d_x(d_n), d_y(d_n), d_sw(d_n), d_f(d_n),
+	d_first(d_peaks), d_last(d_peaks), d_jacobian(d_peaks), d_slots(d_peaks),
+	d_h(d_m), d_g(d_m + 1), d_c(0.0), d_y_border(d_m), d_schur(0.0)
+{
+	QVector<QPair<double, int> > points(d_n);
+	for (int i = 0; i < d_n; i++)
+		points[i] = qMakePair(data->X[i], i);
+	std::sort(points.begin(), points.end());
+
+	for (int i = 0; i < d_n; i++){
+		int index = points[i].second;
+		d_x[i] = data->X[index];
+		d_y[i] = data->Y[index];
+		d_sw[i] = sqrt(data->sigma[index]);
+	}
+}
+
+double GaussPeaksSolver::evaluate(const QVector<double>& params, bool jacobian)
+{
+	double offset = params[d_p - 1];
+	for (int i = 0; i < d_n; i++)
+		d_f[i] = (offset - d_y[i])*d_sw[i];
+
+	const double *x = d_x.constData();
+	for (int j = 0; j < d_peaks; j++){
+		double a = params[3*j];
+		double xc = params[3*j + 1];
+		double w = params[3*j + 2];
+		double w2 = w*w;
+		double range = peakWindow*fabs(w);
+		int first = std::lower_bound(x, x + d_n, xc - range) - x;
+		int last = std::upper_bound(x + first, x + d_n, xc + range) - x;
+		d_first[j] = first;
+		d_last[j] = last;
+
+		double *J = 0;
+		if (jacobian){
+			d_jacobian[j].resize(3*(last - first));
+			J = d_jacobian[j].data();
+		}
+		for (int i = first; i < last; i++){
+			double diff = x[i] - xc;
+			double e = sqrt(M_2_PI)*d_sw[i]*exp(-2*diff*diff/w2);
+			d_f[i] += a*e/w;
+			if (J){
+				*J++ = e/w;
+				*J++ = 4*diff*a*e/(w2*w);
+				*J++ = a/w2*e*(4*diff*diff/w2 - 1);
+			}
+		}
+	}
+
+	double chi2 = 0.0;
+	for (int i = 0; i < d_n; i++)
+		chi2 += d_f[i]*d_f[i];
+	return gsl_finite(chi2) ? chi2 : GSL_NAN;
+}
+
+void GaussPeaksSolver::normalEquations()
+{
+	QVector<QPair<int, int> > windows(d_peaks);
+	for (int j = 0; j < d_peaks; j++)
+		windows[j] = qMakePair(d_first[j], j);
+	std::sort(windows.begin(), windows.end());
+	for (int s = 0; s < d_peaks; s++)
+		d_slots[s] = windows[s].second;
+
+	// the bandwidth is given by the largest number of following windows overlapping a window
+	int overlaps = 0;
+	for (int s = 0; s < d_peaks; s++){
+		int t = s + 1;
+		while (t < d_peaks && d_first[d_slots[t]] < d_last[d_slots[s]])
+			t++;
+		overlaps = qMax(overlaps, t - s - 1);
+	}
+	d_H = BandMatrix(d_m, 3*overlaps + 2);
+
+	d_c = 0.0;
+	d_g[d_m] = 0.0;
+	for (int i = 0; i < d_n; i++){
+		d_c += d_sw[i]*d_sw[i];
+		d_g[d_m] += d_sw[i]*d_f[i];
+	}
+
+	for (int s = 0; s < d_peaks; s++){
+		int j = d_slots[s];
+		int first = d_first[j];
+		const double *Jj = d_jacobian[j].constData();
+		for (int a = 0; a < 3; a++){
+			double h = 0.0, g = 0.0;
+			for (int i = first; i < d_last[j]; i++){
+				double v = Jj[3*(i - first) + a];
+				h += v*d_sw[i];
+				g += v*d_f[i];
+			}
+			d_h[3*s + a] = h;
+			d_g[3*s + a] = g;
+
+			for (int b = 0; b <= a; b++){
+				double sum = 0.0;
+				for (int i = first; i < d_last[j]; i++)
+					sum += Jj[3*(i - first) + a]*Jj[3*(i - first) + b];
+				d_H(3*s + a, 3*s + b) = sum;
+			}
+		}
+
+		for (int t = s + 1; t <= s + overlaps && t < d_peaks; t++){
+			int k = d_slots[t];
+			int start = qMax(first, d_first[k]);
+			int end = qMin(d_last[j], d_last[k]);
+			const double *Jk = d_jacobian[k].constData();
+			for (int a = 0; a < 3; a++){
+				for (int b = 0; b < 3; b++){
+					double sum = 0.0;
+					for (int i = start; i < end; i++)
+						sum += Jk[3*(i - d_first[k]) + a]*Jj[3*(i - first) + b];
+					d_H(3*t + a, 3*s + b) = sum;
+				}
+			}
+		}
+	}
+}
+
+bool GaussPeaksSolver::factorize(double lambda)
+{
+	d_L = d_H;
+	d_L.damp(lambda);
+	if (!d_L.choleskyDecomp())
+		return false;
+
+	// Schur complement of the peak parameters block
+	d_y_border = d_h;
+	d_L.choleskySolve(d_y_border.data());
+	double c = d_c + lambda*(d_c > 0.0 ? d_c : 1.0);
+	d_schur = c;
+	for (int i = 0; i < d_m; i++)
+		d_schur -= d_h[i]*d_y_border[i];
+	return d_schur > 0.0;
+}
+
+void GaussPeaksSolver::solveFactorized(double *b) const
+{
+	d_L.choleskySolve(b);
+	double v = b[d_m];
+	for (int i = 0; i < d_m; i++)
+		v -= d_h[i]*b[i];
+	v /= d_schur;
+	for (int i = 0; i < d_m; i++)
+		b[i] -= d_y_border[i]*v;
+	b[d_m] = v;
+}
+
+void GaussPeaksSolver::applyRanges(QVector<double>& params) const
+{
+	for (int i = 0; i < d_p; i++)
+		params[i] = qBound(d_range_left[i], params[i], d_range_right[i]);
+}
+
+bool GaussPeaksSolver::testDelta(const QVector<double>& delta, const QVector<double>& params, double tolerance) const
+{
+	for (int i = 0; i < d_p; i++){
+		if (fabs(delta[i]) >= tolerance*(1.0 + fabs(params[i])))
+			return false;
+	}
+	return true;
+}
+
+int GaussPeaksSolver::solve(double *results, double tolerance, int maxIterations, gsl_matrix *cov, double& chi2, int& iterations)
+{
+	QVector<double> params(d_p), trial(d_p), delta(d_p), step(d_p);
+	for (int i = 0; i < d_p; i++)
+		params[i] = results[i];
+	applyRanges(params);
+
+	chi2 = evaluate(params, true);
+	iterations = 0;
+	int status = gsl_finite(chi2) ? GSL_CONTINUE : GSL_EBADFUNC;
+
+	double lambda = 1e-3;
+	while (status == GSL_CONTINUE && iterations < maxIterations){
+		iterations++;
+		normalEquations();
+		// Levenberg-Marquardt step: the damping grows until the chi^2 decreases
+		while (true){
+			if (factorize(lambda)){
+				for (int i = 0; i <= d_m; i++)
+					step[i] = -d_g[i];
+				solveFactorized(step.data());
+				for (int i = 0; i <= d_m; i++){
+					int index = parameterIndex(i);
+					trial[index] = params[index] + step[i];
+				}
+				applyRanges(trial);
+				for (int i = 0; i < d_p; i++)
+					delta[i] = trial[i] - params[i];
+
+				double trialChi2 = evaluate(trial, false);
+				if (gsl_finite(trialChi2) && trialChi2 <= chi2)
+					break;
+				if (testDelta(delta, params, tolerance)){
+					// no better solution within the tolerance
+					status = GSL_SUCCESS;
+					break;
+				}
+			}
+			lambda *= 10.0;
+			if (lambda > 1e16){
+				status = GSL_ENOPROG;
+				break;
+			}
+		}
+		if (status != GSL_CONTINUE)
+			break;
+
+		status = testDelta(delta, trial, tolerance) ? GSL_SUCCESS : GSL_CONTINUE;
+		params = trial;
+		lambda = qMax(0.1*lambda, 1e-12);
+		chi2 = evaluate(params, true);
+		if (!gsl_finite(chi2))
+			status = GSL_EBADFUNC;
+	}
+
+	for (int i = 0; i < d_p; i++)
+		results[i] = params[i];
+
+	if (status == GSL_EBADFUNC){
+		gsl_matrix_set_all(cov, GSL_NAN);
+		return status;
+	}
+
+	// the covariance matrix is the inverse of the normal equations, calculated column by column
+	chi2 = evaluate(params, true);
+	normalEquations();
+	if (!factorize(0.0)){
+		gsl_matrix_set_all(cov, GSL_NAN);
+		return status;
+	}
+	QVector<double> column(d_m + 1);
+	for (int j = 0; j <= d_m; j++){
+		column.fill(0.0);
+		column[j] = 1.0;
+		solveFactorized(column.data());
+		for (int i = 0; i <= d_m; i++)
+			gsl_matrix_set(cov, parameterIndex(i), parameterIndex(j), column[i]);
+	}
+	return status;
+}
+
+int MultiPeakFit::solve(struct FitData *data, const gsl_vector *init, double *results, gsl_matrix *cov,
+				double& chi2, int& iterations, bool parallel) const
+{
+	if (d_profile != Gauss || d_solver == NelderMeadSimplex || (data->p - 1)/3 < sparseSolverPeaks)
+		return Fit::solve(data, init, results, cov, chi2, iterations, parallel);
+
+	for (int i = 0; i < data->p; i++)
+		results[i] = gsl_vector_get(init, i);
+
+	GaussPeaksSolver solver(data, d_param_range_left, d_param_range_right);
+	return solver.solve(results, d_tolerance, d_max_iterations, cov, chi2, iterations);
+}
+
 void MultiPeakFit::insertPeakFunctionCurve(int peak)
 {
 	QStringList curves = d_output_graph->curveNamesList();
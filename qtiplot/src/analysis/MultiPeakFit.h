@@ -64,6 +64,9 @@ class MultiPeakFit : public Fit
 	private:
 		void init(int);
 
+		//! Uses a sparse Levenberg-Marquardt solver for Gaussian fits with many peaks
+		int solve(struct FitData *data, const gsl_vector *init, double *results, gsl_matrix *cov,
+				double& chi2, int& iterations, bool parallel = true) const;
 		QString logFitInfo(int iterations, int status);
 		void generateFitCurve();
 		static QString peakFormula(int peakIndex, PeakProfile profile);
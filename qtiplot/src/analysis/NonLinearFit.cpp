@@ -28,10 +28,12 @@
  ***************************************************************************/
 #include "NonLinearFit.h"
 #include "fit_gsl.h"
+#include "FitCompiler.h"
 #include <MyParser.h>
 #include <FunctionCurve.h>
 
 #include <QApplication>
+#include <QLibrary>
 #include <QMessageBox>
 #include <QTextStream>
 
@@ -85,6 +87,7 @@ void NonLinearFit::init()
 	d_df = user_df;
 	d_fdf = user_fdf;
 	d_fsimplex = user_d;
+	d_native_eval = NULL;
 	d_explanation = tr("Non-linear Fit");
     d_fit_type = User;
 }
@@ -153,12 +156,20 @@ bool NonLinearFit::setParametersList(const QStringList& lst)
 	}
 
 	d_init_err = false;
-	d_param_names = lst;
+	if (d_p > 0 && lst == d_param_names){// keeps the workspace of the previous fit, but resets its contents
+		gsl_vector_set_all(d_param_init, 1.0);
+		for (int i = 0; i < d_p; i++){
+			d_param_range_left[i] = -DBL_MAX;
+			d_param_range_right[i] = DBL_MAX;
+		}
+	} else {
+		d_param_names = lst;
 
-	if (d_p > 0)
-		freeWorkspace();
-	d_p = (int)lst.count();
-	initWorkspace(d_p);
+		if (d_p > 0)
+			freeWorkspace();
+		d_p = (int)lst.count();
+		initWorkspace(d_p);
+	}
 
 	d_param_explain.clear();
 	for (int i=0; i<d_p; i++)
@@ -186,22 +197,38 @@ void NonLinearFit::calculateFitCurveData(double *X, double *Y)
 	if (d_gen_function){
 		double X0 = d_x[0];
 		double step = (d_x[d_n - 1] - X0)/(d_points - 1);
-		for (int i=0; i<d_points; i++){
-		    x = X0 + i*step;
-			X[i] = x;
-			Y[i] = parser.EvalRemoveSingularity(&x, false);
-		}
+		for (int i=0; i<d_points; i++)
+			X[i] = X0 + i*step;
 	} else {
-		for (int i=0; i<d_points; i++) {
-		    x = d_x[i];
-			X[i] = x;
-			Y[i] = parser.EvalRemoveSingularity(&x, false);
-		}
+		for (int i=0; i<d_points; i++)
+			X[i] = d_x[i];
 	}
+	parser.EvalBatchRemoveSingularity(&x, X, Y, d_points, false);
+}
+
+void NonLinearFit::modelGradient(double *X, int points, double *Y, gsl_matrix *G)
+{
+	// the model evaluated with null data and unit weights gives the values and the gradients of the formula,
+	// calculated by the parser in batches split between several threads
+	QVector<double> zeros(points, 0.0), weights(points, 1.0);
+	struct FitData data = {points, d_p, X, zeros.data(), weights.data(), this, compiledModel()};
+	gsl_vector_view par = gsl_vector_view_array(d_results, d_p);
+	gsl_vector_view f = gsl_vector_view_array(Y, points);
+
+	ParallelFitData *pd = parallel_fit_alloc(&data, d_f, d_df, d_fdf, d_fsimplex);
+	int status = pd ? parallel_fit_fdf(&par.vector, pd, &f.vector, G) : d_fdf(&par.vector, &data, &f.vector, G);
+	parallel_fit_free(pd);
+
+	// non-removable singularities are evaluated point by point
+	if (status)
+		Fit::modelGradient(X, points, Y, G);
 }
 
 double NonLinearFit::eval(double *par, double x)
 {
+	if (d_native_eval && d_native_key == compiledModelKey())
+		return d_native_eval(x, par);
+
 	MyParser parser;
 	for (int i=0; i<d_p; i++)
 		parser.DefineVar(d_param_names[i].ascii(), &par[i]);
@@ -222,6 +249,58 @@ void NonLinearFit::setConstant(const QString& parName, double val)
 	d_constants.insert(parName, val);
 }
 
+QString NonLinearFit::compiledModelKey()
+{
+	QString key = Fit::compiledModelKey();
+	QMapIterator<QString, double> i(d_constants);
+	while (i.hasNext()) {
+		i.next();
+		key += ";" + i.key() + "=" + QString::number(i.value(), 'g', 17);
+	}
+	// the model is prepared again once its plugin, compiled in the background, is ready
+	if (!d_plugin.isEmpty() && FitCompiler::isCompiled(d_plugin))
+		key += ";native";
+	return key;
+}
+
+void NonLinearFit::prepareModel()
+{
+	d_f = user_f;
+	d_df = user_df;
+	d_fdf = user_fdf;
+	d_fsimplex = user_d;
+	d_native_eval = NULL;
+	d_native_key = QString::null;
+	d_plugin = QString::null;
+
+	ApplicationWindow *app = qobject_cast<ApplicationWindow *>(parent());
+	if (app && !app->d_compile_fit_models)
+		return;
+
+	// the parser is used until the plugin is compiled
+	d_plugin = FitCompiler::plugin(this);
+	if (d_plugin.isEmpty() || !FitCompiler::isCompiled(d_plugin))
+		return;
+
+	// the library stays loaded, since it is shared by all the fits of the same model
+	QLibrary lib(d_plugin);
+	lib.setAutoUnload(false);
+	fit_function f = (fit_function)lib.resolve("function_f");
+	fit_function_df df = (fit_function_df)lib.resolve("function_df");
+	fit_function_fdf fdf = (fit_function_fdf)lib.resolve("function_fdf");
+	fit_function_simplex fsimplex = (fit_function_simplex)lib.resolve("function_d");
+	fitFunctionEval fEval = (fitFunctionEval)lib.resolve("function_eval");
+	if (!f || !df || !fdf || !fsimplex || !fEval)
+		return;
+
+	d_f = f;
+	d_df = df;
+	d_fdf = fdf;
+	d_fsimplex = fsimplex;
+	d_native_eval = fEval;
+	d_native_key = compiledModelKey();
+}
+
 QString NonLinearFit::logFitInfo(int iterations, int status)
 {
 	QString info = Fit::logFitInfo(iterations, status);
@@ -67,10 +67,23 @@ class NonLinearFit : public Fit
 
 	private:
 		void calculateFitCurveData(double *X, double *Y);
+		void modelGradient(double *X, int points, double *Y, gsl_matrix *G);
 		void init();
+		//! The constants are compiled in the model
+		QString compiledModelKey();
+		//! Loads the model compiled into a native plugin, if possible (see FitCompiler)
+		void prepareModel();
 		virtual bool removeDataSingularities();
 		void removePole(int index);
 
 		QMap<QString, double> d_constants;
+
+		typedef double (*fitFunctionEval)(double, double *);
+		//! Evaluates the compiled model, NULL if the model is evaluated by the parser
+		fitFunctionEval d_native_eval;
+		//! Key of the model compiled into the plugin (see compiledModelKey())
+		QString d_native_key;
+		//! File name of the plugin of the model, which may still be compiling
+		QString d_plugin;
 };
 #endif
@@ -76,6 +76,7 @@ void PluginFit::init()
 {
 	d_explanation = tr("Plugin Fit");
     d_fit_type = Plugin;
+	d_thread_safe = false;
 }
 
 bool PluginFit::load(const QString& pluginName)
@@ -109,6 +110,11 @@ bool PluginFit::load(const QString& pluginName)
 	if (!f_eval)
 		return false;
 
+	// plugins may keep state between calls, so that they are only called concurrently if they declare it safe
+	typedef int (*threadSafeFunc)();
+	threadSafeFunc threadSafe = (threadSafeFunc) lib.resolve("thread_safe");
+	d_thread_safe = threadSafe && threadSafe();
+
 	typedef char* (*fitFunc)();
 	fitFunc fitFunction = (fitFunc) lib.resolve("parameters");
 	if (fitFunction){
@@ -46,10 +46,14 @@ class PluginFit : public Fit
 		bool load(const QString& pluginName);
         double eval(double *par, double x){return f_eval(x, par);};
 
+		//! Plugins are evaluated by a single thread, unless they export an int thread_safe() function returning non-zero
+		bool isThreadSafe() const {return d_thread_safe;};
+
 	private:
 		void init();
 		typedef double (*fitFunctionEval)(double, double *);
 		void calculateFitCurveData(double *X, double *Y);
 		fitFunctionEval f_eval;
+		bool d_thread_safe;
 };
 #endif
@@ -27,6 +27,7 @@
  *                                                                         *
  ***************************************************************************/
 #include "PolynomialFit.h"
+#include "fit_gsl.h"
 
 #include <QMessageBox>
 #include <QLocale>
@@ -168,27 +169,30 @@ void PolynomialFit::fit()
   		return;
   	}
 
-	gsl_matrix *X = gsl_matrix_alloc (d_n, d_p);
+	if (polynomialSolve(d_p, d_results, covar, chi_2) != GSL_SUCCESS){
+		// rank deficient problem: use the SVD of the design matrix
+		gsl_matrix *X = gsl_matrix_alloc (d_n, d_p);
 
-	for (int i = 0; i <d_n; i++){
-		for (int j= 0; j < d_p; j++)
-			gsl_matrix_set (X, i, j, pow(d_x[i],j));
-	}
+		for (int i = 0; i <d_n; i++){
+			for (int j= 0; j < d_p; j++)
+				gsl_matrix_set (X, i, j, pow(d_x[i],j));
+		}
 
-	gsl_vector_view y = gsl_vector_view_array (d_y, d_n);
-	gsl_vector_view w = gsl_vector_view_array (d_w, d_n);
-	gsl_multifit_linear_workspace * work = gsl_multifit_linear_alloc (d_n, d_p);
+		gsl_vector_view y = gsl_vector_view_array (d_y, d_n);
+		gsl_vector_view wv = gsl_vector_view_array (d_w, d_n);
+		gsl_multifit_linear_workspace * work = gsl_multifit_linear_alloc (d_n, d_p);
 
-	if (d_weighting == NoWeighting)
-		gsl_multifit_linear (X, &y.vector, d_param_init, covar, &chi_2, work);
-	else
-		gsl_multifit_wlinear (X, &w.vector, &y.vector, d_param_init, covar, &chi_2, work);
+		if (d_weighting == NoWeighting)
+			gsl_multifit_linear (X, &y.vector, d_param_init, covar, &chi_2, work);
+		else
+			gsl_multifit_wlinear (X, &wv.vector, &y.vector, d_param_init, covar, &chi_2, work);
 
-	for (int i = 0; i < d_p; i++)
-		d_results[i] = gsl_vector_get(d_param_init, i);
+		for (int i = 0; i < d_p; i++)
+			d_results[i] = gsl_vector_get(d_param_init, i);
 
-	gsl_multifit_linear_free (work);
-	gsl_matrix_free (X);
+		gsl_multifit_linear_free (work);
+		gsl_matrix_free (X);
+	}
 
 	generateFitCurve();
 
@@ -301,19 +305,21 @@ void LinearFit::fit()
   		return;
   	}
 
-	double c0, c1, cov00, cov01, cov11;
-	if (d_weighting == NoWeighting)
-		gsl_fit_linear(d_x, 1, d_y, 1, d_n, &c0, &c1, &cov00, &cov01, &cov11, &chi_2);
-	else
-		gsl_fit_wlinear(d_x, 1, d_w, 1, d_y, 1, d_n, &c0, &c1, &cov00, &cov01, &cov11, &chi_2);
+	if (polynomialSolve(d_p, d_results, covar, chi_2) != GSL_SUCCESS){
+		double c0, c1, cov00, cov01, cov11;
+		if (d_weighting == NoWeighting)
+			gsl_fit_linear(d_x, 1, d_y, 1, d_n, &c0, &c1, &cov00, &cov01, &cov11, &chi_2);
+		else
+			gsl_fit_wlinear(d_x, 1, d_w, 1, d_y, 1, d_n, &c0, &c1, &cov00, &cov01, &cov11, &chi_2);
 
-	d_results[0] = c0;
-	d_results[1] = c1;
+		d_results[0] = c0;
+		d_results[1] = c1;
 
-	gsl_matrix_set(covar, 0, 0, cov00);
-	gsl_matrix_set(covar, 0, 1, cov01);
-	gsl_matrix_set(covar, 1, 1, cov11);
-	gsl_matrix_set(covar, 1, 0, cov01);
+		gsl_matrix_set(covar, 0, 0, cov00);
+		gsl_matrix_set(covar, 0, 1, cov01);
+		gsl_matrix_set(covar, 1, 1, cov11);
+		gsl_matrix_set(covar, 1, 0, cov01);
+	}
 
 	generateFitCurve();
 
@@ -29,11 +29,11 @@
  *                                                                         *
  ***************************************************************************/
 #include "SmoothFilter.h"
+#include "FFTPlan.h"
 
 #include <QApplication>
 #include <QMessageBox>
 
-#include <gsl/gsl_fft_halfcomplex.h>
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_blas.h>
 #include <gsl/gsl_poly.h>
@@ -126,10 +126,7 @@ void SmoothFilter::calculateOutputData(double *x, double *y)
 
 void SmoothFilter::smoothFFT(double *x, double *y)
 {
-	gsl_fft_real_workspace *work = gsl_fft_real_workspace_alloc(d_n);
-	gsl_fft_real_wavetable *real = gsl_fft_real_wavetable_alloc(d_n);
-	gsl_fft_real_transform (y, 1, d_n, real, work);//FFT forward
-	gsl_fft_real_wavetable_free (real);
+	FFTPlan(FFTPlan::Real, d_n).execute(y);//FFT forward
 
 	double df = 1.0/(double)(x[1] - x[0]);
 	double lf = df/(double)d_smooth_points;//frequency cutoff
@@ -140,10 +137,7 @@ void SmoothFilter::smoothFFT(double *x, double *y)
 	   y[i] = i*df > lf ? 0 : y[i];//filtering frequencies
 	}
 
-	gsl_fft_halfcomplex_wavetable *hc = gsl_fft_halfcomplex_wavetable_alloc (d_n);
-	gsl_fft_halfcomplex_inverse (y, 1, d_n, hc, work);//FFT inverse
-	gsl_fft_halfcomplex_wavetable_free (hc);
-	gsl_fft_real_workspace_free (work);
+	FFTPlan(FFTPlan::HalfComplexInverse, d_n).execute(y);//FFT inverse
 }
 
 void SmoothFilter::smoothAverage(double *, double *y)
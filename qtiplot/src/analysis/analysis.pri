@@ -5,16 +5,20 @@
 INCLUDEPATH += src/analysis/
 INCLUDEPATH += src/analysis/dialogs/
 
-	HEADERS += src/analysis/ChiSquareTest.h \
+	HEADERS += src/analysis/BatchFit.h \
+			   src/analysis/ChiSquareTest.h \
 			   src/analysis/Convolution.h \
 			   src/analysis/Correlation.h \
 			   src/analysis/Differentiation.h \
 			   src/analysis/ExponentialFit.h \
 			   src/analysis/FFTFilter.h \
 			   src/analysis/FFT.h \
+			   src/analysis/FFTPlan.h \
 			   src/analysis/Filter.h \
 			   src/analysis/Fit.h \
+			   src/analysis/FitCompiler.h \
 			   src/analysis/FitModelHandler.h \
+			   src/analysis/GlobalFit.h \
 			   src/analysis/Integration.h \
 			   src/analysis/Interpolation.h \
 			   src/analysis/LogisticFit.h \
@@ -31,16 +35,20 @@ INCLUDEPATH += src/analysis/dialogs/
 			   src/analysis/fft2D.h \
 			   src/analysis/fit_gsl.h \
 
-	SOURCES += src/analysis/ChiSquareTest.cpp \
+	SOURCES += src/analysis/BatchFit.cpp \
+			   src/analysis/ChiSquareTest.cpp \
 			   src/analysis/Convolution.cpp \
 			   src/analysis/Correlation.cpp \
 			   src/analysis/Differentiation.cpp \
 			   src/analysis/ExponentialFit.cpp \
 			   src/analysis/FFTFilter.cpp \
 			   src/analysis/FFT.cpp \
+			   src/analysis/FFTPlan.cpp \
 			   src/analysis/Filter.cpp \
 			   src/analysis/Fit.cpp \
+			   src/analysis/FitCompiler.cpp \
 			   src/analysis/FitModelHandler.cpp \
+			   src/analysis/GlobalFit.cpp \
 			   src/analysis/Integration.cpp \
 			   src/analysis/Interpolation.cpp \
 			   src/analysis/LogisticFit.cpp \
@@ -28,6 +28,7 @@
  ***************************************************************************/
 #include "FitDialog.h"
 #include <Fit.h>
+#include <GlobalFit.h>
 #include <MultiPeakFit.h>
 #include <ExponentialFit.h>
 #include <PolynomialFit.h>
@@ -80,6 +81,7 @@ FitDialog::FitDialog(Graph *g, QWidget* parent)
 
 	d_param_table = 0;
 	d_current_fit = 0;
+	d_data_curve = 0;
 	d_preview_curve = NULL;
 
 	tw = new QStackedWidget();
@@ -198,6 +200,25 @@ void FitDialog::initFitPage()
 
 	gl1->addLayout(hbox2, 2, 3);
 
+	batchFitBox = new QCheckBox(tr("Fit &all curves"));
+	gl1->addWidget(batchFitBox, 3, 1);
+
+	warmStartBox = new QCheckBox(tr("&Warm start from previous result"));
+	warmStartBox->setEnabled(false);
+	connect(batchFitBox, SIGNAL(toggled(bool)), warmStartBox, SLOT(setEnabled(bool)));
+	gl1->addWidget(warmStartBox, 3, 3);
+
+	globalFitBox = new QCheckBox(tr("&Global fit, shared parameters"));
+	globalFitBox->setEnabled(false);
+	connect(batchFitBox, SIGNAL(toggled(bool)), globalFitBox, SLOT(setEnabled(bool)));
+	gl1->addWidget(globalFitBox, 4, 1);
+
+	sharedParamsBox = new QLineEdit();
+	sharedParamsBox->setEnabled(false);
+	connect(globalFitBox, SIGNAL(toggled(bool)), sharedParamsBox, SLOT(setEnabled(bool)));
+	connect(globalFitBox, SIGNAL(toggled(bool)), warmStartBox, SLOT(setDisabled(bool)));
+	gl1->addWidget(sharedParamsBox, 4, 3);
+
 	boxFunction = new QTextEdit();
 	boxFunction->setReadOnly(true);
     palette = boxFunction->palette();
@@ -280,6 +301,27 @@ void FitDialog::initFitPage()
 	gl3->addWidget(boxTolerance, 0, 4);
 	gl3->setColumnStretch(4, 1);
 
+	globalSearchBox = new QCheckBox(tr("Global &search"));
+	globalSearchBox->setChecked(false);
+	gl3->addWidget(globalSearchBox, 1, 0);
+
+	gl3->addWidget(new QLabel(tr("Starting points")), 1, 1);
+	boxStartingPoints = new QSpinBox();
+	boxStartingPoints->setRange(2, 100000);
+	boxStartingPoints->setSingleStep(10);
+	boxStartingPoints->setValue(100);
+	boxStartingPoints->setEnabled(false);
+	connect(globalSearchBox, SIGNAL(toggled(bool)), boxStartingPoints, SLOT(setEnabled(bool)));
+	gl3->addWidget(boxStartingPoints, 1, 2);
+
+	gl3->addWidget(new QLabel(tr("Robust loss")), 1, 3);
+	boxRobustLoss = new QComboBox();
+	boxRobustLoss->addItem(tr("None (Least Squares)"));
+	boxRobustLoss->addItem(tr("Huber"));
+	boxRobustLoss->addItem(tr("Cauchy"));
+	boxRobustLoss->addItem(tr("Tukey Biweight"));
+	gl3->addWidget(boxRobustLoss, 1, 4);
+
     QHBoxLayout *hbox3 = new QHBoxLayout();
 	previewBox = new QCheckBox(tr("&Preview"));
 	previewBox->setChecked(false);
@@ -996,12 +1038,16 @@ void FitDialog::showFitPage()
         boxAlgorithm->setEnabled(false);
 		boxPoints->setEnabled(false);
 		boxTolerance->setEnabled(false);
+		globalSearchBox->setEnabled(false);
+		boxRobustLoss->setEnabled(!d_current_fit->isA("LinearSlopeFit"));
 		btnGuess->setVisible(false);
     } else {
         btnParamRange->setEnabled(true);
         boxAlgorithm->setEnabled(true);
 		boxPoints->setEnabled(true);
 		boxTolerance->setEnabled(true);
+		globalSearchBox->setEnabled(true);
+		boxRobustLoss->setEnabled(true);
 		btnGuess->setVisible(d_current_fit->type() == Fit::BuiltIn);
     }
 
@@ -1452,9 +1498,8 @@ void FitDialog::accept()
 
 		d_current_fit->setInitialGuesses(paramsInit);
 
-		if (!d_current_fit->setDataFromCurve(d_graph->curve(boxCurve->currentText()), start, end) ||
-			!d_current_fit->setWeightingData ((Fit::WeightingMethod)boxWeighting->currentIndex(),
-						   tableNamesBox->currentText() + "_" + colNamesBox->currentText())) return;
+		if (!loadFitData())
+			return;
 
 		if (btnParamRange->isEnabled()){
 			for (int i = 0; i < n; i++)
@@ -1467,8 +1512,19 @@ void FitDialog::accept()
 		d_current_fit->setColor(boxColor->color());
 		d_current_fit->generateFunction(generatePointsBtn->isChecked(), generatePointsBox->value());
 		d_current_fit->setMaximumIterations(boxPoints->value());
+		d_current_fit->setGlobalSearch(globalSearchBox->isEnabled() && globalSearchBox->isChecked() ? boxStartingPoints->value() : 0);
+		d_current_fit->setRobustLoss(boxRobustLoss->isEnabled() ? (Fit::RobustLoss)boxRobustLoss->currentIndex() : Fit::LeastSquares);
 		if (!d_current_fit->isA("PolynomialFit") && !d_current_fit->isA("LinearFit") && !d_current_fit->isA("LinearSlopeFit"))
 			d_current_fit->scaleErrors(scaleErrorsBox->isChecked());
+
+		if (batchFitBox->isChecked()){
+			fitAllCurves(curvesList, start, end);
+			free (paramsInit);
+			free (paramRangeLeft);
+			free (paramRangeRight);
+			return;
+		}
+
 		d_current_fit->fit();
 		d_result_curves << d_current_fit->resultCurve();
 		double *res = d_current_fit->results();
@@ -1503,6 +1559,84 @@ void FitDialog::accept()
 	}
 }
 
+bool FitDialog::loadFitData()
+{
+	QwtPlotCurve *c = d_graph->curve(boxCurve->currentText());
+	double start = boxFrom->value();
+	double end = boxTo->value();
+	int weighting = boxWeighting->currentIndex();
+	QString weightingDataset = tableNamesBox->currentText() + "_" + colNamesBox->currentText();
+
+	// each fit removes the singularities of user functions from the data set, depending on the formula,
+	// the initial values and the constants: only data sets left unchanged by the previous fits are reused
+	if (d_data_fit && d_data_fit == d_current_fit && c && c == d_data_curve && start == d_data_start &&
+		end == d_data_end && weighting == d_data_weighting && weightingDataset == d_data_weighting_dataset &&
+		d_current_fit->dataSize() == d_data_points)
+		return true;
+
+	d_data_fit = 0;
+	if (!d_current_fit->setDataFromCurve(c, start, end) ||
+		!d_current_fit->setWeightingData((Fit::WeightingMethod)weighting, weightingDataset))
+		return false;
+
+	d_data_fit = d_current_fit;
+	d_data_curve = c;
+	d_data_start = start;
+	d_data_end = end;
+	d_data_weighting = weighting;
+	d_data_weighting_dataset = weightingDataset;
+	d_data_points = d_current_fit->dataSize();
+
+	// the data set is read again as soon as the source table is modified
+	PlotCurve *pc = (PlotCurve *)c;
+	if (pc->type() != Graph::Function){
+		Table *t = ((DataCurve *)c)->table();
+		disconnect(t, SIGNAL(modifiedData(Table *, const QString&)), this, SLOT(invalidateFitData()));
+		connect(t, SIGNAL(modifiedData(Table *, const QString&)), this, SLOT(invalidateFitData()));
+	}
+	return true;
+}
+
+void FitDialog::invalidateFitData()
+{
+	d_data_fit = 0;
+}
+
+void FitDialog::fitAllCurves(const QStringList& curves, double start, double end)
+{
+	// the batch fit loads all the curves into the model
+	invalidateFitData();
+
+	BatchFit *batch = 0;
+	if (globalFitBox->isChecked()){
+		GlobalFit *globalFit = new GlobalFit(d_current_fit);
+		QStringList names = sharedParamsBox->text().split(QRegExp("[,;\\s]"), QString::SkipEmptyParts);
+		foreach(QString name, names){
+			if (!globalFit->setSharedParameter(name)){
+				QMessageBox::critical(this, tr("QtiPlot - Input error"), tr("Unknown parameter name: %1!").arg(name));
+				sharedParamsBox->setFocus();
+				delete globalFit;
+				return;
+			}
+		}
+		batch = globalFit;
+	} else {
+		batch = new BatchFit(d_current_fit);
+		batch->setWarmStart(warmStartBox->isChecked());
+	}
+
+	foreach(QString name, curves){
+		PlotCurve *c = d_graph->curve(name);
+		if (!c || c->type() == Graph::Function)
+			continue;
+		batch->addDataSet(c, start, end);
+	}
+
+	if (batch->run())
+		batch->resultsTable(globalFitBox->isChecked() ? tr("GlobalFit") : tr("BatchFit"));
+	delete batch;
+}
+
 void FitDialog::modifyGuesses(double* initVal)
 {
 	if (!d_current_fit)
@@ -1540,8 +1674,12 @@ void FitDialog::setSrcTables(QList<MdiSubWindow*> tables)
 
 	srcTables = tables;
 	tableNamesBox->clear();
-	foreach(MdiSubWindow *w, srcTables)
+	foreach(MdiSubWindow *w, srcTables){
 		tableNamesBox->addItem(w->objectName());
+		// weighting data sets may be read from any table
+		disconnect(w, SIGNAL(modifiedData(Table *, const QString&)), this, SLOT(invalidateFitData()));
+		connect(w, SIGNAL(modifiedData(Table *, const QString&)), this, SLOT(invalidateFitData()));
+	}
 
 	tableNamesBox->setCurrentIndex(tableNamesBox->findText(boxCurve->currentText().split("_", QString::SkipEmptyParts)[0]));
 	selectSrcTable(tableNamesBox->currentIndex());
@@ -1786,7 +1924,8 @@ void FitDialog::guessInitialValues()
 		return;
 
 	if (d_current_fit->type() == Fit::BuiltIn){
-		d_current_fit->setDataFromCurve(boxCurve->currentText(), boxFrom->value(), boxTo->value());
+		if (!loadFitData())
+			return;
 		d_current_fit->guessInitialValues();
 		//modifyGuesses (paramsInit);
 	}
@@ -117,6 +117,8 @@ private slots:
 	void showPreview(bool on);
 	void showParameterRange(bool);
 	void guessParameters();
+	//! Forces the next fit to read the data set again
+	void invalidateFitData();
 
 private:
 	void loadPlugins();
@@ -129,10 +131,20 @@ private:
 	QString parseFormula(const QString& s);
 	void setEditorTextColor(const QColor& c);
 	void setCurrentFit(int);
+	//! Loads the selected data set into the current fit, unless it is already loaded
+	bool loadFitData();
+	//! Fits the current model to all the curves in the list using a BatchFit
+	void fitAllCurves(const QStringList& curves, double start, double end);
 
     Fit *d_current_fit;
 	Graph *d_graph;
 	QPointer <Table> d_param_table;
+	//! Fit holding the data set loaded by loadFitData() and the settings it was loaded with
+	QPointer <Fit> d_data_fit;
+	QwtPlotCurve *d_data_curve;
+	double d_data_start, d_data_end;
+	int d_data_weighting, d_data_points;
+	QString d_data_weighting_dataset;
 	QList <Fit*> d_user_functions, d_built_in_functions, d_plugins;
 	QList <QwtPlotCurve*> d_result_curves;
 	QList <MdiSubWindow*> srcTables;
@@ -151,11 +163,13 @@ private:
 	QPushButton* btnSaveGuesses, *btnLoadGuesses, *btnGuess;
 	QComboBox* boxCurve;
 	QComboBox* boxAlgorithm;
+	QComboBox* boxRobustLoss;
 	QTableWidget* boxParams;
 	DoubleSpinBox* boxFrom;
 	DoubleSpinBox* boxTo;
 	DoubleSpinBox* boxTolerance;
-	QSpinBox* boxPoints, *generatePointsBox, *boxPrecision, *polynomOrderBox;
+	QSpinBox* boxPoints, *generatePointsBox, *boxPrecision, *polynomOrderBox, *boxStartingPoints;
+	QCheckBox *globalSearchBox;
 	QWidget *fitPage, *editPage, *advancedPage;
 	ScriptEdit *editBox;
 	QTextEdit *explainBox, *boxFunction;
@@ -173,6 +187,7 @@ private:
 	DoubleSpinBox *boxConfidenceLevel;
 	QLineEdit *covMatrixName, *paramTableName;
 	QCheckBox *plotLabelBox, *logBox, *scaleErrorsBox, *globalParamTableBox;
-	QCheckBox *previewBox;
+	QCheckBox *previewBox, *batchFitBox, *warmStartBox, *globalFitBox;
+	QLineEdit *sharedParamsBox;
 };
 #endif // FITDIALOG_H
@@ -27,8 +27,18 @@
  *                                                                         *
  ***************************************************************************/
 #include "fft2D.h"
-#include <Matrix.h>
+#include "FFTPlan.h"
+
+#include <QThread>
+#include <QVector>
+#if QT_VERSION >= 0x040400
+#include <QtConcurrentRun>
+#include <QFuture>
+#endif
+
 #include <math.h>
+#include <stdlib.h>
+#include <gsl/gsl_fft_halfcomplex.h>
 
 int next2Power(int n)
 {
@@ -46,168 +56,178 @@ bool isPower2(int n)
 	return n && !(n & (n - 1));
 }
 
-void fft(double* x_int_re, double* x_int_im, int taille)
-{
-	int size_2 = taille >> 1, tmp1 = 0;
-	double tmp, tmpcos, tmpsin, base = 2*M_PI/taille;
-	const double SQ_2=sqrt(2);
-	double pair_re[size_2], pair_im[size_2], impair_re[size_2], impair_im[size_2];
-
-	for(int i=0; i<size_2; i++){
-		tmp1=(i<<1);
-		pair_re[i]=x_int_re[tmp1];
-		pair_im[i]=x_int_im[tmp1];
-		impair_re[i]=x_int_re[tmp1+1];
-		impair_im[i]=x_int_im[tmp1+1];
-	}
-
-	if(taille>2){
-		fft(pair_re,pair_im,size_2);
-		fft(impair_re,impair_im,size_2);
-	}
-
-	for(int i=0; i<size_2; i++){
-		tmp=base*i;
-		tmpcos=cos(tmp);
-		tmpsin=sin(tmp);
-		x_int_re[i]=(pair_re[i]+impair_re[i]*tmpcos+impair_im[i]*tmpsin)/SQ_2;
-		x_int_im[i]=(pair_im[i]+impair_im[i]*tmpcos-impair_re[i]*tmpsin)/SQ_2;
-		x_int_re[i+size_2]=(pair_re[i]-impair_re[i]*tmpcos-impair_im[i]*tmpsin)/SQ_2;
-		x_int_im[i+size_2]=(pair_im[i]-impair_im[i]*tmpcos+impair_re[i]*tmpsin)/SQ_2;
-	}
-}
-
-void fft_inv(double* x_int_re, double* x_int_im, int taille)
-{
-	int size_2 = taille >> 1, tmp1 = 0;
-	double tmp, tmpcos, tmpsin, base=2*M_PI/taille;
-	const double SQ_2=sqrt(2);
-	double pair_re[size_2], pair_im[size_2], impair_re[size_2], impair_im[size_2];
-
-	for(int i=0; i<size_2; i++){
-		tmp1=i<<1;
-		pair_re[i]=x_int_re[tmp1];
-		pair_im[i]=x_int_im[tmp1];
-		impair_re[i]=x_int_re[tmp1+1];
-		impair_im[i]=x_int_im[tmp1+1];
-	}
-
-	if(taille>2){
-		fft_inv(pair_re, pair_im,size_2);
-		fft_inv(impair_re, impair_im,size_2);
-	}
-
-	for(int i=0; i<size_2; i++){
-		tmp=base*i;
-		tmpcos=cos(tmp);
-		tmpsin=sin(tmp);
-		x_int_re[i]=(pair_re[i]+impair_re[i]*tmpcos-impair_im[i]*tmpsin)/SQ_2;
-		x_int_im[i]=(pair_im[i]+impair_im[i]*tmpcos+impair_re[i]*tmpsin)/SQ_2;
-		x_int_re[i+size_2]=(pair_re[i]-impair_re[i]*tmpcos+impair_im[i]*tmpsin)/SQ_2;
-		x_int_im[i+size_2]=(pair_im[i]-impair_im[i]*tmpcos-impair_re[i]*tmpsin)/SQ_2;
-	}
-}
-
-void fft2d(double **xtre, double **xtim, int width, int height, bool shift)
+//! Number of columns gathered in a contiguous buffer and transformed together
+static const int fft2d_columns = 16;
+
+//! Data shared by the threads of a 2D transform
+struct FFT2DCall {
+	double **re, **im;
+	//! Output matrices, may be the input ones
+	double **out_re, **out_im;
+	int width, height;
+	bool inverse;
+	//! Rows of the input matrices are read from the shifted positions (inverse transform)
+	bool undoShift;
+	//! Columns of the output matrices are written to the shifted positions (forward transform)
+	bool shift;
+	//! Normalization of the transform
+	double scale;
+	//! Transforms of the rows, stored as packed complex values, one row after the other
+	double *rows;
+	const FFTPlan *rowPlan, *realRowPlan, *columnPlan;
+	int threads;
+	//! Error status of the threads
+	bool *ok;
+};
+
+//! Transforms the rows of the slice assigned to the thread
+static void transformRows(FFT2DCall *call, int thread)
 {
-	double **xint_re = Matrix::allocateMatrixData(height, width);
-	if (!xint_re)
-		return;
-	double **xint_im = Matrix::allocateMatrixData(height, width);
-	if (!xint_im){
-		Matrix::freeMatrixData(xint_re, height);
-		return;
-	}
-
-	double x_int_l[width], x_int2_l[width], x_int_c[height], x_int2_c[height];
-	for(int k=0; k<height; k++){
-		for(int j=0; j<width; j++){
-			x_int_l[j] = xtre[k][j];
-			x_int2_l[j] = xtim[k][j];
+	int w = call->width, h = call->height;
+	int first = thread*h/call->threads, last = (thread + 1)*h/call->threads;
+	QVector<double> real(w);
+	bool ok = true;
+	for (int k = first; k < last && ok; k++){
+		int row = call->undoShift ? (k + (h>>1))%h : k;
+		double *re = call->re[row], *im = call->im[row];
+		double *c = call->rows + 2*(size_t)k*w;
+
+		bool isReal = !call->inverse;
+		for (int j = 0; j < w && isReal; j++)
+			isReal = (im[j] == 0.0);
+
+		if (isReal){
+			// real to complex transform, the other half of the coefficients is given by the Hermitian symmetry
+			for (int j = 0; j < w; j++)
+				real[j] = re[j];
+			ok = call->realRowPlan->execute(real.data());
+			gsl_fft_halfcomplex_unpack(real.data(), c, 1, w);
+			continue;
 		}
 
-		fft(x_int_l, x_int2_l, width);
-
-		for(int j=0; j<width; j++){
-			xint_re[k][j] = x_int_l[j];
-			xint_im[k][j] = x_int2_l[j];
+		if (call->undoShift){
+			for (int j = 0; j < w; j++){
+				int col = (j + (w>>1))%w;
+				c[2*j] = re[col];
+				c[2*j + 1] = im[col];
+			}
+		} else {
+			for (int j = 0; j < w; j++){
+				c[2*j] = re[j];
+				c[2*j + 1] = im[j];
+			}
 		}
+		ok = call->rowPlan->execute(c);
 	}
+	call->ok[thread] = ok;
+}
 
-	for(int k=0; k<width; k++){
-		for(int i=0; i<height; i++){
-			x_int_c[i] = xint_re[i][k];
-			x_int2_c[i] = xint_im[i][k];
+//! Transforms the batches of columns thread, thread + threads, thread + 2*threads, ... and writes them to the output
+static void transformColumns(FFT2DCall *call, int thread)
+{
+	int w = call->width, h = call->height;
+	int batches = (w + fft2d_columns - 1)/fft2d_columns;
+	double scale = call->scale;
+	// the columns of a batch are gathered one after the other, reading tiles of adjacent values from each row
+	QVector<double> buffer(2*fft2d_columns*h);
+	bool ok = true;
+	for (int b = thread; b < batches && ok; b += call->threads){
+		int first = b*fft2d_columns;
+		int count = qMin(fft2d_columns, w - first);
+		for (int i = 0; i < h; i++){
+			const double *c = call->rows + 2*((size_t)i*w + first);
+			for (int j = 0; j < count; j++){
+				double *col = buffer.data() + 2*(size_t)j*h;
+				col[2*i] = c[2*j];
+				col[2*i + 1] = c[2*j + 1];
+			}
 		}
 
-		fft(x_int_c, x_int2_c, height) ;
-
-		if (shift){
-			int col = (k+(width>>1))%width;
-			for(int i=0; i<height; i++){
-				int row = (i+(height>>1))%height;
-				xtre[row][col] = x_int_c[i];
-				xtim[row][col] = x_int2_c[i];
-			}
-		} else {
-			for(int i=0; i<height; i++){
-				xtre[i][k] = x_int_c[i];
-				xtim[i][k] = x_int2_c[i];
+		for (int j = 0; j < count && ok; j++)
+			ok = call->columnPlan->execute(buffer.data() + 2*(size_t)j*h);
+
+		for (int i = 0; i < h; i++){
+			int row = call->shift ? (i + (h>>1))%h : i;
+			double *re = call->out_re[row], *im = call->out_im[row];
+			for (int j = 0; j < count; j++){
+				int col = first + j;
+				if (call->shift)
+					col = (col + (w>>1))%w;
+				const double *v = buffer.data() + 2*((size_t)j*h + i);
+				re[col] = scale*v[0];
+				im[col] = scale*v[1];
 			}
 		}
 	}
-	Matrix::freeMatrixData(xint_re, height);
-	Matrix::freeMatrixData(xint_im, height);
+	call->ok[thread] = ok;
 }
 
-void fft2d_inv(double **xtre, double **xtim, double **xrec_re, double **xrec_im, int width, int height, bool undoShift)
+static bool runFFT2D(void (*f)(FFT2DCall *, int), FFT2DCall *call)
 {
-	double **xint_re = Matrix::allocateMatrixData(height, width);
-	if (!xint_re)
-		return;
-	double **xint_im = Matrix::allocateMatrixData(height, width);
-	if (!xint_im){
-		Matrix::freeMatrixData(xint_re, height);
-		return;
+	QVector<bool> ok(call->threads, true);
+	call->ok = ok.data();
+#if QT_VERSION >= 0x040400
+	QList<QFuture<void> > futures;
+	for (int i = 1; i < call->threads; i++)
+		futures << QtConcurrent::run(f, call, i);
+	f(call, 0);
+	for (int i = 0; i < futures.size(); i++)
+		futures[i].waitForFinished();
+#else
+	f(call, 0);
+#endif
+	for (int i = 0; i < call->threads; i++){
+		if (!ok[i])
+			return false;
 	}
+	return true;
+}
 
-	double x_int_l[width], x_int2_l[width], x_int_c[height], x_int2_c[height];
-
-	for(int k = 0; k < height; k++){
-		if (undoShift){
-			int row = (k + (height>>1))%height;
-			for(int j = 0; j < width; j++){
-				int col = (j + (width>>1))%width;
-				x_int_l[j] = xtre[row][col];
-				x_int2_l[j] = xtim[row][col];
-			}
-		} else {
-			for(int j = 0; j < width; j++){
-				x_int_l[j] = xtre[k][j];
-				x_int2_l[j] = xtim[k][j];
-			}
-		}
-
-		fft_inv(x_int_l, x_int2_l, width);
+/*! Unitary 2D transform (normalized by 1/sqrt(width*height)) of the matrix (re, im), written to (out_re, out_im):
+ * the rows are transformed first, then the columns, in batches processed by a pool of threads.
+ */
+static bool fft2D(double **re, double **im, double **out_re, double **out_im, int width, int height, bool inverse, bool shift)
+{
+	if (width < 1 || height < 1)
+		return false;
+
+	double *rows = (double *)malloc(2*(size_t)width*height*sizeof(double));
+	if (!rows)
+		return false;
+
+	FFTPlan::Type type = inverse ? FFTPlan::ComplexInverse : FFTPlan::Complex;
+	FFTPlan rowPlan(type, width), realRowPlan(FFTPlan::Real, width), columnPlan(type, height);
+	if (!rowPlan.isValid() || !realRowPlan.isValid() || !columnPlan.isValid()){
+		free(rows);
+		return false;
+	}
 
-		for(int j = 0; j < width; j++){
-			xint_re[k][j] = x_int_l[j];
-			xint_im[k][j] = x_int2_l[j];
-		}
+	// the inverse transforms computed by FFTPlan are normalized by 1/n
+	double n = (double)width*height;
+	double scale = inverse ? sqrt(n) : 1.0/sqrt(n);
+
+	int threads = 1;
+#if QT_VERSION >= 0x040400
+	threads = qMax(1, QThread::idealThreadCount());
+#endif
+
+	FFT2DCall call = {re, im, out_re, out_im, width, height, inverse, inverse && shift, !inverse && shift,
+					scale, rows, &rowPlan, &realRowPlan, &columnPlan, qMin(threads, height), 0};
+	bool ok = runFFT2D(transformRows, &call);
+	if (ok){
+		call.threads = qMin(threads, (width + fft2d_columns - 1)/fft2d_columns);
+		ok = runFFT2D(transformColumns, &call);
 	}
-	for(int k = 0; k < width; k++){
-		for(int i = 0; i < height; i++){
-			x_int_c[i] = xint_re[i][k];
-			x_int2_c[i] = xint_im[i][k];
-		}
+	free(rows);
+	return ok;
+}
 
-		fft_inv(x_int_c, x_int2_c, height);
+bool fft2d(double **xtre, double **xtim, int width, int height, bool shift)
+{
+	return fft2D(xtre, xtim, xtre, xtim, width, height, false, shift);
+}
 
-		for(int i = 0; i < height; i++){
-			xrec_re[i][k] = x_int_c[i];
-			xrec_im[i][k] = x_int2_c[i];
-		}
-	}
-	Matrix::freeMatrixData(xint_re, height);
-	Matrix::freeMatrixData(xint_im, height);
+bool fft2d_inv(double **xtre, double **xtim, double **xrec_re, double **xrec_im, int width, int height, bool undoShift)
+{
+	return fft2D(xtre, xtim, xrec_re, xrec_im, width, height, true, undoShift);
 }
@@ -30,8 +30,13 @@
 #ifndef FOURIER_H
 #define FOURIER_H
 
-void fft2d(double **xtre, double **xtim, int width, int height, bool shift = true);
-void fft2d_inv(double **xtre, double **xtim, double **xrec_re, double **xrec_im, int width, int height, bool undoShift = true);
+//! Unitary 2D FFT of any size, computed in place; the zero frequency is moved to the center if shift is true
+/**
+ * Returns false if the memory needed by the transform couldn't be allocated.
+ */
+bool fft2d(double **xtre, double **xtim, int width, int height, bool shift = true);
+//! Inverse of fft2d(), written to (xrec_re, xrec_im). Returns false if the memory needed by the transform couldn't be allocated.
+bool fft2d_inv(double **xtre, double **xtim, double **xrec_re, double **xrec_im, int width, int height, bool undoShift = true);
 
 bool isPower2(int n);
 int next2Power(int n);
@@ -38,8 +38,18 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stddef.h>
+#include <algorithm>
+#include <QApplication>
 #include <QMessageBox>
+#include <QThread>
+#include <QVector>
+#if QT_VERSION >= 0x040400
+#include <QtConcurrentRun>
+#include <QFuture>
+#endif
+
 #include <gsl/gsl_blas.h>
+#include <gsl/gsl_math.h>
 
 int expd3_f (const gsl_vector * x, void *params, gsl_vector * f){
     int n = ((struct FitData *)params)->n;
@@ -510,140 +520,166 @@ int lorentz_multi_peak_fdf (const gsl_vector * x, void *params, gsl_vector * f,
     return GSL_SUCCESS;
 }
 
-int user_f(const gsl_vector * x, void *params, gsl_vector * f) {
-    int n = ((struct FitData *)params)->n;
-    int p = ((struct FitData *)params)->p;
-    double *X = ((struct FitData *)params)->X;
-    double *Y = ((struct FitData *)params)->Y;
-    double *sigma = ((struct FitData *)params)->sigma;
+//! Parser evaluating the formula of a NonLinearFit. Each thread evaluating the model uses its own instance.
+class UserFitParser
+{
+public:
+	UserFitParser(NonLinearFit *fitter);
+
+	int residuals(const gsl_vector *x, struct FitData *data, gsl_vector *f);
+	double chiSquare(const gsl_vector *x, struct FitData *data);
+	int jacobian(const gsl_vector *x, struct FitData *data, gsl_matrix *J);
+
+private:
+	void setParameters(const gsl_vector *x);
 
-	NonLinearFit *fitter = (NonLinearFit *)((struct FitData *) params)->fitter;
-	const char *function = fitter->formula().ascii();
+	MyParser d_parser;
+	double d_x;
+	//! The parser variables are bound to the elements of this vector, it must never be resized
+	QVector<double> d_parameters;
+};
+
+UserFitParser::UserFitParser(NonLinearFit *fitter) : d_x(0.0)
+{
 	QStringList parNames = fitter->parameterNames();
+	int p = parNames.size();
+	d_parameters.resize(p);
 
-	MyParser parser;
-    try {
-        double *parameters = new double[p];
-        double xvar;
-        parser.DefineVar("x", &xvar);
-        for (int i = 0; i < p; i++) {
-            parameters[i] = gsl_vector_get(x,i);
-            parser.DefineVar(parNames[i].ascii(), &parameters[i]);
-        }
+	d_parser.DefineVar("x", &d_x);
+	double *parameters = d_parameters.data();
+	for (int i = 0; i < p; i++)
+		d_parser.DefineVar(parNames[i].toStdString(), &parameters[i]);
 
-		QMapIterator<QString, double> i(fitter->constants());
- 		while (i.hasNext()){
-     		i.next();
-			parser.DefineConst(i.key().ascii(), i.value());
- 		}
-
-        parser.SetExpr(function);
-        for (int j = 0; j < n; j++) {
-            xvar = X[j];
-			double s = 1.0/sqrt(sigma[j]);
-			try {
-			    gsl_vector_set (f, j, (parser.EvalRemoveSingularity(&xvar) - Y[j])/s);
-			} catch (MyParser::Pole) {
-			    return GSL_ESING;
-			}
-         }
-        delete[] parameters;
-    } catch (mu::ParserError &e) {
-        QMessageBox::critical(0, "QtiPlot - Input function error", QString::fromStdString(e.GetMsg()));
-        return GSL_EINVAL;
-    }
-    return GSL_SUCCESS;
+	QMapIterator<QString, double> i(fitter->constants());
+	while (i.hasNext()){
+		i.next();
+		d_parser.DefineConst(i.key().toStdString(), i.value());
+	}
+
+	d_parser.SetExpr(fitter->formula().toStdString());
 }
 
-double user_d(const gsl_vector * x, void *params) {
-    int n = ((struct FitData *)params)->n;
-    int p = ((struct FitData *)params)->p;
-    double *X = ((struct FitData *)params)->X;
-    double *Y = ((struct FitData *)params)->Y;
-    double *sigma = ((struct FitData *)params)->sigma;
+void UserFitParser::setParameters(const gsl_vector *x)
+{
+	double *parameters = d_parameters.data();
+	for (int i = 0; i < d_parameters.size(); i++)
+		parameters[i] = gsl_vector_get(x, i);
+}
 
-	NonLinearFit *fitter = (NonLinearFit *)((struct FitData *) params)->fitter;
-	const char *function = fitter->formula().ascii();
-	QStringList parNames = fitter->parameterNames();
+int UserFitParser::residuals(const gsl_vector *x, struct FitData *data, gsl_vector *f)
+{
+	int n = data->n;
+	double *Y = data->Y;
+	double *sigma = data->sigma;
 
-    double val=0;
-    MyParser parser;
-    try {
-        double *parameters = new double[p];
-        double xvar;
-        parser.DefineVar("x", &xvar);
-        for (int i=0; i < p; i++) {
-            parameters[i]=gsl_vector_get(x,i);
-            parser.DefineVar(parNames[i].ascii(), &parameters[i]);
-        }
+	setParameters(x);
+	double *values = new double[n];
+	// called by worker threads: non-removable singularities are reported as NaN values
+	d_parser.EvalBatchRemoveSingularity(&d_x, data->X, values, n, false);
+	for (int j = 0; j < n; j++) {
+		if (gsl_isnan(values[j])) {
+			delete[] values;
+			return GSL_ESING;
+		}
+		double s = 1.0/sqrt(sigma[j]);
+		gsl_vector_set (f, j, (values[j] - Y[j])/s);
+	}
+	delete[] values;
+	return GSL_SUCCESS;
+}
+
+double UserFitParser::chiSquare(const gsl_vector *x, struct FitData *data)
+{
+	int n = data->n;
+	double *Y = data->Y;
+	double *sigma = data->sigma;
 
-		QMapIterator<QString, double> i(fitter->constants());
- 		while (i.hasNext()){
-     		i.next();
-			parser.DefineConst(i.key().ascii(), i.value());
- 		}
-
-        parser.SetExpr(function);
-        for (int j = 0; j < n; j++) {
-            xvar = X[j];
-			double s = 1.0/sqrt(sigma[j]);
-            try {
-				double t = (parser.EvalRemoveSingularity(&xvar) - Y[j])/s;
-				val += t*t;
-			} catch (MyParser::Pole) {
-				return GSL_POSINF; //weird, I know. blame gsl.
+	setParameters(x);
+	double *values = new double[n];
+	d_parser.EvalBatchRemoveSingularity(&d_x, data->X, values, n, false);
+	double val = 0;
+	for (int j = 0; j < n; j++) {
+		if (gsl_isnan(values[j])) {
+			delete[] values;
+			return GSL_POSINF; //weird, I know. blame gsl.
+		}
+		double s = 1.0/sqrt(sigma[j]);
+		double t = (values[j] - Y[j])/s;
+		val += t*t;
+	}
+	delete[] values;
+	return val;
+}
+
+int UserFitParser::jacobian(const gsl_vector *x, struct FitData *data, gsl_matrix *J)
+{
+	int n = data->n;
+	double *sigma = data->sigma;
+
+	setParameters(x);
+	double *param = d_parameters.data();
+	double *values = new double[n];
+	for (int j = 0; j < d_parameters.size(); j++) {
+		d_parser.DiffBatchRemoveSingularity(&d_x, data->X, &param[j], param[j], values, n, false);
+		for (int i = 0; i < n; i++) {
+			if (gsl_isnan(values[i])) {
+				delete[] values;
+				return GSL_ESING;
 			}
-        }
-        delete[] parameters;
-    } catch (mu::ParserError &e) {
-        QMessageBox::critical(0,"QtiPlot - Input function error",QString::fromStdString(e.GetMsg()));
-        return GSL_EINVAL;
-    }
-    return val;
+			double s = 1.0/sqrt(sigma[i]);
+			gsl_matrix_set (J, i, j, 1.0/s*values[i]);
+		}
+	}
+	delete[] values;
+	return GSL_SUCCESS;
 }
 
-int user_df(const gsl_vector *x, void *params, gsl_matrix *J) {
-    int n = ((struct FitData *)params)->n;
-    int p = ((struct FitData *)params)->p;
-    double *X = ((struct FitData *)params)->X;
-    double *sigma = ((struct FitData *)params)->sigma;
+//! Message boxes can only be displayed by the GUI thread, worker threads only return the error code
+static void userFunctionError(const mu::ParserError& e)
+{
+	if (QThread::currentThread() == QApplication::instance()->thread())
+		QMessageBox::critical(0, "QtiPlot - Input function error", QString::fromStdString(e.GetMsg()));
+}
 
-	NonLinearFit *fitter = (NonLinearFit *)((struct FitData *) params)->fitter;
-	const char *function = fitter->formula().ascii();
-	QStringList parNames = fitter->parameterNames();
+int user_f(const gsl_vector * x, void *params, gsl_vector * f) {
+	struct FitData *data = (struct FitData *)params;
+	try {
+		if (data->evaluator)
+			return ((UserFitParser *)data->evaluator)->residuals(x, data, f);
 
+		UserFitParser parser((NonLinearFit *)data->fitter);
+		return parser.residuals(x, data, f);
+	} catch (mu::ParserError &e) {
+		userFunctionError(e);
+		return GSL_EINVAL;
+	}
+}
+
+double user_d(const gsl_vector * x, void *params) {
+	struct FitData *data = (struct FitData *)params;
 	try {
-        double *param = new double[p];
-        MyParser parser;
-        double xvar;
-        parser.DefineVar("x", &xvar);
-        for (int k=0; k<p; k++) {
-            param[k] = gsl_vector_get(x,k);
-            parser.DefineVar(parNames[k].ascii(), &param[k]);
-        }
+		if (data->evaluator)
+			return ((UserFitParser *)data->evaluator)->chiSquare(x, data);
 
-		QMapIterator<QString, double> i(fitter->constants());
- 		while (i.hasNext()){
-     		i.next();
-			parser.DefineConst(i.key().ascii(), i.value());
- 		}
+		UserFitParser parser((NonLinearFit *)data->fitter);
+		return parser.chiSquare(x, data);
+	} catch (mu::ParserError &e) {
+		userFunctionError(e);
+		return GSL_EINVAL;
+	}
+}
 
-        parser.SetExpr(function);
-        for (int i = 0; i < n; i++) {
-            xvar = X[i];
-			double s = 1.0/sqrt(sigma[i]);
-            for (int j = 0; j < p; j++)
-	        try {
-				gsl_matrix_set (J, i, j, 1.0/s*parser.DiffRemoveSingularity(&xvar, &param[j], param[j]));
-			} catch (MyParser::Pole) {
-				return GSL_ESING;
-			}
-        }
-        delete[] param;
-    } catch (mu::ParserError &) {
-        return GSL_EINVAL;
-    }
-    return GSL_SUCCESS;
+int user_df(const gsl_vector *x, void *params, gsl_matrix *J) {
+	struct FitData *data = (struct FitData *)params;
+	try {
+		if (data->evaluator)
+			return ((UserFitParser *)data->evaluator)->jacobian(x, data, J);
+
+		UserFitParser parser((NonLinearFit *)data->fitter);
+		return parser.jacobian(x, data, J);
+	} catch (mu::ParserError &) {
+		return GSL_EINVAL;
+	}
 }
 
 int user_fdf(const gsl_vector * x, void *params, gsl_vector * f, gsl_matrix * J) {
@@ -787,3 +823,565 @@ int logistic_fdf (const gsl_vector * x, void *params, gsl_vector * f, gsl_matrix
     logistic_df (x, params, J);
     return GSL_SUCCESS;
 }
+
+/*****************************************************************************
+ * Parallel evaluation of the fit models
+ *****************************************************************************/
+
+//! Number of data points evaluated by a single call of the fit model
+/**
+ * The partition of the data in blocks doesn't depend on the number of threads,
+ * so that the sums of squares are always added in the same order.
+ */
+static const int parallel_fit_block = 16384;
+
+struct ParallelFitData {
+	struct FitData *data;
+	fit_f f;
+	fit_df df;
+	fit_fdf fdf;
+	fit_d d;
+	int blocks;
+	int threads;
+	//! Evaluators of user defined models, one for each thread
+	void **evaluators;
+};
+
+void* fit_evaluator_alloc(struct FitData *data, fit_f f)
+{
+	if (f != user_f || !data->fitter)
+		return 0;
+
+	return new UserFitParser((NonLinearFit *)data->fitter);
+}
+
+void fit_evaluator_free(void *evaluator)
+{
+	delete (UserFitParser *)evaluator;
+}
+
+ParallelFitData* parallel_fit_alloc(struct FitData *data, fit_f f, fit_df df, fit_fdf fdf, fit_d d)
+{
+#if QT_VERSION >= 0x040400
+	if (data->fitter && !data->fitter->isThreadSafe())
+		return 0;
+
+	int blocks = (data->n + parallel_fit_block - 1)/parallel_fit_block;
+	int threads = qMin(QThread::idealThreadCount(), blocks);
+	if (threads < 2)
+		return 0;
+
+	ParallelFitData *pd = new ParallelFitData;
+	pd->data = data;
+	pd->f = f;
+	pd->df = df;
+	pd->fdf = fdf;
+	pd->d = d;
+	pd->blocks = blocks;
+	pd->threads = threads;
+	pd->evaluators = 0;
+
+	if (f == user_f && data->fitter){
+		pd->evaluators = new void*[threads];
+		for (int i = 0; i < threads; i++)
+			pd->evaluators[i] = 0;
+		try {
+			for (int i = 0; i < threads; i++)
+				pd->evaluators[i] = fit_evaluator_alloc(data, f);
+		} catch (mu::ParserError &) {
+			// the serial evaluation reports the error
+			parallel_fit_free(pd);
+			return 0;
+		}
+	}
+	return pd;
+#else
+	Q_UNUSED(data) Q_UNUSED(f) Q_UNUSED(df) Q_UNUSED(fdf) Q_UNUSED(d)
+	return 0;
+#endif
+}
+
+void parallel_fit_free(ParallelFitData *pd)
+{
+	if (!pd)
+		return;
+
+	if (pd->evaluators){
+		for (int i = 0; i < pd->threads; i++)
+			fit_evaluator_free(pd->evaluators[i]);
+		delete[] pd->evaluators;
+	}
+	delete pd;
+}
+
+enum ParallelFitMode{Residuals, Jacobian, ResidualsAndJacobian, ChiSquare};
+
+//! A call of the fit model evaluated in parallel
+struct ParallelFitCall {
+	ParallelFitData *pd;
+	ParallelFitMode mode;
+	const gsl_vector *x;
+	gsl_vector *f;
+	gsl_matrix *J;
+	//! Sums of squares of the blocks
+	double *chi2;
+	//! Error status of the threads
+	int *status;
+};
+
+//! Evaluates the blocks thread, thread + threads, thread + 2*threads, ...
+static void evaluateFitBlocks(ParallelFitCall *call, int thread)
+{
+	ParallelFitData *pd = call->pd;
+	struct FitData *data = pd->data;
+	int p = data->p;
+	int status = GSL_SUCCESS;
+	for (int b = thread; b < pd->blocks && status == GSL_SUCCESS; b += pd->threads){
+		int start = b*parallel_fit_block;
+		int size = qMin(parallel_fit_block, data->n - start);
+		struct FitData block = {size, p, data->X + start, data->Y + start, data->sigma + start, data->fitter,
+								pd->evaluators ? pd->evaluators[thread] : 0};
+		switch(call->mode){
+			case Residuals:
+			{
+				gsl_vector_view f = gsl_vector_subvector(call->f, start, size);
+				status = pd->f(call->x, &block, &f.vector);
+				break;
+			}
+			case Jacobian:
+			{
+				gsl_matrix_view J = gsl_matrix_submatrix(call->J, start, 0, size, p);
+				status = pd->df(call->x, &block, &J.matrix);
+				break;
+			}
+			case ResidualsAndJacobian:
+			{
+				gsl_vector_view f = gsl_vector_subvector(call->f, start, size);
+				gsl_matrix_view J = gsl_matrix_submatrix(call->J, start, 0, size, p);
+				status = pd->fdf(call->x, &block, &f.vector, &J.matrix);
+				break;
+			}
+			case ChiSquare:
+				call->chi2[b] = pd->d(call->x, &block);
+				break;
+		}
+	}
+	call->status[thread] = status;
+}
+
+static int evaluateFitInParallel(ParallelFitCall *call)
+{
+	int threads = call->pd->threads;
+	QVector<int> status(threads, GSL_SUCCESS);
+	call->status = status.data();
+
+#if QT_VERSION >= 0x040400
+	QList<QFuture<void> > futures;
+	for (int i = 1; i < threads; i++)
+		futures << QtConcurrent::run(evaluateFitBlocks, call, i);
+	// the calling thread evaluates the first blocks, so that it reports the parser errors
+	evaluateFitBlocks(call, 0);
+	for (int i = 0; i < futures.size(); i++)
+		futures[i].waitForFinished();
+#else
+	for (int i = 0; i < threads; i++)
+		evaluateFitBlocks(call, i);
+#endif
+
+	for (int i = 0; i < threads; i++){
+		if (status[i] != GSL_SUCCESS)
+			return status[i];
+	}
+	return GSL_SUCCESS;
+}
+
+int parallel_fit_f(const gsl_vector * x, void *params, gsl_vector * f)
+{
+	ParallelFitCall call = {(ParallelFitData *)params, Residuals, x, f, 0, 0, 0};
+	return evaluateFitInParallel(&call);
+}
+
+int parallel_fit_df(const gsl_vector * x, void *params, gsl_matrix * J)
+{
+	ParallelFitCall call = {(ParallelFitData *)params, Jacobian, x, 0, J, 0, 0};
+	return evaluateFitInParallel(&call);
+}
+
+int parallel_fit_fdf(const gsl_vector * x, void *params, gsl_vector * f, gsl_matrix * J)
+{
+	ParallelFitCall call = {(ParallelFitData *)params, ResidualsAndJacobian, x, f, J, 0, 0};
+	return evaluateFitInParallel(&call);
+}
+
+double parallel_fit_d(const gsl_vector * x, void *params)
+{
+	ParallelFitData *pd = (ParallelFitData *)params;
+	QVector<double> chi2(pd->blocks, 0.0);
+	ParallelFitCall call = {pd, ChiSquare, x, 0, 0, chi2.data(), 0};
+	evaluateFitInParallel(&call);
+
+	double val = 0.0;
+	for (int b = 0; b < pd->blocks; b++)
+		val += chi2[b];
+	return val;
+}
+
+/*****************************************************************************
+ * Streaming polynomial least squares
+ *****************************************************************************/
+
+//! Number of data points accumulated in a triangular factor by a thread
+static const int polynomial_fit_block = 65536;
+
+//! Upper triangular factor R and right hand side z of the least squares problem of a block of data
+struct PolynomialFitBlock {
+	int p;
+	QVector<double> R;
+	QVector<double> z;
+	double chi2;
+
+	void init(int size)
+	{
+		p = size;
+		R = QVector<double>(p*p, 0.0);
+		z = QVector<double>(p, 0.0);
+		chi2 = 0.0;
+	}
+
+	//! Rotates the row into R, the row is overwritten
+	void addRow(double *row, double y)
+	{
+		for (int k = 0; k < p; k++){
+			double b = row[k];
+			if (b == 0.0)
+				continue;
+
+			double *Rk = R.data() + k*p;
+			double a = Rk[k];
+			if (a == 0.0){// empty row of R
+				for (int j = k; j < p; j++)
+					Rk[j] = row[j];
+				z[k] = y;
+				return;
+			}
+
+			double h = hypot(a, b);
+			double cs = a/h, sn = b/h;
+			Rk[k] = h;
+			for (int j = k + 1; j < p; j++){
+				double r = Rk[j];
+				Rk[j] = cs*r + sn*row[j];
+				row[j] = cs*row[j] - sn*r;
+			}
+			double zk = z[k];
+			z[k] = cs*zk + sn*y;
+			y = cs*y - sn*zk;
+		}
+		chi2 += y*y;
+	}
+
+	void merge(const PolynomialFitBlock& block)
+	{
+		QVector<double> row(p);
+		for (int k = 0; k < p; k++){
+			for (int j = 0; j < p; j++)
+				row[j] = block.R[k*p + j];
+			addRow(row.data(), block.z[k]);
+		}
+		chi2 += block.chi2;
+	}
+};
+
+//! Data shared by the threads of a polynomial fit
+struct PolynomialFitCall {
+	const double *X, *Y, *w;
+	int n;
+	//! Center and half width of the x range
+	double center, scale;
+	int threads;
+	QVector<PolynomialFitBlock> *blocks;
+};
+
+//! Accumulates the blocks thread, thread + threads, thread + 2*threads, ...
+static void accumulatePolynomialBlocks(PolynomialFitCall *call, int thread)
+{
+	QVector<double> row;
+	for (int b = thread; b < call->blocks->size(); b += call->threads){
+		PolynomialFitBlock& block = (*call->blocks)[b];
+		int p = block.p;
+		row.resize(p);
+		int end = qMin(call->n, (b + 1)*polynomial_fit_block);
+		for (int i = b*polynomial_fit_block; i < end; i++){
+			double sw = call->w ? sqrt(call->w[i]) : 1.0;
+			// Chebyshev polynomials of the scaled abscissa
+			double t = (call->X[i] - call->center)/call->scale;
+			row[0] = sw;
+			if (p > 1)
+				row[1] = sw*t;
+			for (int j = 2; j < p; j++)
+				row[j] = 2*t*row[j - 1] - row[j - 2];
+			block.addRow(row.data(), sw*call->Y[i]);
+		}
+	}
+}
+
+int polynomial_fit(const double *X, const double *Y, const double *w, int n, int p, double *c, gsl_matrix *cov, double *chi2)
+{
+	double xmin = X[0], xmax = X[0];
+	for (int i = 1; i < n; i++){
+		if (X[i] < xmin)
+			xmin = X[i];
+		else if (X[i] > xmax)
+			xmax = X[i];
+	}
+	if (xmin == xmax)
+		return GSL_ESING;
+
+	int count = (n + polynomial_fit_block - 1)/polynomial_fit_block;
+	QVector<PolynomialFitBlock> blocks(count);
+	for (int b = 0; b < count; b++)
+		blocks[b].init(p);
+
+	int threads = 1;
+#if QT_VERSION >= 0x040400
+	threads = qMax(1, qMin(QThread::idealThreadCount(), count));
+#endif
+	PolynomialFitCall call = {X, Y, w, n, 0.5*(xmin + xmax), 0.5*(xmax - xmin), threads, &blocks};
+#if QT_VERSION >= 0x040400
+	QList<QFuture<void> > futures;
+	for (int i = 1; i < threads; i++)
+		futures << QtConcurrent::run(accumulatePolynomialBlocks, &call, i);
+	accumulatePolynomialBlocks(&call, 0);
+	for (int i = 0; i < futures.size(); i++)
+		futures[i].waitForFinished();
+#else
+	accumulatePolynomialBlocks(&call, 0);
+#endif
+
+	// the blocks are always merged in the same order
+	PolynomialFitBlock& qr = blocks[0];
+	for (int b = 1; b < count; b++)
+		qr.merge(blocks[b]);
+
+	const double *R = qr.R.constData();
+	double rmax = 0.0;
+	for (int k = 0; k < p; k++)
+		rmax = qMax(rmax, fabs(R[k*p + k]));
+	for (int k = 0; k < p; k++){
+		if (fabs(R[k*p + k]) <= p*GSL_DBL_EPSILON*rmax)
+			return GSL_ESING;
+	}
+
+	// coefficients and covariance in the Chebyshev basis: R a = z, cov = R^-1 R^-T
+	QVector<double> a(p), Rinv(p*p, 0.0);
+	for (int k = p - 1; k >= 0; k--){
+		double sum = qr.z[k];
+		for (int j = k + 1; j < p; j++)
+			sum -= R[k*p + j]*a[j];
+		a[k] = sum/R[k*p + k];
+	}
+	for (int j = 0; j < p; j++){
+		Rinv[j*p + j] = 1.0/R[j*p + j];
+		for (int k = j - 1; k >= 0; k--){
+			double sum = 0.0;
+			for (int i = k + 1; i <= j; i++)
+				sum -= R[k*p + i]*Rinv[i*p + j];
+			Rinv[k*p + j] = sum/R[k*p + k];
+		}
+	}
+
+	// M(k, j) is the coefficient of x^j in the Chebyshev polynomial T_k((x - center)/scale)
+	QVector<double> M(p*p, 0.0);
+	double t0 = -call.center/call.scale, t1 = 1.0/call.scale;
+	M[0] = 1.0;
+	if (p > 1){
+		M[p] = t0;
+		M[p + 1] = t1;
+	}
+	for (int k = 2; k < p; k++){
+		for (int j = 0; j <= k; j++){
+			double v = 2*t0*M[(k - 1)*p + j] - M[(k - 2)*p + j];
+			if (j > 0)
+				v += 2*t1*M[(k - 1)*p + j - 1];
+			M[k*p + j] = v;
+		}
+	}
+
+	for (int j = 0; j < p; j++){
+		double sum = 0.0;
+		for (int k = j; k < p; k++)
+			sum += a[k]*M[k*p + j];
+		c[j] = sum;
+	}
+
+	// B = M^T R^-1, cov = B B^T
+	QVector<double> B(p*p, 0.0);
+	for (int i = 0; i < p; i++){
+		for (int j = 0; j < p; j++){
+			double sum = 0.0;
+			for (int k = i; k <= j; k++)
+				sum += M[k*p + i]*Rinv[k*p + j];
+			B[i*p + j] = sum;
+		}
+	}
+	double s2 = (!w && n > p) ? qr.chi2/(n - p) : 1.0;
+	for (int i = 0; i < p; i++){
+		for (int j = 0; j <= i; j++){
+			double sum = 0.0;
+			for (int k = 0; k < p; k++)
+				sum += B[i*p + k]*B[j*p + k];
+			gsl_matrix_set(cov, i, j, s2*sum);
+			gsl_matrix_set(cov, j, i, s2*sum);
+		}
+	}
+
+	*chi2 = qr.chi2;
+	return GSL_SUCCESS;
+}
+
+/*****************************************************************************
+ * Robust fits
+ *****************************************************************************/
+
+//! Number of data points processed at once by a thread
+static const int robust_fit_block = 65536;
+
+//! Runs f(call, thread) for the threads of the pool, the calling thread being the first one
+template<class Call> static void runRobustBlocks(void (*f)(Call *, int), Call *call)
+{
+#if QT_VERSION >= 0x040400
+	QList<QFuture<void> > futures;
+	for (int i = 1; i < call->threads; i++)
+		futures << QtConcurrent::run(f, call, i);
+	f(call, 0);
+	for (int i = 0; i < futures.size(); i++)
+		futures[i].waitForFinished();
+#else
+	f(call, 0);
+#endif
+}
+
+static int robustThreads(int n)
+{
+	int threads = 1;
+#if QT_VERSION >= 0x040400
+	threads = qMax(1, qMin(QThread::idealThreadCount(), (n + robust_fit_block - 1)/robust_fit_block));
+#endif
+	return threads;
+}
+
+//! Data shared by the threads computing the robust weights
+struct RobustWeightsCall {
+	Fit::RobustLoss loss;
+	//! Scale of the residuals multiplied by the tuning constant
+	double scale;
+	const double *r, *w;
+	double *rw;
+	int n;
+	int threads;
+};
+
+static void robustWeightsBlocks(RobustWeightsCall *call, int thread)
+{
+	int blocks = (call->n + robust_fit_block - 1)/robust_fit_block;
+	for (int b = thread; b < blocks; b += call->threads){
+		int end = qMin(call->n, (b + 1)*robust_fit_block);
+		for (int i = b*robust_fit_block; i < end; i++){
+			double u = fabs(call->r[i])/call->scale;
+			double psi = 1.0;// psi(u)/u
+			switch(call->loss){
+				case Fit::Huber:
+					if (u > 1.0)
+						psi = 1.0/u;
+					break;
+				case Fit::Cauchy:
+					psi = 1.0/(1.0 + u*u);
+					break;
+				case Fit::Tukey:// biweight
+					psi = (u < 1.0) ? (1.0 - u*u)*(1.0 - u*u) : 0.0;
+					break;
+				case Fit::LeastSquares:
+					break;
+			}
+			call->rw[i] = (call->w ? call->w[i] : 1.0)*psi;
+		}
+	}
+}
+
+double robust_fit_tuning(Fit::RobustLoss loss)
+{
+	// 95% efficiency for normally distributed errors
+	switch(loss){
+		case Fit::Huber:
+			return 1.345;
+		case Fit::Cauchy:
+			return 2.385;
+		case Fit::Tukey:
+			return 4.685;
+		case Fit::LeastSquares:
+			break;
+	}
+	return 0.0;
+}
+
+double robust_weights(Fit::RobustLoss loss, double tuning, const double *r, const double *w, double *rw, int n)
+{
+	// robust scale of the residuals: median absolute deviation, the points of null weight being ignored
+	QVector<double> a;
+	a.reserve(n);
+	for (int i = 0; i < n; i++){
+		if (!w || w[i] > 0.0)
+			a << fabs(r[i]);
+	}
+
+	double s = 0.0;
+	if (!a.isEmpty()){
+		double *m = a.data() + a.size()/2;
+		std::nth_element(a.data(), m, a.data() + a.size());
+		s = *m/0.6745;
+	}
+
+	if (tuning <= 0.0)
+		tuning = robust_fit_tuning(loss);
+	if (s == 0.0 || tuning <= 0.0 || loss == Fit::LeastSquares){
+		for (int i = 0; i < n; i++)
+			rw[i] = w ? w[i] : 1.0;
+		return s;
+	}
+
+	RobustWeightsCall call = {loss, tuning*s, r, w, rw, n, robustThreads(n)};
+	runRobustBlocks(robustWeightsBlocks, &call);
+	return s;
+}
+
+//! Data shared by the threads computing the residuals of a polynomial
+struct PolynomialResidualsCall {
+	const double *X, *Y, *w;
+	int n, p;
+	const double *c;
+	double *r;
+	int threads;
+};
+
+static void polynomialResidualsBlocks(PolynomialResidualsCall *call, int thread)
+{
+	int blocks = (call->n + robust_fit_block - 1)/robust_fit_block;
+	int p = call->p;
+	const double *c = call->c;
+	for (int b = thread; b < blocks; b += call->threads){
+		int end = qMin(call->n, (b + 1)*robust_fit_block);
+		for (int i = b*robust_fit_block; i < end; i++){
+			double x = call->X[i];
+			double y = c[p - 1];
+			for (int j = p - 2; j >= 0; j--)
+				y = y*x + c[j];
+			call->r[i] = (y - call->Y[i])*(call->w ? sqrt(call->w[i]) : 1.0);
+		}
+	}
+}
+
+void polynomial_residuals(const double *X, const double *Y, const double *w, int n, int p, const double *c, double *r)
+{
+	PolynomialResidualsCall call = {X, Y, w, n, p, c, r, robustThreads(n)};
+	runRobustBlocks(polynomialResidualsBlocks, &call);
+}
@@ -36,7 +36,7 @@
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_matrix.h>
 
-class Fit;
+#include "Fit.h"
 	
 //! Structure for fitting data
 struct FitData {
@@ -46,8 +46,59 @@ struct FitData {
   double * Y; // the data to be fitted (ordinates)
   double * sigma; // the weighting data
   Fit *fitter; //pointer to the fitter object (used only for the NonLinearFit class)
+  void *evaluator; // evaluator of the model used by the current thread (used only for the NonLinearFit class)
 };
 
+typedef int (*fit_f)(const gsl_vector *, void *, gsl_vector *);
+typedef int (*fit_df)(const gsl_vector *, void *, gsl_matrix *);
+typedef int (*fit_fdf)(const gsl_vector *, void *, gsl_vector *, gsl_matrix *);
+typedef double (*fit_d)(const gsl_vector *, void *);
+
+/*! Creates the evaluator of the model f to be stored in the evaluator field of the FitData used by a thread,
+ * returns NULL if the model doesn't need one. Must be called from the GUI thread.
+ * Throws mu::ParserError if the formula of a user defined model is not valid.
+ */
+void* fit_evaluator_alloc(struct FitData *data, fit_f f);
+void fit_evaluator_free(void *evaluator);
+
+//! Data used to evaluate a fit model in parallel over blocks of data points
+struct ParallelFitData;
+
+/*! Prepares the parallel evaluation of a fit model. The returned pointer must be passed as the params
+ * argument of the parallel_fit_* functions, which call the model functions f, df, fdf and d for the blocks
+ * of data points of data using a pool of threads. Returns NULL if the data set is too small for a parallel
+ * evaluation to be worth it or if the model is not thread safe (see Fit::isThreadSafe()).
+ */
+ParallelFitData* parallel_fit_alloc(struct FitData *data, fit_f f, fit_df df, fit_fdf fdf, fit_d d);
+void parallel_fit_free(ParallelFitData *pd);
+
+int parallel_fit_f(const gsl_vector * x, void *params, gsl_vector * f);
+int parallel_fit_df(const gsl_vector * x, void *params, gsl_matrix * J);
+int parallel_fit_fdf(const gsl_vector * x, void *params, gsl_vector * f, gsl_matrix * J);
+double parallel_fit_d(const gsl_vector * x, void *params);
+
+/*! Least squares fit of a polynomial with p coefficients c (c[0] + c[1]*x + ... + c[p-1]*x^(p-1)) to n data points.
+ * The data points are read in a single pass, in blocks processed by a pool of threads, without building the
+ * design matrix: each block is accumulated in a triangular factor using Givens rotations, the polynomial being
+ * expressed in the Chebyshev basis of the x range, and the factors of the blocks are merged at the end.
+ * If w is not NULL the points are weighted by w and cov is (X^T W X)^-1, otherwise cov is scaled by chi2/(n - p),
+ * as for gsl_multifit_linear. Returns GSL_ESING if the problem is rank deficient.
+ */
+int polynomial_fit(const double *X, const double *Y, const double *w, int n, int p, double *c, gsl_matrix *cov, double *chi2);
+
+//! Weighted residuals (P(X) - Y)*sqrt(w) of the polynomial with p coefficients c, computed by a pool of threads. w may be NULL.
+void polynomial_residuals(const double *X, const double *Y, const double *w, int n, int p, const double *c, double *r);
+
+//! Default tuning constant of the robust loss function
+double robust_fit_tuning(Fit::RobustLoss loss);
+
+/*! Computes the weights rw of the next pass of an iteratively reweighted least squares fit with the robust
+ * loss function, from the residuals r weighted by sqrt(w) and the initial weights w
+ * (which may be NULL). The residuals are scaled by their median absolute deviation and by the tuning constant
+ * (the default one if tuning <= 0). The weights are computed by a pool of threads. Returns the scale of the residuals.
+ */
+double robust_weights(Fit::RobustLoss loss, double tuning, const double *r, const double *w, double *rw, int n);
+
 int expd3_fdf (const gsl_vector * x, void *params, gsl_vector * f, gsl_matrix * J);
 int expd3_df (const gsl_vector * x, void *params, gsl_matrix * J);
 int expd3_f (const gsl_vector * x, void *params, gsl_vector * f);
@@ -39,6 +39,7 @@ Description          : QtiPlot's main window
 #include "OpenProjectDialog.h"
 #include "CustomActionDialog.h"
 #include "MdiSubWindow.h"
+#include "RemoteControlServer.h"
 
 #include <SelectionMoveResizer.h>
 #include <SymbolBox.h>
@@ -172,6 +173,8 @@ using namespace std;
 #include <QTextStream>
 #include <QVarLengthArray>
 #include <QList>
+#include <QSet>
+#include <QTemporaryFile>
 #include <QUrl>
 #include <QAssistantClient>
 #include <QFontComboBox>
@@ -187,6 +190,10 @@ using namespace std;
 #if QT_VERSION >= 0x040500
 #include <QTextDocumentWriter>
 #endif
+#if QT_VERSION >= 0x040400
+#include <QtConcurrentRun>
+#include <QFuture>
+#endif
 #include <QToolButton>
 #ifdef Q_OS_WIN
 	#include <QAxObject>
@@ -337,6 +344,7 @@ void ApplicationWindow::init(bool factorySettings)
 	hiddenWindows = new QList<QWidget*>();
 
 	scriptWindow = 0;
+	d_remote_server = 0;
     d_text_editor = NULL;
 
 	d_default_2D_grid = new Grid();
@@ -737,6 +745,7 @@ void ApplicationWindow::setDefaultOptions()
 	peakCurvesColor = Qt::green;
 	fit_scale_errors = true;
 	d_2_linear_fit_points = true;
+	d_compile_fit_models = true;
 	d_multi_peak_messages = true;
 
 	columnSeparator = "\t";
@@ -4890,6 +4899,8 @@ ApplicationWindow* ApplicationWindow::openProject(const QString& fn, bool factor
 	item->setText(0, fi.baseName());
 	item->folder()->setObjectName(fi.baseName());
 
+	d_loaded_column_blocks.clear();
+
 	//process tables and matrix information
 	while (!t.atEnd() && !progress.wasCanceled()){
 		s = t.readLine();
@@ -4959,6 +4970,7 @@ ApplicationWindow* ApplicationWindow::openProject(const QString& fn, bool factor
 			app->goToParentFolder();
 	}
 	f.close();
+	d_loaded_column_blocks.clear();
 
 	if (progress.wasCanceled()){
 		app->saved = true;
@@ -4969,7 +4981,6 @@ ApplicationWindow* ApplicationWindow::openProject(const QString& fn, bool factor
 	//process the rest
 	f.open(QIODevice::ReadOnly);
 
-	MultiLayer *plot=0;
 	while (!t.atEnd() && !progress.wasCanceled()){
 		s = t.readLine();
 		if  (s.left(8) == "<folder>"){
@@ -4980,73 +4991,7 @@ ApplicationWindow* ApplicationWindow::openProject(const QString& fn, bool factor
 			title = titleBase + QString::number(++aux) + "/" + QString::number(widgets);
 			progress.setLabelText(title);
 
-			s = t.readLine();
-			QStringList graph = s.split("\t");
-			QString caption = graph[0];
-
-			plot = app->multilayerPlot(caption, 0,  graph[2].toInt(), graph[1].toInt());
-			app->setListViewDate(caption, graph[3]);
-			plot->setBirthDate(graph[3]);
-
-			restoreWindowGeometry(plot, t.readLine());
-			plot->blockSignals(true);
-
-			if (d_file_version > 71){
-				QStringList lst = t.readLine().split("\t");
-				if (lst.size() > 1)
-					plot->setWindowLabel(lst[1]);
-				if (lst.size() > 2)
-					plot->setCaptionPolicy((MdiSubWindow::CaptionPolicy)lst[2].toInt());
-			}
-			if (d_file_version > 83){
-				QStringList lst=t.readLine().split("\t", QString::SkipEmptyParts);
-				if (lst.size() >= 5)
-					plot->setMargins(lst[1].toInt(),lst[2].toInt(),lst[3].toInt(),lst[4].toInt());
-				lst=t.readLine().split("\t", QString::SkipEmptyParts);
-				if (lst.size() >= 3)
-					plot->setSpacing(lst[1].toInt(),lst[2].toInt());
-				lst=t.readLine().split("\t", QString::SkipEmptyParts);
-				if (lst.size() >= 3)
-					plot->setLayerCanvasSize(lst[1].toInt(),lst[2].toInt());
-				lst=t.readLine().split("\t", QString::SkipEmptyParts);
-				if (lst.size() >= 3)
-					plot->setAlignement(lst[1].toInt(),lst[2].toInt());
-			}
-
-			while ( s != "</multiLayer>" ){//open layers
-				s = t.readLine();
-				if (s.contains("<waterfall>")){
-					QStringList lst = s.trimmed().remove("<waterfall>").remove("</waterfall>").split(",");
-					Graph *ag = plot->activeLayer();
-					if (ag && lst.size() >= 2){
-						ag->setWaterfallOffset(lst[0].toDouble(), lst[1].toDouble());
-						if (lst.size() >= 3)
-							ag->setWaterfallSideLines(lst[2].toInt());
-					}
-					plot->setWaterfallLayout();
-				}
-
-				if (s.left(7) == "<graph>"){
-					list.clear();
-					while ( s != "</graph>" ){
-						s = t.readLine();
-						list<<s;
-					}
-					openGraph(app, plot, list);
-				}
-
-				if (s.contains("<LinkXAxes>"))
-					plot->linkXLayerAxes(s.trimmed().remove("<LinkXAxes>").remove("</LinkXAxes>").toInt());
-				else if (s.contains("<AlignPolicy>"))
-					plot->setAlignPolicy((MultiLayer::AlignPolicy)s.trimmed().remove("<AlignPolicy>").remove("</AlignPolicy>").toInt());
-				else if (s.contains("<CommonAxes>"))
-					plot->setCommonAxesLayout(s.trimmed().remove("<CommonAxes>").remove("</CommonAxes>").toInt());
-				else if (s.contains("<ScaleLayers>"))
-					plot->setScaleLayersOnResize(s.trimmed().remove("<ScaleLayers>").remove("</ScaleLayers>").toInt());
-			}
-			if (plot->status() == MdiSubWindow::Minimized)
-				plot->showMinimized();
-			plot->blockSignals(false);
+			openMultiLayer(app, t);
 			progress.setValue(aux);
 		} else if  (s == "<SurfacePlot>") {//process 3D plots information
 			list.clear();
@@ -5105,6 +5050,78 @@ ApplicationWindow* ApplicationWindow::openProject(const QString& fn, bool factor
 	return app;
 }
 
+MultiLayer* ApplicationWindow::openMultiLayer(ApplicationWindow* app, QTextStream& t)
+{
+	QString s = t.readLine();
+	QStringList graph = s.split("\t");
+	QString caption = graph[0];
+
+	MultiLayer *plot = app->multilayerPlot(caption, 0,  graph[2].toInt(), graph[1].toInt());
+	app->setListViewDate(caption, graph[3]);
+	plot->setBirthDate(graph[3]);
+
+	restoreWindowGeometry(plot, t.readLine());
+	plot->blockSignals(true);
+
+	if (d_file_version > 71){
+		QStringList lst = t.readLine().split("\t");
+		if (lst.size() > 1)
+			plot->setWindowLabel(lst[1]);
+		if (lst.size() > 2)
+			plot->setCaptionPolicy((MdiSubWindow::CaptionPolicy)lst[2].toInt());
+	}
+	if (d_file_version > 83){
+		QStringList lst=t.readLine().split("\t", QString::SkipEmptyParts);
+		if (lst.size() >= 5)
+			plot->setMargins(lst[1].toInt(),lst[2].toInt(),lst[3].toInt(),lst[4].toInt());
+		lst=t.readLine().split("\t", QString::SkipEmptyParts);
+		if (lst.size() >= 3)
+			plot->setSpacing(lst[1].toInt(),lst[2].toInt());
+		lst=t.readLine().split("\t", QString::SkipEmptyParts);
+		if (lst.size() >= 3)
+			plot->setLayerCanvasSize(lst[1].toInt(),lst[2].toInt());
+		lst=t.readLine().split("\t", QString::SkipEmptyParts);
+		if (lst.size() >= 3)
+			plot->setAlignement(lst[1].toInt(),lst[2].toInt());
+	}
+
+	while (!t.atEnd() && s != "</multiLayer>"){//open layers
+		s = t.readLine();
+		if (s.contains("<waterfall>")){
+			QStringList lst = s.trimmed().remove("<waterfall>").remove("</waterfall>").split(",");
+			Graph *ag = plot->activeLayer();
+			if (ag && lst.size() >= 2){
+				ag->setWaterfallOffset(lst[0].toDouble(), lst[1].toDouble());
+				if (lst.size() >= 3)
+					ag->setWaterfallSideLines(lst[2].toInt());
+			}
+			plot->setWaterfallLayout();
+		}
+
+		if (s.left(7) == "<graph>"){
+			QStringList list;
+			while (!t.atEnd() && s != "</graph>"){
+				s = t.readLine();
+				list<<s;
+			}
+			openGraph(app, plot, list);
+		}
+
+		if (s.contains("<LinkXAxes>"))
+			plot->linkXLayerAxes(s.trimmed().remove("<LinkXAxes>").remove("</LinkXAxes>").toInt());
+		else if (s.contains("<AlignPolicy>"))
+			plot->setAlignPolicy((MultiLayer::AlignPolicy)s.trimmed().remove("<AlignPolicy>").remove("</AlignPolicy>").toInt());
+		else if (s.contains("<CommonAxes>"))
+			plot->setCommonAxesLayout(s.trimmed().remove("<CommonAxes>").remove("</CommonAxes>").toInt());
+		else if (s.contains("<ScaleLayers>"))
+			plot->setScaleLayersOnResize(s.trimmed().remove("<ScaleLayers>").remove("</ScaleLayers>").toInt());
+	}
+	if (plot->status() == MdiSubWindow::Minimized)
+		plot->showMinimized();
+	plot->blockSignals(false);
+	return plot;
+}
+
 void ApplicationWindow::executeNotes()
 {
 	QList<MdiSubWindow *> lst = projectFolder()->windowsList();
@@ -5734,6 +5751,7 @@ void ApplicationWindow::readSettings()
 	peakCurvesColor = QColor(settings.value("/PeakColor", peakCurvesColor.name()).toString());//green color
 	fit_scale_errors = settings.value("/ScaleErrors", true).toBool();
 	d_2_linear_fit_points = settings.value("/TwoPointsLinearFit", true).toBool();
+	d_compile_fit_models = settings.value("/CompileModels", true).toBool();
 	d_multi_peak_messages = settings.value("/MultiPeakToolMsg", d_multi_peak_messages).toBool();
 	settings.endGroup(); // Fitting
 
@@ -6230,6 +6248,7 @@ void ApplicationWindow::saveSettings()
 	settings.setValue("/PeakColor", peakCurvesColor.name());
 	settings.setValue("/ScaleErrors", fit_scale_errors);
 	settings.setValue("/TwoPointsLinearFit", d_2_linear_fit_points);
+	settings.setValue("/CompileModels", d_compile_fit_models);
 	settings.setValue("/MultiPeakToolMsg", d_multi_peak_messages);
 	settings.endGroup(); // Fitting
 
@@ -6912,7 +6931,7 @@ bool ApplicationWindow::saveWindow(MdiSubWindow *w, const QString& fn, bool comp
 
 	QTextStream t( &f );
 	t.setEncoding(QTextStream::UnicodeUTF8);
-	t << "QtiPlot " + QString::number(maj_version) + "." + QString::number(min_version) + "." + QString::number(patch_version) + " project file\n";
+	t << "QtiPlot " + QString(project_file_version) + " project file\n";
 	t << "<scripting-lang>\t" + QString(scriptEnv->name()) + "\n";
 
 	int windows = 1;
@@ -6932,6 +6951,7 @@ bool ApplicationWindow::saveWindow(MdiSubWindow *w, const QString& fn, bool comp
 	if (!f.isOpen())
 		f.open(QIODevice::Append);
 
+	d_saved_column_blocks.clear();
 	foreach(QString s, tbls){
 		Table *t = table(s);
 		if (t)
@@ -6949,6 +6969,7 @@ bool ApplicationWindow::saveWindow(MdiSubWindow *w, const QString& fn, bool comp
 
 	w->save(fn, windowGeometryInfo(w));
 	f.close();
+	d_saved_column_blocks.clear();
 
 	if (compress)
 		file_compress(fn.toAscii().data(), "wb9");
@@ -12207,6 +12228,7 @@ Table* ApplicationWindow::openTable(ApplicationWindow* app, const QStringList &f
 	app->setListViewDate(caption, list[3]);
 	w->setBirthDate(list[3]);
 
+	QStringList colHashes, sharedCols;
 	for (line++; line!=flist.end(); line++){
 		QStringList fields = (*line).split("\t");
 		if (fields[0] == "geometry" || fields[0] == "tgeometry") {
@@ -12252,6 +12274,12 @@ Table* ApplicationWindow::openTable(ApplicationWindow* app, const QStringList &f
 			fields.pop_front();
 			for (int i=0; i < w->numCols(); i++)
 				w->hideColumn(i, fields[i] == "1");
+		} else if (fields[0] == "ColumnHash" && d_file_version >= 99) {
+			fields.pop_front();
+			colHashes = fields;
+		} else if (fields[0] == "SharedColumn" && d_file_version >= 99) {
+			fields.pop_front();
+			sharedCols = fields;
 		} else // <data> or values
 			break;
 	}
@@ -12280,6 +12308,30 @@ Table* ApplicationWindow::openTable(ApplicationWindow* app, const QStringList &f
 		}
 		QApplication::processEvents(QEventLoop::ExcludeUserInput);
 	}
+
+	for (int col = 0; col < cols && col < colHashes.size(); col++){
+		QString key = colHashes[col];
+		if (key.isEmpty())
+			continue;
+
+		if (col < sharedCols.size() && !sharedCols[col].isEmpty()){//data block already read from the source table
+			if (!d_loaded_column_blocks.contains(key))
+				continue;
+
+			QStringList block = d_loaded_column_blocks.value(key);
+			for (int row = 0; row < block.size() && row < rows; row++){
+				QString cell = block[row];
+				if (cell.isEmpty())
+					continue;
+
+				if (w->columnType(col) == Table::Numeric)
+					w->setCell(row, col, cell.toDouble());
+				else
+					w->setText(row, col, cell);
+			}
+		} else if (!d_loaded_column_blocks.contains(key))
+			d_loaded_column_blocks.insert(key, w->columnBlock(col));
+	}
     QApplication::restoreOverrideCursor();
 
 	w->table()->blockSignals(false);
@@ -16072,6 +16124,7 @@ void ApplicationWindow::parseCommandLineArguments(const QStringList& args)
 	bool noGui = false;
 	bool default_settings = false;
 	bool console = false;
+	QString remote_name;
 	foreach(str, args){
 		if( (str == "-a" || str == "--about") ||
 				(str == "-m" || str == "--manual") ){
@@ -16110,7 +16163,11 @@ void ApplicationWindow::parseCommandLineArguments(const QStringList& args)
 			s += "-m " + tr("or") + " --manual: " + tr("show QtiPlot manual in a standalone window") + "\n";
 			s += "-v " + tr("or") + " --version: " + tr("print QtiPlot version and release date") + "\n";
 			s += "-x " + tr("or") + " --execute: " + tr("execute the script file given as argument") + "\n";
-			s += "-X: " + tr("execute the script file given as argument without displying the user interface. Warning: 2D plots are not correctly handled in this functioning mode!") + "\n\n";
+			s += "-X: " + tr("execute the script file given as argument without displying the user interface. Warning: 2D plots are not correctly handled in this functioning mode!") + "\n";
+			s += "-b[=N] " + tr("or") + " --batch[=N] [--output=" + tr("folder") + "] " + tr("script") + " " + tr("files") + ": ";
+			s += tr("execute the script once for each file using N headless processes") + "\n";
+			s += "-r[=" + tr("name") + "] " + tr("or") + " --remote-control[=" + tr("name") + "]: ";
+			s += tr("accept commands from other processes on the local socket 'name' (default: qtiplot)") + "\n\n";
 			s += "'" + tr("file") + "_" + tr("name") + "' " + tr("can be any .qti, qti.gz, .ods, .opj, .ogm, .ogw, .ogg, .py, .xls or ASCII file") + "\n";
 			#ifdef Q_OS_WIN
                 hide();
@@ -16133,6 +16190,11 @@ void ApplicationWindow::parseCommandLineArguments(const QStringList& args)
 			exec = true;
 		else if (str.startsWith("-X"))
 			noGui = true;
+		else if (str.startsWith("--remote-control") || str.startsWith("-r")){
+			int index = str.indexOf('=');
+			remote_name = index > 0 ? str.mid(index + 1) : QString("qtiplot");
+			startRemoteControl(remote_name);
+		}
 		else if (str.startsWith("-") || str.startsWith("--")){
 			QMessageBox::critical(this, tr("QtiPlot - Error"),
 			tr("<b> %1 </b> unknown command line option!").arg(str) + "\n" + tr("Type %1 to see the list of the valid options.").arg("'qtiplot -h'"));
@@ -16148,6 +16210,10 @@ void ApplicationWindow::parseCommandLineArguments(const QStringList& args)
 			ApplicationWindow *app = open(recentProjects[0], default_settings);
 			if (app && app != this){
 				savedProject();
+				if (!remote_name.isEmpty()){
+					stopRemoteControl();
+					app->startRemoteControl(remote_name);
+				}
 				close();
 			}
 		}
@@ -16173,8 +16239,13 @@ void ApplicationWindow::parseCommandLineArguments(const QStringList& args)
 			loadScript(file_name, exec, noGui);
 		else {
 			ApplicationWindow *app = open(file_name, default_settings);
-			if (app && app != this)
+			if (app && app != this){
+				if (!remote_name.isEmpty()){
+					stopRemoteControl();
+					app->startRemoteControl(remote_name);
+				}
 				close();
+			}
 		}
 	}
 }
@@ -16378,6 +16449,8 @@ Folder* ApplicationWindow::appendProject(const QString& fn, Folder* parentFolder
 		if (d_file_version < 73)
 			t.readLine();
 
+		d_loaded_column_blocks.clear();
+
 		//process tables and matrix information
 		while ( !t.atEnd()){
 			s = t.readLine();
@@ -16427,6 +16500,7 @@ Folder* ApplicationWindow::appendProject(const QString& fn, Folder* parentFolder
 				goToParentFolder();
 		}
 		f.close();
+		d_loaded_column_blocks.clear();
 
 		//process the rest
 		f.open(QIODevice::ReadOnly);
@@ -16584,14 +16658,18 @@ void ApplicationWindow::saveFolder(Folder *folder, const QString& fn, bool compr
 
 	QTextStream t( &f );
 	t.setEncoding(QTextStream::UnicodeUTF8);
-	t << "QtiPlot " + QString::number(maj_version) + "." + QString::number(min_version) + "."+
-			QString::number(patch_version) + " project file\n";
+	t << "QtiPlot " + QString(project_file_version) + " project file\n";
 	t << "<scripting-lang>\t" + QString(scriptEnv->name()) + "\n";
 	t << "<windows>\t" + QString::number(windows) + "\n";
 	f.close();
 
-	foreach(MdiSubWindow *w, lst)
+	d_saved_column_blocks.clear();
+	QStringList index;
+	foreach(MdiSubWindow *w, lst){
+		qint64 offset = QFile(fn).size();
 		w->save(fn, windowGeometryInfo(w));
+		index << projectIndexEntry(w, folder, offset, QFile(fn).size() - offset);
+	}
 
 	initial_depth = folder->depth();
 	dir = folder->folderBelow();
@@ -16608,8 +16686,11 @@ void ApplicationWindow::saveFolder(Folder *folder, const QString& fn, bool compr
 		f.close();
 
 		lst = dir->windowsList();
-		foreach(MdiSubWindow *w, lst)
+		foreach(MdiSubWindow *w, lst){
+			qint64 offset = QFile(fn).size();
 			w->save(fn, windowGeometryInfo(w));
+			index << projectIndexEntry(w, dir, offset, QFile(fn).size() - offset);
+		}
 
 		if (!f.isOpen())
 			f.open(QIODevice::Append);
@@ -16641,9 +16722,18 @@ void ApplicationWindow::saveFolder(Folder *folder, const QString& fn, bool compr
 
 	t << "<open>" + QString::number(folder->folderListItem()->isOpen()) + "</open>\n";
 	if (!folder->logInfo().isEmpty())
-		t << "<log>\n" + folder->logInfo() + "</log>" ;
+		t << "<log>\n" + folder->logInfo() + "</log>\n" ;
+
+	//trailing index of the windows, allowing to read a single window without parsing the whole file
+	t.flush();
+	qint64 indexOffset = f.size();
+	t << "<index>\n";
+	foreach(QString entry, index)
+		t << entry + "\n";
+	t << "</index>\t" + QString::number(indexOffset) + "\n";
 
 	f.close();
+	d_saved_column_blocks.clear();
 
 	if (compress)
 		file_compress(fn.toAscii().data(), "wb9");
@@ -16651,6 +16741,309 @@ void ApplicationWindow::saveFolder(Folder *folder, const QString& fn, bool compr
 	QApplication::restoreOverrideCursor();
 }
 
+static void compressProjectFile(const QString& fn)
+{
+	file_compress(fn.toAscii().data(), "wb9");
+}
+
+int ApplicationWindow::generateProjects(const QString& templateFile, const QString& tableName,
+						const QStringList& dataFiles, const QString& outputDir, bool compress, QStringList *errors)
+{
+	//errors are returned to the caller: this function is meant for scripts and batch jobs
+	QStringList messages;
+	if (!errors)
+		errors = &messages;
+
+	if (!isProjectFile(templateFile)){
+		*errors << tr("The file %1 is not a QtiPlot project file!").arg(templateFile);
+		return 0;
+	}
+
+	//the layout is read only once, the data of the template table is then replaced for each output project
+	ApplicationWindow *app = open(templateFile, false, true);
+	if (!app || app == this){
+		*errors << tr("The file %1 could not be opened as a template project!").arg(templateFile);
+		return 0;
+	}
+	//the template project is only used to generate the files and is never shown
+	app->hide();
+
+	Table *t = app->projectFolder()->table(tableName, true);
+	if (!t){
+		*errors << tr("There is no table called %1 in project file %2!").arg(tableName).arg(templateFile);
+		app->saved = true;
+		app->close();
+		return 0;
+	}
+
+	QDir dir(outputDir);
+	if (!dir.exists() && !dir.mkpath(dir.absolutePath())){
+		*errors << tr("The folder %1 could not be created!").arg(outputDir);
+		app->saved = true;
+		app->close();
+		return 0;
+	}
+
+#if QT_VERSION >= 0x040400
+	QList<QFuture<void> > compressions;
+#endif
+	int projects = 0;
+	QSet<QString> outputFiles;
+	foreach(QString file, dataFiles){
+		if (!QFile::exists(file)){
+			*errors << tr("The data file %1 does not exist!").arg(file);
+			continue;
+		}
+
+		t->importASCII(file, app->columnSeparator, app->ignoredLines, app->renameColumns, app->strip_spaces,
+				app->simplify_spaces, app->d_ASCII_import_comments, app->d_ASCII_comment_string,
+				app->d_ASCII_import_read_only, Table::Overwrite, app->d_ASCII_import_locale, app->d_ASCII_end_line);
+
+		//data files from different folders may have the same name: each project needs its own file,
+		//the compression jobs would otherwise write to the same path
+		QString baseName = QFileInfo(file).completeBaseName();
+		QString fn = dir.absoluteFilePath(baseName + ".qti");
+		for (int i = 2; outputFiles.contains(fn); i++)
+			fn = dir.absoluteFilePath(baseName + "-" + QString::number(i) + ".qti");
+		outputFiles << fn;
+
+		app->saveFolder(app->projectFolder(), fn, false);
+		if (compress){//zlib compression doesn't touch the GUI and can overlap with the next project
+		#if QT_VERSION >= 0x040400
+			compressions << QtConcurrent::run(compressProjectFile, fn);
+		#else
+			compressProjectFile(fn);
+		#endif
+		}
+		projects++;
+	}
+
+#if QT_VERSION >= 0x040400
+	foreach(QFuture<void> future, compressions)
+		future.waitForFinished();
+#endif
+
+	app->saved = true;
+	app->close();
+	return projects;
+}
+
+QString ApplicationWindow::projectIndexEntry(MdiSubWindow *w, Folder *folder, qint64 offset, qint64 length)
+{
+	QStringList dependencies;
+	if (qobject_cast<MultiLayer *>(w))
+		dependencies = multilayerDependencies(w);
+	else if (qobject_cast<Graph3D *>(w)){
+		Graph3D *g = (Graph3D *)w;
+		if (g->table())
+			dependencies << g->table()->objectName();
+		if (g->matrix())
+			dependencies << g->matrix()->objectName();
+	} else if (qobject_cast<TableStatistics *>(w))
+		dependencies << ((TableStatistics *)w)->baseName();
+
+	QString s = QString(w->objectName()) + "\t" + QString(w->className()) + "\t" + folder->path() + "\t";
+	s += QString::number(offset) + "\t" + QString::number(length);
+	foreach(QString name, dependencies)
+		s += "\t" + name;
+	return s;
+}
+
+QStringList ApplicationWindow::projectIndex(const QString& fn)
+{
+	QFile f(fn);
+	if (!f.open(QIODevice::ReadOnly))
+		return QStringList();
+
+	f.seek(qMax((qint64)0, f.size() - 64));
+	QString tail = QString::fromUtf8(f.readAll());
+	int pos = tail.lastIndexOf("</index>\t");
+	if (pos < 0)
+		return QStringList();
+
+	QStringList index;
+	f.seek(tail.mid(pos + 9).trimmed().toLongLong());
+	if (QString::fromUtf8(f.readLine()).trimmed() != "<index>")
+		return index;
+
+	while (!f.atEnd()){
+		QString s = QString::fromUtf8(f.readLine());
+		if (s.startsWith("</index>"))
+			break;
+		s.chop(1);
+		index << s;
+	}
+	f.close();
+	return index;
+}
+
+//! Decompresses the gzip file \a fn into \a out, leaving \a fn untouched
+static bool uncompressToFile(const QString& fn, QFile& out)
+{
+	gzFile in = gzopen(QFile::encodeName(fn).constData(), "rb");
+	if (!in)
+		return false;
+
+	char buffer[16384];
+	int length;
+	while ((length = gzread(in, buffer, sizeof(buffer))) > 0){
+		if (out.write(buffer, length) != length)
+			break;
+	}
+	gzclose(in);
+	out.close();
+	return length == 0;
+}
+
+MdiSubWindow* ApplicationWindow::openProjectWindow(const QString& fn, const QString& name)
+{
+	QString fname = fn;
+	//the window is read from a temporary copy: the compressed project is left as it is
+	QTemporaryFile uncompressed(QDir::tempPath() + "/qtiplot-XXXXXX.qti");
+	if (fn.endsWith(".qti.gz", Qt::CaseInsensitive)){
+		if (!uncompressed.open() || !uncompressToFile(fn, uncompressed)){
+			QMessageBox::critical(this, tr("QtiPlot - File opening error"),
+					tr("The file: <b>%1</b> could not be decompressed!").arg(fn));
+			return 0;
+		}
+		fname = uncompressed.fileName();
+	}
+
+	QStringList index = projectIndex(fname);
+	QFile f(fname);
+	if (index.isEmpty() || !f.open(QIODevice::ReadOnly)){
+		QMessageBox::critical(this, tr("QtiPlot - File opening error"),
+				tr("There is no window called <b>%1</b> in the index of project file <b>%2</b>!").arg(name).arg(fn));
+		return 0;
+	}
+
+	QStringList lst = QString::fromUtf8(f.readLine()).split(QRegExp("\\s"), QString::SkipEmptyParts);
+	f.close();
+	if (lst.size() < 2 || lst[0] != "QtiPlot")
+		return 0;
+
+	//the version of the file is only used while reading it, the windows are renamed like when appending a project
+	int fileVersion = d_file_version;
+	QStringList vl = lst[1].split(".", QString::SkipEmptyParts);
+	d_file_version = 100*(vl[0]).toInt()+10*(vl[1]).toInt()+(vl[2]).toInt();
+	d_is_appending_file = true;
+	d_opening_file = true;
+	renamedTables.clear();
+	d_loaded_column_blocks.clear();
+	QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+
+	QStringList read;
+	MdiSubWindow *w = readProjectWindow(fname, index, name, read);
+
+	QApplication::restoreOverrideCursor();
+	d_loaded_column_blocks.clear();
+	renamedTables.clear();
+	d_opening_file = false;
+	d_is_appending_file = false;
+	d_file_version = fileVersion;
+
+	if (w)
+		modifiedProject();
+	return w;
+}
+
+MdiSubWindow* ApplicationWindow::readProjectWindow(const QString& fn, const QStringList& index, const QString& name, QStringList& read)
+{
+	QStringList entry;
+	foreach(QString s, index){
+		QStringList fields = s.split("\t");
+		if (fields.size() >= 5 && fields[0] == name){
+			entry = fields;
+			break;
+		}
+	}
+
+	if (entry.isEmpty()){
+		QApplication::restoreOverrideCursor();
+		QMessageBox::critical(this, tr("QtiPlot - File opening error"),
+				tr("There is no window called <b>%1</b> in the index of project file <b>%2</b>!").arg(name).arg(fn));
+		QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+		return 0;
+	}
+	read << name;
+
+	//the windows needed by this one are always read from the file: a window of the current project
+	//with the same name may hold different data, the windows read are renamed in case of name collisions
+	for (int i = 5; i < entry.size(); i++){
+		if (!read.contains(entry[i]) && !index.filter(QRegExp("^" + QRegExp::escape(entry[i]) + "\t")).isEmpty())
+			readProjectWindow(fn, index, entry[i], read);
+	}
+
+	QFile f(fn);
+	if (!f.open(QIODevice::ReadOnly))
+		return 0;
+
+	f.seek(entry[3].toLongLong());
+	QString block = QString::fromUtf8(f.read(entry[4].toLongLong()));
+	f.close();
+
+	QTextStream t(&block, QIODevice::ReadOnly);
+	QString s = t.readLine();
+	QStringList lst;
+
+	MdiSubWindow *w = 0;
+	if (s == "<table>"){
+		QStringList keys;
+		while (!t.atEnd()){
+			s = t.readLine();
+			if (d_file_version >= 99 && s.startsWith("ColumnHash\t"))
+				keys = s.split("\t");
+			else if (d_file_version >= 99 && s.startsWith("SharedColumn\t"))
+				loadColumnBlocks(fn, index, keys, s.split("\t"), read);
+			lst << s;
+		}
+		lst.pop_back();
+		w = openTable(this, lst);
+	} else if (s.left(17) == "<TableStatistics>"){
+		while (!t.atEnd())
+			lst << t.readLine();
+		lst.pop_back();
+		TableStatistics *ts = openTableStatistics(lst);
+		QString baseName = ts->baseName();
+		if (renamedTables.contains(baseName))
+			baseName = renamedTables[renamedTables.indexOf(baseName) + 1];
+		ts->setBase(table(baseName));
+		w = ts;
+	} else if (s == "<matrix>"){
+		while (!t.atEnd())
+			lst << t.readLine();
+		lst.pop_back();
+		w = openMatrix(this, lst);
+	} else if (s == "<note>"){
+		for (int i = 0; i < 3; i++)
+			lst << t.readLine();
+		Note *m = openNote(this, lst);
+		QStringList cont;
+		while (!t.atEnd())
+			cont << t.readLine();
+		cont.pop_back();
+		m->restore(cont, d_file_version);
+		w = m;
+	} else if (s == "<multiLayer>")
+		w = openMultiLayer(this, t);
+	else if (s == "<SurfacePlot>"){
+		while (!t.atEnd())
+			lst << t.readLine();
+		w = Graph3D::restore(this, lst, d_file_version);
+	}
+	return w;
+}
+
+void ApplicationWindow::loadColumnBlocks(const QString& fn, const QStringList& index, const QStringList& keys,
+										const QStringList& sources, QStringList& read)
+{
+	for (int i = 1; i < sources.size() && i < keys.size(); i++){
+		//reading the source table from the file registers all its data blocks
+		if (!sources[i].isEmpty() && !d_loaded_column_blocks.contains(keys[i]) && !read.contains(sources[i]))
+			readProjectWindow(fn, index, sources[i], read);
+	}
+}
+
 void ApplicationWindow::saveAsProject()
 {
 	saveFolderAsProject(current_folder);
@@ -17662,6 +18055,25 @@ void ApplicationWindow::goToColumn()
 		((Matrix *)w)->goToColumn(col);
 }
 
+bool ApplicationWindow::startRemoteControl(const QString& name)
+{
+	if (!d_remote_server)
+		d_remote_server = new RemoteControlServer(this);
+
+	if (!d_remote_server->listen(name)){
+		QMessageBox::critical(this, tr("QtiPlot - Error"),
+		tr("Could not start the remote control server %1:").arg(name) + "\n" + d_remote_server->errorString());
+		return false;
+	}
+	return true;
+}
+
+void ApplicationWindow::stopRemoteControl()
+{
+	if (d_remote_server)
+		d_remote_server->close();
+}
+
 void ApplicationWindow::showScriptWindow(bool parent)
 {
 	if (!scriptWindow){
@@ -17804,7 +18216,8 @@ ApplicationWindow * ApplicationWindow::loadScript(const QString& fn, bool execut
 		se->importASCII(fn);
 		se->executeAll();
 
-		exit(0);
+		// a non zero exit code lets batch runners detect failed scripts
+		exit(se->error() ? 1 : 0);
 	} else {
 		QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
 		setScriptingLanguage("Python");
@@ -39,6 +39,7 @@
 #include <QBuffer>
 #include <QLineEdit>
 #include <QMessageBox>
+#include <QHash>
 
 #include <MultiLayer.h>
 #include <Graph.h>
@@ -78,6 +79,7 @@ class QMdiArea;
 class QUndoView;
 class QCompleter;
 class QFileInfo;
+class QTextStream;
 
 class Matrix;
 class Table;
@@ -100,6 +102,7 @@ class ScriptEdit;
 class ExportDialog;
 class Grid;
 class ImportExportPlugin;
+class RemoteControlServer;
 
 /**
  * \brief QtiPlot's main window.
@@ -276,6 +279,10 @@ public slots:
 	void open();
 	ApplicationWindow* open(const QString& fn, bool factorySettings = false, bool newProject = true);
 	ApplicationWindow* openProject(const QString& fn, bool factorySettings = false, bool newProject = true);
+	//! Returns the trailing index of project file \a fn: one tab separated line per window (name, class, folder, offset, length, dependencies)
+	QStringList projectIndex(const QString& fn);
+	//! Reads only the window called \a name (and the windows it depends on) from project file \a fn into the current project, renaming them like when appending a project
+	MdiSubWindow* openProjectWindow(const QString& fn, const QString& name);
 	ApplicationWindow* importOPJ(const QString& fn, bool factorySettings = false, bool newProject = true);
 	void closeProject();
 
@@ -676,6 +683,7 @@ public slots:
 	Table* openTable(ApplicationWindow* app, const QStringList &flist);
 	TableStatistics* openTableStatistics(const QStringList &flist);
 	Graph* openGraph(ApplicationWindow* app, MultiLayer *plot, const QStringList &list);
+	MultiLayer* openMultiLayer(ApplicationWindow* app, QTextStream& t);
 
 	void openRecentProject(int index);
 	//@}
@@ -972,6 +980,13 @@ public slots:
 	//! Returns a list with the names of all the matrices in the project
 	QStringList matrixNames();
 
+	//! \name Remote Control
+	//@{
+	//! Starts a local socket server allowing other processes to control QtiPlot (see RemoteControlServer)
+	bool startRemoteControl(const QString& name = "qtiplot");
+	void stopRemoteControl();
+	//@}
+
 	//! \name Notes
 	//@{
  	//! Creates a new empty note window
@@ -1072,6 +1087,21 @@ public slots:
 	void saveAsProject();
 	void saveFolderAsProject(Folder *f);
 	void saveFolder(Folder *folder, const QString& fn, bool compress = false);
+	/**
+	 * \brief Generates one project file per data file from a project used as template.
+	 *
+	 * \param templateFile is opened only once in a hidden application window.
+	 * \param tableName is the table of the template project whose data is replaced by each file in \a dataFiles.
+	 * \param outputDir is the folder where the projects are saved, named after the data files.
+	 * Data files with the same base name get a counter suffix (name-2.qti, name-3.qti...).
+	 * \param compress specifies if the projects should be saved as .qti.gz files.
+	 * \param errors if not null, receives the error messages. No message box is shown, so that
+	 * the function can be used by scripts and batch jobs.
+	 * Returns the number of projects written.
+	 */
+	int generateProjects(const QString& templateFile, const QString& tableName,
+						const QStringList& dataFiles, const QString& outputDir, bool compress = false,
+						QStringList *errors = 0);
 
 	//!  adds a folder list item to the list view "lv"
 	void addFolderListViewItem(Folder *f);
@@ -1155,6 +1185,11 @@ private:
 	QString getSaveProjectName(const QString& fileName, bool *compress = 0, int scope = 0);
 	void goToParentFolder();
 	bool isProjectFile(const QString& fn);
+	QString projectIndexEntry(MdiSubWindow *w, Folder *folder, qint64 offset, qint64 length);
+	//! Reads the window \a name and the windows it depends on, see openProjectWindow(); \a read holds the names of the windows already read
+	MdiSubWindow* readProjectWindow(const QString& fn, const QStringList& index, const QString& name, QStringList& read);
+	//! Reads the source tables of the shared columns of a table, unless they were already read
+	void loadColumnBlocks(const QString& fn, const QStringList& index, const QStringList& keys, const QStringList& sources, QStringList& read);
 	void initSearchForUpdates();
 	Graph* activePlotLayer(bool = true);
 
@@ -1332,6 +1367,9 @@ public:
 	//! Calculate only 2 points in a generated linear fit function curve
 	bool d_2_linear_fit_points;
 
+	//! Compile user defined fit models into native plugins, see FitCompiler
+	bool d_compile_fit_models;
+
 	bool pasteFitResultsToPlot;
 
 	//! Write fit output information to Result Log
@@ -1407,6 +1445,10 @@ public:
     QStringList d_param_surface_func; //user-defined parametric surface functions;
 	//! List of tables and matrices renamed in order to avoid conflicts when appending a project to a folder
 	QStringList renamedTables;
+	//! Keys of the table column data blocks already written to the project file being saved, with the name of their source table
+	QHash<QString, QString> d_saved_column_blocks;
+	//! Table column data blocks read from the project file being opened, indexed by their keys
+	QHash<QString, QStringList> d_loaded_column_blocks;
 
 	//! \name variables used when user copy/paste markers
 	//@{
@@ -1464,6 +1506,9 @@ private:
 	//! Stores the pointers to the dragged items from the FolderListViews objects
 	QList<Q3ListViewItem *> draggedItems;
 
+	//! Local socket server used by other processes to control QtiPlot
+	RemoteControlServer *d_remote_server;
+
 	//! Used when checking for new versions
 	QHttp *http;
 	//! Used when checking for new versions
@@ -0,0 +1,232 @@
+/***************************************************************************
+	File                 : BatchRunner.cpp
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Runs a script on many input files using a pool of processes
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#include "BatchRunner.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+
+#include <iostream>
+
+BatchRunner::BatchRunner(const QString& script, const QStringList& inputs, const QString& outputFolder, int processes, QObject *parent)
+	: QObject(parent),
+	d_script(QFileInfo(script).absoluteFilePath()),
+	d_output_folder(QDir(outputFolder).absolutePath()),
+	d_processes(processes),
+	d_next_task(0),
+	d_finished_tasks(0),
+	d_failed_tasks(0)
+{
+	if (d_processes <= 0)
+		d_processes = qMax(QThread::idealThreadCount(), 1);
+
+	QDir dir(d_output_folder);
+	int digits = QString::number(inputs.size()).length();
+	for (int i = 0; i < inputs.size(); i++){
+		Task task;
+		task.input = QFileInfo(inputs[i]).absoluteFilePath();
+		// the index keeps the folders unique when several inputs have the same base name
+		task.outputFolder = dir.absoluteFilePath(QString::number(i + 1).rightJustified(digits, '0') +
+								"_" + QFileInfo(inputs[i]).completeBaseName());
+		task.process = 0;
+		task.elapsed = 0;
+		task.exitCode = -1;
+		d_tasks << task;
+	}
+}
+
+bool BatchRunner::isBatchOption(const QString& arg)
+{
+	return arg == "--batch" || arg.startsWith("--batch=") || arg == "-b" || arg.startsWith("-b=");
+}
+
+bool BatchRunner::isBatchCommandLine(const QStringList& args)
+{
+	foreach(QString arg, args){
+		if (isBatchOption(arg))
+			return true;
+	}
+	return false;
+}
+
+BatchRunner* BatchRunner::fromCommandLine(const QStringList& args, QObject *parent)
+{
+	int processes = 0;
+	QString outputFolder = QDir::current().absoluteFilePath("batch_output");
+	QStringList files;
+	foreach(QString arg, args){
+		if (isBatchOption(arg)){
+			int index = arg.indexOf('=');
+			if (index > 0)
+				processes = arg.mid(index + 1).toInt();
+		} else if (arg.startsWith("--output=") || arg.startsWith("-o="))
+			outputFolder = arg.mid(arg.indexOf('=') + 1);
+		else if (arg.startsWith("@")){
+			QFile f(arg.mid(1));
+			if (!f.open(QIODevice::ReadOnly | QIODevice::Text)){
+				message(tr("Could not read the list of input files %1!").arg(f.fileName()));
+				return 0;
+			}
+			QTextStream t(&f);
+			while (!t.atEnd()){
+				QString file = t.readLine().trimmed();
+				if (!file.isEmpty())
+					files << file;
+			}
+			f.close();
+		} else if (!arg.startsWith("-"))
+			files << arg;
+	}
+
+	if (files.size() < 2){
+		message(tr("Usage") + ": qtiplot --batch[=N] [--output=folder] script.py input_files...");
+		return 0;
+	}
+
+	QString script = files.takeFirst();
+	if (!QFile::exists(script)){
+		message(tr("The script file %1 doesn't exist!").arg(script));
+		return 0;
+	}
+	return new BatchRunner(script, files, outputFolder, processes, parent);
+}
+
+void BatchRunner::start()
+{
+	QDir dir(d_output_folder);
+	if (!dir.exists() && !dir.mkpath(d_output_folder)){
+		message(tr("Could not create the output folder %1!").arg(d_output_folder));
+		emit finished(d_tasks.size());
+		return;
+	}
+
+	message(tr("Processing %1 files with %2 using %3 processes...").arg(d_tasks.size()).arg(d_script).arg(d_processes));
+	d_time.start();
+	while (d_next_task < d_tasks.size() && d_next_task < d_processes)
+		startTask(d_next_task++);
+
+	if (d_tasks.isEmpty())
+		emit finished(0);
+}
+
+void BatchRunner::startTask(int index)
+{
+	Task& task = d_tasks[index];
+	QDir().mkpath(task.outputFolder);
+
+	QStringList env = QProcess::systemEnvironment();
+	env << "QTIPLOT_BATCH_INPUT=" + task.input;
+	env << "QTIPLOT_BATCH_OUTPUT=" + task.outputFolder;
+	env << "QTIPLOT_BATCH_TASK=" + QString::number(index + 1);
+
+	QProcess *process = new QProcess(this);
+	process->setEnvironment(env);
+	// relative file names used by the script end up in the output folder of the task
+	process->setWorkingDirectory(task.outputFolder);
+	process->setProcessChannelMode(QProcess::MergedChannels);
+	process->setStandardOutputFile(QDir(task.outputFolder).absoluteFilePath("output.log"));
+	process->setProperty("task", index);
+	connect(process, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(taskFinished(int, QProcess::ExitStatus)));
+	connect(process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(taskError(QProcess::ProcessError)));
+
+	task.process = process;
+	task.time.start();
+	process->start(QCoreApplication::applicationFilePath(), QStringList() << "-X" << d_script);
+}
+
+void BatchRunner::taskFinished(int exitCode, QProcess::ExitStatus status)
+{
+	endTask(qobject_cast<QProcess *>(sender()), status == QProcess::NormalExit ? exitCode : -1);
+}
+
+void BatchRunner::taskError(QProcess::ProcessError error)
+{
+	// crashes are reported by the finished() signal
+	if (error == QProcess::FailedToStart)
+		endTask(qobject_cast<QProcess *>(sender()), -1);
+}
+
+void BatchRunner::endTask(QProcess *process, int exitCode)
+{
+	if (!process)
+		return;
+
+	int index = process->property("task").toInt();
+	Task& task = d_tasks[index];
+	if (task.process != process)
+		return;
+
+	task.elapsed = task.time.elapsed();
+	task.exitCode = exitCode;
+	task.process = 0;
+	process->deleteLater();
+
+	d_finished_tasks++;
+	if (exitCode)
+		d_failed_tasks++;
+
+	message(QString("[%1/%2] %3: %4 (%5 s)").arg(d_finished_tasks).arg(d_tasks.size()).arg(task.input)
+			.arg(exitCode ? tr("failed") : tr("done")).arg(0.001*task.elapsed, 0, 'f', 2));
+
+	if (d_next_task < d_tasks.size())
+		startTask(d_next_task++);
+	else if (d_finished_tasks == d_tasks.size()){
+		writeReport();
+		message(tr("%1 files processed in %2 s, %3 failed.").arg(d_tasks.size())
+				.arg(0.001*d_time.elapsed(), 0, 'f', 2).arg(d_failed_tasks));
+		emit finished(d_failed_tasks);
+	}
+}
+
+void BatchRunner::writeReport()
+{
+	QFile f(QDir(d_output_folder).absoluteFilePath("batch_report.txt"));
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Text)){
+		message(tr("Could not write the report file %1!").arg(f.fileName()));
+		return;
+	}
+
+	QTextStream t(&f);
+	t << "input\texit code\ttime (s)\toutput folder\toutput files\n";
+	foreach(Task task, d_tasks){
+		QStringList files = QDir(task.outputFolder).entryList(QDir::Files, QDir::Name);
+		files.removeAll("output.log");
+		t << task.input << "\t" << task.exitCode << "\t" << QString::number(0.001*task.elapsed, 'f', 3) << "\t";
+		t << task.outputFolder << "\t" << files.join(";") << "\n";
+	}
+	f.close();
+}
+
+void BatchRunner::message(const QString& text)
+{
+	std::wcout << text.toStdWString() << std::endl;
+}
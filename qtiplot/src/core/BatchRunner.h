@@ -0,0 +1,107 @@
+/***************************************************************************
+	File                 : BatchRunner.h
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Runs a script on many input files using a pool of processes
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+#include <QTime>
+#include <QVector>
+
+//! Runs a script on a list of input files, using a pool of headless QtiPlot processes.
+/**
+ * Each input file is processed by a separate "qtiplot -X script" worker process.
+ * The worker finds the input file name, its own output folder and the task index in the
+ * QTIPLOT_BATCH_INPUT, QTIPLOT_BATCH_OUTPUT and QTIPLOT_BATCH_TASK environment variables,
+ * e.g. os.environ["QTIPLOT_BATCH_INPUT"] in Python.
+ *
+ * The console output of each task is saved to a log file in its output folder.
+ * When all tasks are finished a tab separated report (batch_report.txt) listing the exit code,
+ * the duration and the files written by each task is saved in the output folder.
+ *
+ * Command line usage: qtiplot --batch[=N] [--output=folder] script.py input_files...
+ * where N is the number of worker processes and an argument \@list.txt stands for all
+ * the file names listed (one per line) in the file list.txt.
+ */
+class BatchRunner : public QObject
+{
+	Q_OBJECT
+
+public:
+	BatchRunner(const QString& script, const QStringList& inputs, const QString& outputFolder, int processes = 0, QObject *parent = 0);
+
+	//! Returns true if \a arg is the -b[=N] or --batch[=N] option
+	static bool isBatchOption(const QString& arg);
+	//! Returns true if one of the command line arguments \a args is the --batch option
+	static bool isBatchCommandLine(const QStringList& args);
+	//! Parses the command line arguments of a batch run, returns 0 if they are not valid
+	static BatchRunner* fromCommandLine(const QStringList& args, QObject *parent = 0);
+
+public slots:
+	//! Starts the worker processes, finished() is emitted when all tasks are over
+	void start();
+
+signals:
+	void finished(int failedTasks);
+
+private slots:
+	void taskFinished(int exitCode, QProcess::ExitStatus status);
+	void taskError(QProcess::ProcessError error);
+
+private:
+	struct Task
+	{
+		QString input;
+		QString outputFolder;
+		QProcess *process;
+		QTime time;
+		int elapsed;
+		int exitCode;
+	};
+
+	void startTask(int index);
+	void endTask(QProcess *process, int exitCode);
+	void writeReport();
+	//! Writes a line to the standard output of the batch process
+	static void message(const QString& text);
+
+	QString d_script;
+	QString d_output_folder;
+	int d_processes;
+	QVector<Task> d_tasks;
+	//! Index of the next task to be started
+	int d_next_task;
+	int d_finished_tasks;
+	int d_failed_tasks;
+	QTime d_time;
+};
+
+#endif
@@ -1044,11 +1044,15 @@ void ConfigDialog::initFittingPage()
 	boxMultiPeakMsgs = new QCheckBox();
 	boxMultiPeakMsgs->setChecked(app->d_multi_peak_messages);
 
+	compileFitModelsBox = new QCheckBox();
+	compileFitModelsBox->setChecked(app->d_compile_fit_models);
+
 	QVBoxLayout* fitPageLayout = new QVBoxLayout(fitPage);
 	fitPageLayout->addWidget(groupBoxFittingCurve);
 	fitPageLayout->addWidget(groupBoxMultiPeak);
 	fitPageLayout->addWidget(groupBoxFitParameters);
 	fitPageLayout->addWidget(boxMultiPeakMsgs);
+	fitPageLayout->addWidget(compileFitModelsBox);
 	fitPageLayout->addStretch();
 
 	connect(samePointsBtn, SIGNAL(toggled(bool)), this, SLOT(showPointsBox(bool)));
@@ -2399,6 +2403,7 @@ void ConfigDialog::languageChange()
 	lblPeaksColor->setText(tr("Peaks Color"));
 
 	boxMultiPeakMsgs->setText(tr("Display Confirmation &Messages for Multi-peak Fits"));
+	compileFitModelsBox->setText(tr("&Compile User Defined Models (requires a C compiler)"));
 
 	updateMenuList();
 }
@@ -2718,6 +2723,7 @@ void ConfigDialog::apply()
 	app->fit_scale_errors = scaleErrorsBox->isChecked();
 	app->d_2_linear_fit_points = linearFit2PointsBox->isChecked();
 	app->d_multi_peak_messages = boxMultiPeakMsgs->isChecked();
+	app->d_compile_fit_models = compileFitModelsBox->isChecked();
 	app->saveSettings();
 
 	updateMenuList();
@@ -3857,6 +3863,7 @@ void ConfigDialog::setApplication(ApplicationWindow *app)
 	plotLabelBox->setChecked(app->pasteFitResultsToPlot);
 	scaleErrorsBox->setChecked(app->fit_scale_errors);
 	boxMultiPeakMsgs->setChecked(app->d_multi_peak_messages);
+	compileFitModelsBox->setChecked(app->d_compile_fit_models);
 
 	languageChange();
 
@@ -283,7 +283,7 @@ private:
 	DoubleSpinBox *boxCanvasHeight, *boxCanvasWidth;
 	QComboBox *unitBox;
 	QLabel *unitBoxLabel, *canvasWidthLabel, *canvasHeightLabel;
-	QCheckBox *keepRatioBox, *boxMultiPeakMsgs;
+	QCheckBox *keepRatioBox, *boxMultiPeakMsgs, *compileFitModelsBox;
 
 	double aspect_ratio;
 
@@ -29,6 +29,7 @@
 
 #include <QtiPlotApplication.h>
 #include <ApplicationWindow.h>
+#include <BatchRunner.h>
 #include <QFileOpenEvent>
 #include <QTimer>
 #include <QMenu>
@@ -52,19 +53,32 @@ QtiPlotApplication::QtiPlotApplication( int & argc, char ** argv) : QApplication
 	#else
 		ApplicationWindow::about(false);
 	#endif
+	} else if (BatchRunner::isBatchCommandLine(args)){
+		// the batch process only dispatches the tasks, no main window is needed
+		BatchRunner *runner = BatchRunner::fromCommandLine(args, this);
+		if (runner){
+			connect(runner, SIGNAL(finished(int)), this, SLOT(batchFinished(int)));
+			QTimer::singleShot(0, runner, SLOT(start()));
+		} else
+			QMetaObject::invokeMethod(this, "batchFinished", Qt::QueuedConnection, Q_ARG(int, 1));
 	} else {
 		bool factorySettings = false;
 		if (args.contains("-d") || args.contains("--default-settings"))
 			factorySettings = true;
 
+		// headless script runs (e.g. the workers of a batch) skip the interactive start-up steps
+		bool noGui = args.contains("-X");
+
 		ApplicationWindow *mw = new ApplicationWindow(factorySettings);
-		mw->restoreApplicationGeometry();
-	#if (!defined(QTIPLOT_PRO) && !defined(QTIPLOT_DEMO) && !defined(Q_WS_X11))
-		mw->showDonationDialog();
-	#endif
-		if (mw->autoSearchUpdates){
-			mw->autoSearchUpdatesRequest = true;
-			mw->searchForUpdates();
+		if (!noGui){
+			mw->restoreApplicationGeometry();
+		#if (!defined(QTIPLOT_PRO) && !defined(QTIPLOT_DEMO) && !defined(Q_WS_X11))
+			mw->showDonationDialog();
+		#endif
+			if (mw->autoSearchUpdates){
+				mw->autoSearchUpdatesRequest = true;
+				mw->searchForUpdates();
+			}
 		}
 		mw->parseCommandLineArguments(args);
 	}
@@ -79,6 +93,11 @@ QtiPlotApplication::QtiPlotApplication( int & argc, char ** argv) : QApplication
 	#endif
 }
 
+void QtiPlotApplication::batchFinished(int failedTasks)
+{
+	exit(failedTasks ? 1 : 0);
+}
+
 void QtiPlotApplication::close()
 {
 	ApplicationWindow *mw = d_windows.last();
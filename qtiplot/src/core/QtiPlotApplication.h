@@ -54,6 +54,8 @@ private:
 
 private slots:
 	void close();
+	//! Exits when all the tasks started by the --batch command line option are finished
+	void batchFinished(int failedTasks);
 #ifdef Q_WS_MAC
 	void newWindow();
 	void activateWindow(QAction *);
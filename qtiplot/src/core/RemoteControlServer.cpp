@@ -0,0 +1,510 @@
+/***************************************************************************
+	File                 : RemoteControlServer.cpp
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Local socket server allowing other processes to control QtiPlot
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#include "RemoteControlServer.h"
+#include "ApplicationWindow.h"
+#include <Matrix.h>
+#include <MatrixModel.h>
+#include <MultiLayer.h>
+#include <Graph.h>
+#include <Graph3D.h>
+#include <Table.h>
+#include <Script.h>
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QtEndian>
+#include <QVector>
+
+#include <gsl/gsl_math.h>
+#include <limits.h>
+
+//! Size of the request and reply headers: size, id and command or status
+static const int header_size = 9;
+
+//! Reads the arguments of a request from the socket, never reading past the end of the request
+class RequestReader
+{
+public:
+	RequestReader(QIODevice *device, quint32 size) : d_device(device), d_remaining(size), d_ok(true){};
+
+	bool ok() const {return d_ok;};
+	//! Marks the arguments as invalid
+	void setInvalid(){d_ok = false;};
+
+	//! Returns true if the unread part of the request holds at least n doubles
+	bool hasDoubles(quint64 n) const {return d_ok && n <= d_remaining/sizeof(double);};
+
+	quint32 readUInt()
+	{
+		uchar buffer[4];
+		if (!readRaw((char *)buffer, 4))
+			return 0;
+		return qFromLittleEndian<quint32>(buffer);
+	}
+
+	QString readString()
+	{
+		quint32 length = readUInt();
+		if (!d_ok || length > d_remaining){
+			d_ok = false;
+			return QString::null;
+		}
+		QByteArray bytes = d_device->read(length);
+		d_remaining -= bytes.size();
+		return QString::fromUtf8(bytes.constData(), bytes.size());
+	}
+
+	//! Reads n doubles directly into data
+	bool readDoubles(double *data, quint32 n)
+	{
+		if (n > d_remaining/sizeof(double) || !readRaw((char *)data, n*sizeof(double)))
+			return false;
+	#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+		quint64 *values = (quint64 *)data;
+		for (quint32 i = 0; i < n; i++)
+			values[i] = qFromLittleEndian<quint64>((const uchar *)&values[i]);
+	#endif
+		return true;
+	}
+
+	//! Discards the unread part of the request
+	void skip()
+	{
+		while (d_remaining > 0){
+			QByteArray bytes = d_device->read(d_remaining);
+			if (bytes.isEmpty())
+				break;
+			d_remaining -= bytes.size();
+		}
+	}
+
+private:
+	bool readRaw(char *data, qint64 size)
+	{
+		if (!d_ok || size > d_remaining || d_device->read(data, size) != size){
+			d_ok = false;
+			return false;
+		}
+		d_remaining -= size;
+		return true;
+	}
+
+	QIODevice *d_device;
+	quint32 d_remaining;
+	bool d_ok;
+};
+
+static void appendUInt(QByteArray& data, quint32 value)
+{
+	uchar buffer[4];
+	qToLittleEndian<quint32>(value, buffer);
+	data.append((const char *)buffer, 4);
+}
+
+static void appendDouble(QByteArray& data, double value)
+{
+	uchar buffer[8];
+	qToLittleEndian<quint64>(*(quint64 *)&value, buffer);
+	data.append((const char *)buffer, 8);
+}
+
+RemoteControlServer::RemoteControlServer(ApplicationWindow *parent)
+	: QObject(parent),
+	d_app(parent),
+	d_script(0),
+	d_script_env(0)
+{
+	d_server = new QLocalServer(this);
+	connect(d_server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+bool RemoteControlServer::listen(const QString& name)
+{
+	if (d_server->isListening())
+		d_server->close();
+	d_error_string = QString::null;
+
+	// another instance may already be listening on this name
+	QLocalSocket socket;
+	socket.connectToServer(name);
+	if (socket.waitForConnected(1000)){
+		socket.disconnectFromServer();
+		d_error_string = tr("The name %1 is already used by another server.").arg(name);
+		return false;
+	}
+
+#if QT_VERSION >= 0x040500
+	// nobody answers: removes the socket file left behind by a crashed instance
+	QLocalServer::removeServer(name);
+#endif
+	return d_server->listen(name);
+}
+
+void RemoteControlServer::close()
+{
+	d_server->close();
+}
+
+bool RemoteControlServer::isListening() const
+{
+	return d_server->isListening();
+}
+
+QString RemoteControlServer::serverName() const
+{
+	return d_server->serverName();
+}
+
+QString RemoteControlServer::errorString() const
+{
+	if (!d_error_string.isEmpty())
+		return d_error_string;
+	return d_server->errorString();
+}
+
+void RemoteControlServer::newConnection()
+{
+	while (d_server->hasPendingConnections()){
+		QLocalSocket *socket = d_server->nextPendingConnection();
+		connect(socket, SIGNAL(readyRead()), this, SLOT(readRequests()));
+		connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+	}
+}
+
+void RemoteControlServer::readRequests()
+{
+	QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+	if (!socket)
+		return;
+
+	// all the complete requests are processed before updating the modified windows
+	bool processed = false;
+	while (socket->bytesAvailable() >= header_size){
+		uchar header[header_size];
+		socket->peek((char *)header, header_size);
+		quint32 size = qFromLittleEndian<quint32>(header);
+		if (size < header_size - 4){
+			socket->disconnectFromServer();
+			break;
+		}
+		if (socket->bytesAvailable() < 4 + (qint64)size)
+			break;
+
+		socket->read((char *)header, header_size);
+		quint32 id = qFromLittleEndian<quint32>(header + 4);
+		processRequest(socket, id, header[8], size - (header_size - 4));
+		processed = true;
+	}
+
+	if (processed){
+		flush();
+		socket->flush();
+	}
+}
+
+void RemoteControlServer::processRequest(QLocalSocket *socket, quint32 id, int command, quint32 size)
+{
+	RequestReader reader(socket, size);
+	switch(command){
+		case Ping:
+		{
+			QByteArray data = "QtiPlot remote control 1";
+			reply(socket, id, Success, data);
+			break;
+		}
+
+		case Execute:
+		{
+			QString code = reader.readString();
+			if (!reader.ok())
+				break;
+
+			flush();
+			QString error;
+			if (execute(code, error))
+				reply(socket, id, Success);
+			else
+				replyError(socket, id, error);
+			break;
+		}
+
+		case SetColumn:
+		{
+			QString name = reader.readString();
+			quint32 col = reader.readUInt();
+			quint32 startRow = reader.readUInt();
+			quint32 count = reader.readUInt();
+			// the size is checked before allocating anything
+			if (!reader.hasDoubles(count) || (qint64)startRow + count > INT_MAX){
+				reader.setInvalid();
+				break;
+			}
+
+			QVector<double> values(count);
+			if (!reader.readDoubles(values.data(), count))
+				break;
+
+			Table *t = qobject_cast<Table *>(d_app->window(name));
+			if (!t || (int)col >= t->numCols()){
+				replyError(socket, id, tr("There is no column %1 in table %2!").arg(col + 1).arg(name));
+				break;
+			}
+
+			if ((qint64)startRow + count > t->numRows())
+				t->setNumRows((int)(startRow + count));
+			for (quint32 i = 0; i < count; i++){
+				double val = values[i];
+				if (gsl_isnan(val))
+					t->setText(startRow + i, col, "");
+				else
+					t->setCell(startRow + i, col, val);
+			}
+			d_modified_columns[name] << col;
+			reply(socket, id, Success);
+			break;
+		}
+
+		case GetColumn:
+		{
+			QString name = reader.readString();
+			quint32 col = reader.readUInt();
+			quint32 startRow = reader.readUInt();
+			quint32 count = reader.readUInt();
+			if (!reader.ok())
+				break;
+
+			Table *t = qobject_cast<Table *>(d_app->window(name));
+			if (!t || (int)col >= t->numCols()){
+				replyError(socket, id, tr("There is no column %1 in table %2!").arg(col + 1).arg(name));
+				break;
+			}
+
+			int rows = t->numRows();
+			int endRow = (count == 0xffffffff) ? rows : qMin((qint64)rows, (qint64)startRow + count);
+			int n = qMax(endRow - (int)startRow, 0);
+
+			QByteArray data;
+			data.reserve(4 + 8*n);
+			appendUInt(data, n);
+			for (int row = startRow; row < endRow; row++)
+				appendDouble(data, t->text(row, col).isEmpty() ? GSL_NAN : t->cell(row, col));
+			reply(socket, id, Success, data);
+			break;
+		}
+
+		case SetMatrix:
+		{
+			QString name = reader.readString();
+			quint32 rows = reader.readUInt();
+			quint32 cols = reader.readUInt();
+			if (!reader.ok())
+				break;
+
+			Matrix *m = qobject_cast<Matrix *>(d_app->window(name));
+			if (!m || !rows || !cols){
+				replyError(socket, id, tr("There is no matrix called %1!").arg(name));
+				break;
+			}
+
+			// the whole payload must be in the request before the matrix is resized
+			quint64 cells = (quint64)rows*cols;
+			if (!reader.hasDoubles(cells) || cells > INT_MAX){
+				reader.setInvalid();
+				break;
+			}
+
+			if (m->numRows() != (int)rows || m->numCols() != (int)cols)
+				m->setDimensions(rows, cols);
+			// the matrix is left unchanged if it can't be resized, the payload is then skipped
+			MatrixModel *model = m->matrixModel();
+			if (m->numRows() != (int)rows || m->numCols() != (int)cols ||
+				!model->dataVector() || (quint64)model->dataVectorSize() < cells){
+				replyError(socket, id, tr("Matrix %1 could not be resized to %2x%3!").arg(name).arg(rows).arg(cols));
+				break;
+			}
+			// the values go straight from the socket into the data of the matrix
+			if (!reader.readDoubles(model->dataVector(), (quint32)cells))
+				break;
+
+			d_modified_matrices << name;
+			reply(socket, id, Success);
+			break;
+		}
+
+		case GetMatrix:
+		{
+			QString name = reader.readString();
+			if (!reader.ok())
+				break;
+
+			Matrix *m = qobject_cast<Matrix *>(d_app->window(name));
+			if (!m){
+				replyError(socket, id, tr("There is no matrix called %1!").arg(name));
+				break;
+			}
+
+			int cells = m->numRows()*m->numCols();
+			const double *values = m->matrixModel()->dataVector();
+			QByteArray data;
+			data.reserve(8 + 8*cells);
+			appendUInt(data, m->numRows());
+			appendUInt(data, m->numCols());
+			for (int i = 0; i < cells; i++)
+				appendDouble(data, values[i]);
+			reply(socket, id, Success, data);
+			break;
+		}
+
+		case Replot:
+		{
+			QString name = reader.readString();
+			if (!reader.ok())
+				break;
+
+			if (!d_app->window(name)){
+				replyError(socket, id, tr("There is no window called %1!").arg(name));
+				break;
+			}
+			d_replots << name;
+			reply(socket, id, Success);
+			break;
+		}
+
+		case Export:
+		{
+			QString name = reader.readString();
+			QString fileName = reader.readString();
+			if (!reader.ok())
+				break;
+
+			MdiSubWindow *w = d_app->window(name);
+			if (!w || fileName.isEmpty()){
+				replyError(socket, id, tr("There is no window called %1!").arg(name));
+				break;
+			}
+
+			flush();
+			if (MultiLayer *ml = qobject_cast<MultiLayer *>(w))
+				ml->exportToFile(fileName);
+			else if (Matrix *m = qobject_cast<Matrix *>(w))
+				m->exportToFile(fileName);
+			else if (Graph3D *g = qobject_cast<Graph3D *>(w))
+				g->exportToFile(fileName);
+			else if (Table *t = qobject_cast<Table *>(w))
+				t->exportASCII(fileName, "\t", true);
+			else {
+				replyError(socket, id, tr("Window %1 can't be exported!").arg(name));
+				break;
+			}
+			reply(socket, id, Success);
+			break;
+		}
+
+		default:
+			replyError(socket, id, tr("Unknown command %1!").arg(command));
+			break;
+	}
+
+	if (!reader.ok())
+		replyError(socket, id, tr("Invalid arguments for command %1!").arg(command));
+	reader.skip();
+}
+
+void RemoteControlServer::reply(QLocalSocket *socket, quint32 id, int status, const QByteArray& data)
+{
+	QByteArray header;
+	appendUInt(header, data.size() + header_size - 4);
+	appendUInt(header, id);
+	header.append((char)status);
+	socket->write(header);
+	socket->write(data);
+}
+
+void RemoteControlServer::replyError(QLocalSocket *socket, quint32 id, const QString& message)
+{
+	reply(socket, id, Error, message.toUtf8());
+}
+
+void RemoteControlServer::flush()
+{
+	for (QHash<QString, QSet<int> >::const_iterator it = d_modified_columns.begin(); it != d_modified_columns.end(); ++it){
+		Table *t = qobject_cast<Table *>(d_app->window(it.key()));
+		if (!t)
+			continue;
+		foreach(int col, it.value()){
+			if (col < t->numCols())
+				t->notifyChanges(t->colName(col));
+		}
+	}
+	d_modified_columns.clear();
+
+	foreach(QString name, d_modified_matrices){
+		Matrix *m = qobject_cast<Matrix *>(d_app->window(name));
+		if (m)
+			m->notifyChanges();
+	}
+	d_modified_matrices.clear();
+
+	foreach(QString name, d_replots){
+		MdiSubWindow *w = d_app->window(name);
+		if (MultiLayer *ml = qobject_cast<MultiLayer *>(w)){
+			foreach(Graph *g, ml->layersList())
+				g->replot();
+		} else if (w)
+			w->update();
+	}
+	d_replots.clear();
+}
+
+bool RemoteControlServer::execute(const QString& code, QString& error)
+{
+	ScriptingEnv *env = d_app->scriptingEnv();
+	if (!d_script || d_script_env != env){
+		delete d_script;
+		d_script = env->newScript("", d_app, "<remote>");
+		d_script_env = env;
+		if (!d_script){
+			error = tr("The current scripting language can't execute code!");
+			return false;
+		}
+		connect(d_script, SIGNAL(error(const QString&, const QString&, int)),
+				this, SLOT(scriptError(const QString&, const QString&, int)));
+	}
+
+	d_script_error = QString::null;
+	d_script->setCode(code);
+	bool success = d_script->exec();
+	error = d_script_error;
+	return success && error.isEmpty();
+}
+
+void RemoteControlServer::scriptError(const QString& message, const QString&, int)
+{
+	d_script_error = message;
+}
@@ -0,0 +1,120 @@
+/***************************************************************************
+	File                 : RemoteControlServer.h
+	Project              : QtiPlot
+--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Local socket server allowing other processes to control QtiPlot
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef REMOTECONTROLSERVER_H
+#define REMOTECONTROLSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+class QLocalServer;
+class QLocalSocket;
+class ApplicationWindow;
+class Script;
+class ScriptingEnv;
+
+//! Local socket server allowing other processes (e.g. acquisition software) to control QtiPlot.
+/**
+ * The server is event driven: requests are processed as soon as they arrive. All the complete
+ * requests available on a connection are processed in one go, so that clients can pipeline requests
+ * without waiting for the replies. Tables and matrices modified by a batch of requests are updated,
+ * and their dependent plots replotted, only once at the end of the batch.
+ *
+ * \section protocol Protocol
+ * All integers are unsigned 32 bit little endian values, floating point data are little endian
+ * IEEE doubles and strings are sent as their length in bytes followed by UTF-8 text.
+ *
+ * Request: size (bytes following this field), id, command (one byte), arguments.
+ * Reply: size, id of the request, status (one byte: 0 = success, 1 = error), data or error message.
+ *
+ * Commands:
+ * - Ping: no arguments, replies with the protocol version string.
+ * - Execute: code; executes code using the current scripting language.
+ * - SetColumn: table, column, first row, count, count doubles; NaN values clear the cells.
+ * - GetColumn: table, column, first row, count (0xffffffff = up to the last row);
+ *   replies with count followed by the values (NaN for empty cells).
+ * - SetMatrix: matrix, rows, columns, rows*columns doubles. The values are read from the
+ *   socket directly into the data buffer of the matrix.
+ * - GetMatrix: matrix; replies with rows, columns and the values.
+ * - Replot: window; replots the window at the end of the current batch.
+ * - Export: window, file name; exports a plot or a matrix to a file.
+ */
+class RemoteControlServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Command{Ping = 0, Execute = 1, SetColumn = 2, GetColumn = 3, SetMatrix = 4, GetMatrix = 5, Replot = 6, Export = 7};
+	enum Status{Success = 0, Error = 1};
+
+	RemoteControlServer(ApplicationWindow *parent);
+
+	//! Starts listening on the local socket (named pipe on Windows) with the given name
+	/**
+	 * Fails if another server already accepts connections on this name. A socket
+	 * file nobody answers on is considered stale and removed.
+	 */
+	bool listen(const QString& name);
+	void close();
+	bool isListening() const;
+	QString serverName() const;
+	QString errorString() const;
+
+private slots:
+	void newConnection();
+	void readRequests();
+	void scriptError(const QString& message, const QString& scriptName, int lineNumber);
+
+private:
+	//! Processes a complete request, whose payload (without the header) is still in the socket buffer
+	void processRequest(QLocalSocket *socket, quint32 id, int command, quint32 size);
+	void reply(QLocalSocket *socket, quint32 id, int status, const QByteArray& data = QByteArray());
+	void replyError(QLocalSocket *socket, quint32 id, const QString& message);
+	//! Updates the windows modified by the current batch of requests
+	void flush();
+	bool execute(const QString& code, QString& error);
+
+	ApplicationWindow *d_app;
+	QLocalServer *d_server;
+	//! Error of the last call to listen() not reported by the local server
+	QString d_error_string;
+	//! Script used by the Execute command
+	Script *d_script;
+	ScriptingEnv *d_script_env;
+	QString d_script_error;
+
+	//! Columns modified by the current batch, for each table
+	QHash<QString, QSet<int> > d_modified_columns;
+	QSet<QString> d_modified_matrices;
+	QSet<QString> d_replots;
+};
+
+#endif
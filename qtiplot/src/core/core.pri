@@ -2,6 +2,7 @@
 INCLUDEPATH += src/core/
 
 HEADERS  += src/core/ApplicationWindow.h \
+			src/core/BatchRunner.h \
 			src/core/ConfigDialog.h \
 			src/core/CreateBinMatrixDialog.h \
 			src/core/CustomActionDialog.h \
@@ -13,6 +14,7 @@ HEADERS  += src/core/ApplicationWindow.h \
 			src/core/OpenProjectDialog.h\
 			src/core/PlotWizard.h \
 			src/core/QtiPlotApplication.h \
+			src/core/RemoteControlServer.h \
 			src/core/RenameWindowDialog.h \
 			src/core/globals.h\
 
@@ -24,6 +26,7 @@ HEADERS  += src/core/ApplicationWindow.h \
 }
 
 SOURCES  += src/core/ApplicationWindow.cpp \
+			src/core/BatchRunner.cpp \
 			src/core/ConfigDialog.cpp \
 			src/core/CreateBinMatrixDialog.cpp \
 			src/core/CustomActionDialog.cpp \
@@ -34,4 +37,5 @@ SOURCES  += src/core/ApplicationWindow.cpp \
 			src/core/OpenProjectDialog.cpp\
 			src/core/PlotWizard.cpp \
 			src/core/QtiPlotApplication.cpp \
+			src/core/RemoteControlServer.cpp \
 			src/core/RenameWindowDialog.cpp \
@@ -34,6 +34,9 @@ const int min_version = 9;
 const int patch_version = 8;
 //! Extra version information string (like "alpha", "-2", etc...)
 const char * extra_version = ".10";
+//! Version of the project file format, written in the file headers instead of the program version:
+//! 0.9.9 project files store identical table column data only once (ColumnHash and SharedColumn lines)
+const char * project_file_version = "0.9.9";
 const char * svn_revision = " svn 2394";//SVN_REVISION;  //SRB: SVN_REVISION set by compiler from QTIPLOT_SVN_REVISION environment variable. (10/1/2010 )
 
 //! Copyright string containing the author names
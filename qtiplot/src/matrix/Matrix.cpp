@@ -1608,6 +1608,23 @@ void Matrix::resetView()
     }
 }
 
+void Matrix::notifyChanges()
+{
+	resetView();
+	emit modifiedWindow(this);
+	modifiedData(this);
+}
+
+void Matrix::pasteArray(const QByteArray& values, int rows, int cols)
+{
+	double *data = d_matrix_model->dataVector();
+	if (!data || rows != numRows() || cols != numCols() || values.size() != (int)(rows*cols*sizeof(double)))
+		return;
+
+	memcpy(data, values.constData(), values.size());
+	notifyChanges();
+}
+
 void Matrix::setHeaderViewType(HeaderViewType type)
 {
     if (d_header_view_type == type)
@@ -335,6 +335,10 @@ public slots:
 
 	bool canCalculate(bool useMuParser = true);
 	void notifyModifiedData(){emit modifiedData(this);};
+	//! Refreshes the view and notifies dependent plots after the data buffer was modified directly
+	void notifyChanges();
+	//! Replaces all values with the rows*cols doubles in \a values, ignored if the dimensions of the matrix changed
+	void pasteArray(const QByteArray& values, int rows, int cols);
 
 signals:
 	void modifiedData(Matrix *);
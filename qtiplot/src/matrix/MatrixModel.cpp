@@ -29,11 +29,17 @@
 #include <QtGui>
 #include <QFile>
 #include <QTextStream>
+#if QT_VERSION >= 0x040400
+#include <QtConcurrentRun>
+#include <QFuture>
+#endif
 
 #include <Matrix.h>
 #include <MatrixModel.h>
 #include <MatrixCommand.h>
 #include <muParserScript.h>
+#include <muParserScripting.h>
+#include <MyParser.h>
 #include <ScriptingEnv.h>
 #include <fft2D.h>
 
@@ -373,10 +379,15 @@ bool MatrixModel::canResize(int rows, int cols)
 		return true;
 	}
 
+	memoryErrorMessage();
+	return false;
+}
+
+void MatrixModel::memoryErrorMessage()
+{
 	QApplication::restoreOverrideCursor();
 	QMessageBox::critical(d_matrix, tr("QtiPlot") + " - " + tr("Memory Allocation Error"),
 	tr("Not enough memory, operation aborted!"));
-	return false;
 }
 
 bool MatrixModel::removeColumns(int column, int count, const QModelIndex & parent)
@@ -722,9 +733,7 @@ bool MatrixModel::initWorkspace()
 	if (!d_inv_perm)
 		d_inv_perm = gsl_permutation_alloc(d_cols);
 	if (!d_direct_matrix || !d_inv_matrix || !d_inv_perm){
-		QApplication::restoreOverrideCursor();
-		QMessageBox::critical(d_matrix, tr("QtiPlot") + " - " + tr("Memory Allocation Error"),
-		tr("Not enough memory, operation aborted!"));
+		memoryErrorMessage();
 		return false;
 	}
 	return true;
@@ -805,6 +814,170 @@ double * MatrixModel::dataCopy(int startRow, int endRow, int startCol, int endCo
 	return buffer;
 }
 
+//! Values shared by the threads evaluating a matrix formula in MatrixModel::compiledCalculate()
+struct MatrixCalculation
+{
+	double *data;
+	int cols;
+	int startCol, endCol, endRow;
+	//! Row increment of each thread
+	int step;
+	double y_start, dy;
+	//! Values of x and of the column index for the calculated columns
+	const double *x, *colIndex;
+	//! Master seed of the random numbers, see muParserScripting::setRandomSeed()
+	unsigned long seed;
+	QAtomicInt rowsDone;
+	QAtomicInt canceled;
+};
+
+//! Parser and variables of a thread evaluating a matrix formula
+struct MatrixRowsCalculation
+{
+	MyParser parser;
+	double i, row, j, col, x, y;
+	//! First row computed by the thread, the next ones are obtained adding MatrixCalculation::step
+	int startRow;
+	//! Index of the thread, seeding its random numbers
+	int block;
+};
+
+static void calculateMatrixRows(MatrixCalculation *calc, MatrixRowsCalculation *task)
+{
+	int n = calc->endCol - calc->startCol + 1;
+	double * const vars[] = {&task->x, &task->j, &task->col};
+	const double * const arrays[] = {calc->x, calc->colIndex, calc->colIndex};
+	//each thread has its own random number generator
+	muParserScripting::setRandomSeed(calc->seed, task->block);
+	for (int row = task->startRow; row <= calc->endRow && !calc->canceled; row += calc->step){
+		double r = row + 1.0;
+		task->i = r; task->row = r;
+		task->y = calc->y_start + row*calc->dy;
+		task->parser.EvalBatch(vars, arrays, 3, calc->data + row*calc->cols + calc->startCol, n);
+		calc->rowsDone.ref();
+	}
+	muParserScripting::setRandomSeed(0);
+}
+
+bool MatrixModel::compiledCalculate(const QString& formula, int startRow, int endRow, int startCol, int endCol, bool& canceled)
+{
+	canceled = false;
+
+	int rows = endRow - startRow + 1;
+	int cols = endCol - startCol + 1;
+	if (rows <= 0 || cols <= 0)
+		return false;
+
+	int threads = 1;
+	double *backup = 0;
+#if QT_VERSION >= 0x040400
+	if (rows*cols >= 10000)
+		threads = qMax(1, qMin(QThread::idealThreadCount(), rows));
+	//the threaded calculation can be canceled: the values are then restored from a copy
+	if (threads > 1){
+		backup = dataCopy(startRow, endRow, startCol, endCol);
+		if (!backup)
+			threads = 1;
+	}
+#endif
+
+	double dx = d_matrix->dx();
+	QVector<double> x(cols), colIndex(cols);
+	for (int col = startCol; col <= endCol; col++){
+		x[col - startCol] = d_matrix->xStart() + col*dx;
+		colIndex[col - startCol] = col + 1.0;
+	}
+
+	MatrixCalculation calc;
+	calc.data = d_data;
+	calc.cols = d_cols;
+	calc.startCol = startCol;
+	calc.endCol = endCol;
+	calc.endRow = endRow;
+	calc.step = threads;
+	calc.y_start = d_matrix->yStart();
+	calc.dy = d_matrix->dy();
+	calc.x = x.data();
+	calc.colIndex = colIndex.data();
+	calc.seed = (unsigned long)time(NULL);
+	calc.rowsDone = 0;
+	calc.canceled = 0;
+
+	//the parsers are created in the GUI thread, since MyParser reads the locale of the application widgets
+	QList<MatrixRowsCalculation *> tasks;
+	for (int k = 0; k < threads; k++){
+		MatrixRowsCalculation *task = new MatrixRowsCalculation;
+		tasks << task;
+		task->startRow = startRow + k;
+		task->block = k;
+
+		double r = startRow + 1.0, c = startCol + 1.0;
+		task->i = r; task->row = r;
+		task->j = c; task->col = c;
+		task->x = x[0];
+		task->y = calc.y_start + startRow*calc.dy;
+
+		MyParser *parser = &task->parser;
+		parser->addGSLConstants();
+		parser->DefineVar("i", &task->i);
+		parser->DefineVar("row", &task->row);
+		parser->DefineVar("j", &task->j);
+		parser->DefineVar("col", &task->col);
+		parser->DefineVar("x", &task->x);
+		parser->DefineVar("y", &task->y);
+		try {
+			parser->SetExpr(formula.ascii());
+			//the first evaluation validates the expression, the second one compiles it
+			parser->Eval();
+			parser->Eval();
+		} catch (mu::ParserError &){
+			qDeleteAll(tasks);
+			free(backup);
+			return false;
+		}
+
+		if (!parser->isCompiled()){
+			qDeleteAll(tasks);
+			free(backup);
+			return false;
+		}
+	}
+
+#if QT_VERSION >= 0x040400
+	if (threads > 1){
+		QList<QFuture<void> > futures;
+		foreach(MatrixRowsCalculation *task, tasks)
+			futures << QtConcurrent::run(calculateMatrixRows, &calc, task);
+
+		QProgressDialog progress(d_matrix);
+		progress.setWindowTitle(tr("QtiPlot") + " - " + tr("Calculating values..."));
+		progress.setLabelText(d_matrix->objectName());
+		progress.setWindowModality(Qt::ApplicationModal);
+		progress.setRange(0, rows);
+
+		QTimer timer;
+		timer.start(100);
+		foreach(QFuture<void> future, futures){
+			while (!future.isFinished()){
+				if (progress.wasCanceled())
+					calc.canceled = 1;
+				progress.setValue(calc.rowsDone);
+				qApp->processEvents(QEventLoop::WaitForMoreEvents);
+			}
+		}
+		progress.setValue(rows);
+	} else
+#endif
+		calculateMatrixRows(&calc, tasks[0]);
+
+	canceled = calc.canceled;
+	if (canceled)
+		pasteData(backup, startRow, startCol, rows, cols);
+	free(backup);
+	qDeleteAll(tasks);
+	return true;
+}
+
 bool MatrixModel::muParserCalculate(int startRow, int endRow, int startCol, int endCol)
 {
 	if (d_matrix->formula().count("\n") > 0){
@@ -845,12 +1018,21 @@ bool MatrixModel::muParserCalculate(int startRow, int endRow, int startCol, int
 
 	if (!mup->compile()){
 		QApplication::restoreOverrideCursor();
+		delete mup;
 		return false;
 	}
 
 	QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
 
-	if (mup->codeLines() == 1){
+	bool canceled = false;
+	if (mup->codeLines() == 1 && compiledCalculate(mup->codeLine(0), startRow, endRow, startCol, endCol, canceled)){
+		if (canceled){
+			d_calculated_values = false;
+			QApplication::restoreOverrideCursor();
+			delete mup;
+			return false;
+		}
+	} else if (mup->codeLines() == 1){
 		for(int row = startRow; row <= endRow; row++){
 			double r = row + 1.0;
 			*ri = r; *rr = r;
@@ -887,6 +1069,7 @@ bool MatrixModel::muParserCalculate(int startRow, int endRow, int startCol, int
 	d_calculated_values = (fabs(endRow - startRow) + 1 == d_rows && fabs(endCol - startCol) + 1 == d_cols);
 
 	QApplication::restoreOverrideCursor();
+	delete mup;
 	return true;
 }
 
@@ -959,11 +1142,14 @@ void MatrixModel::fft(bool inverse)
 	int height = d_rows;
 
 	double **x_int_re = Matrix::allocateMatrixData(height, width); /* real coeff matrix */
-	if (!x_int_re)
+	if (!x_int_re){
+		memoryErrorMessage();
 		return;
+	}
 	double **x_int_im = Matrix::allocateMatrixData(height, width); /* imaginary coeff  matrix*/
 	if (!x_int_im){
 		Matrix::freeMatrixData(x_int_re, height);
+		memoryErrorMessage();
 		return;
 	}
 
@@ -980,14 +1166,17 @@ void MatrixModel::fft(bool inverse)
 	if (inverse){
 		double **x_fin_re = Matrix::allocateMatrixData(height, width);
 		double **x_fin_im = Matrix::allocateMatrixData(height, width);
-		if (!x_fin_re || !x_fin_im){
+		if (!x_fin_re || !x_fin_im || !fft2d_inv(x_int_re, x_int_im, x_fin_re, x_fin_im, width, height)){
 			Matrix::freeMatrixData(x_int_re, height);
 			Matrix::freeMatrixData(x_int_im, height);
-			QApplication::restoreOverrideCursor();
+			if (x_fin_re)
+				Matrix::freeMatrixData(x_fin_re, height);
+			if (x_fin_im)
+				Matrix::freeMatrixData(x_fin_im, height);
+			memoryErrorMessage();
 			return;
 		}
 
-		fft2d_inv(x_int_re, x_int_im, x_fin_re, x_fin_im, width, height);
 		cell = 0;
 		for (int i = 0; i < height; i++){
 			for (int j = 0; j < width; j++){
@@ -999,7 +1188,12 @@ void MatrixModel::fft(bool inverse)
 		Matrix::freeMatrixData(x_fin_re, height);
 		Matrix::freeMatrixData(x_fin_im, height);
 	} else {
-		fft2d(x_int_re, x_int_im, width, height);
+		if (!fft2d(x_int_re, x_int_im, width, height)){
+			Matrix::freeMatrixData(x_int_re, height);
+			Matrix::freeMatrixData(x_int_im, height);
+			memoryErrorMessage();
+			return;
+		}
 		cell = 0;
 		for (int i = 0; i < height; i++){
 			for (int j = 0; j < width; j++){
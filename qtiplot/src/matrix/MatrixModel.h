@@ -85,6 +85,8 @@ public:
 	bool setData(const QModelIndex & index, const QVariant & value, int role);
 
 	double* dataVector(){return d_data;};
+	//! Returns the number of values the data vector can hold
+	int dataVectorSize() const {return d_data_block_size.width()*d_data_block_size.height();};
 	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 
 	void setImage(const QImage& image);
@@ -114,6 +116,15 @@ public:
 
 private:
 	void init();
+	//! Restores the cursor and tells the user that there is not enough memory for the current operation
+	void memoryErrorMessage();
+	//! Evaluates a single line formula for the given range using compiled parsers, one per thread.
+	/**
+	 * Returns false if the formula can't be compiled (e.g. it calls cell()), in which case
+	 * the caller must evaluate it with a muParserScript. Sets canceled if the user stopped the calculation,
+	 * the values of the range being left unchanged.
+	 */
+	bool compiledCalculate(const QString& formula, int startRow, int endRow, int startCol, int endCol, bool& canceled);
 	int d_rows, d_cols;
 	double *d_data;
 	Matrix *d_matrix;
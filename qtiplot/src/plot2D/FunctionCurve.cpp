@@ -32,6 +32,7 @@
 #include <ScaleEngine.h>
 
 #include <QMessageBox>
+#include <QVector>
 
 FunctionCurve::FunctionCurve(const QString& name):
 	PlotCurve(name),
@@ -264,19 +265,16 @@ bool FunctionCurve::loadData(int points, bool xLog10Scale)
 				for (int i = 1; i < lastButOne; i++ ){
 					x = d_from*pow(10, i*step);
 					X[i] = x;
-					try {
-						Y[i] = parser.EvalRemoveSingularity(&x, false);
-					} catch (MyParser::Pole){}
 				}
 			} else {
 				for (int i = 1; i < lastButOne; i++ ){
 					x += step;
 					X[i] = x;
-					try {
-						Y[i] = parser.EvalRemoveSingularity(&x, false);
-					} catch (MyParser::Pole){}
 				}
 			}
+			try {
+				parser.EvalBatchRemoveSingularity(&x, X + 1, Y + 1, lastButOne - 1, false);
+			} catch (MyParser::Pole){}
 			//the last point might be outside the interval, therefore we calculate it separately at its precise value
 			x = d_to;
 			X[lastButOne] = x;
@@ -307,12 +305,14 @@ bool FunctionCurve::loadData(int points, bool xLog10Scale)
 			yparser.DefineVar(d_variable.ascii(), &par);
 			xparser.SetExpr(aux[0].ascii());
 			yparser.SetExpr(aux[1].ascii());
+			QVector<double> parameters(points);
 			par = d_from;
 			for (int i = 0; i<points; i++ ){
-				X[i] = xparser.Eval();
-				Y[i] = yparser.Eval();
+				parameters[i] = par;
 				par += step;
 			}
+			xparser.EvalBatch(&par, parameters.data(), X, points);
+			yparser.EvalBatch(&par, parameters.data(), Y, points);
 		} catch(mu::ParserError &) {}
 	}
 
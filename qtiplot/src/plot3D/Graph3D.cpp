@@ -63,22 +63,36 @@ double ConstFunction::operator()(double x, double y)
 }
 
 UserFunction::UserFunction(const QString& s, Qwt3D::Curve *pw)
-: Function(pw), formula(s)
+: Function(pw), formula(s),
+d_parser(0),
+d_x(0.0),
+d_y(0.0),
+d_error(false)
 {}
 
+UserFunction::~UserFunction()
+{
+	delete d_parser;
+}
+
 double UserFunction::operator()(double x, double y)
 {
-	if (formula.isEmpty())
+	if (formula.isEmpty() || d_error)
 		return 0.0;
 
-	MyParser parser;
 	double result = 0.0;
 	try {
-		parser.DefineVar("x", &x);
-		parser.DefineVar("y", &y);
-		parser.SetExpr((const std::string)formula.ascii());
-		result = parser.Eval();
+		if (!d_parser){
+			d_parser = new MyParser();
+			d_parser->DefineVar("x", &d_x);
+			d_parser->DefineVar("y", &d_y);
+			d_parser->SetExpr((const std::string)formula.ascii());
+		}
+		d_x = x;
+		d_y = y;
+		result = d_parser->Eval();
 	} catch(mu::ParserError &e){
+		d_error = true;
 		QMessageBox::critical(0, "QtiPlot - Input function error", QString::fromStdString(e.GetMsg()));
 	}
 	return result;
@@ -96,9 +110,22 @@ UserParametricSurface::UserParametricSurface(const QString& xFormula, const QStr
 : ParametricSurface(pw),
 d_x_formula(xFormula),
 d_y_formula(yFormula),
-d_z_formula(zFormula)
+d_z_formula(zFormula),
+d_x_parser(0),
+d_y_parser(0),
+d_z_parser(0),
+d_u(0.0),
+d_v(0.0),
+d_error(false)
 {}
 
+UserParametricSurface::~UserParametricSurface()
+{
+	delete d_x_parser;
+	delete d_y_parser;
+	delete d_z_parser;
+}
+
 void UserParametricSurface::setDomain(double ul, double ur, double vl, double vr)
 {
 	ParametricSurface::setDomain(ul, ur, vl, vr);
@@ -128,19 +155,30 @@ Triple UserParametricSurface::operator()(double u, double v)
 		return Triple(0.0, 0.0, 0.0);
 
 	double x = 0.0, y = 0.0, z = 0.0;
-	MyParser parser;
+	if (d_error)
+		return Triple(x, y, z);
+
 	try{
-		parser.DefineVar("u", &u);
-		parser.DefineVar("v", &v);
+		if (!d_x_parser){
+			MyParser **parsers[] = {&d_x_parser, &d_y_parser, &d_z_parser};
+			const QString formulas[] = {d_x_formula, d_y_formula, d_z_formula};
+			for (int i = 0; i < 3; i++){
+				MyParser *parser = new MyParser();
+				*parsers[i] = parser;
+				parser->DefineVar("u", &d_u);
+				parser->DefineVar("v", &d_v);
+				parser->SetExpr((const std::string)formulas[i].ascii());
+			}
+		}
 
-		parser.SetExpr((const std::string)d_x_formula.ascii());
-		x = parser.Eval();
-		parser.SetExpr((const std::string)d_y_formula.ascii());
-		y = parser.Eval();
-		parser.SetExpr((const std::string)d_z_formula.ascii());
-		z = parser.Eval();
+		d_u = u;
+		d_v = v;
+		x = d_x_parser->Eval();
+		y = d_y_parser->Eval();
+		z = d_z_parser->Eval();
 	}
 	catch(mu::ParserError &e){
+		d_error = true;
 		QMessageBox::critical(0, "QtiPlot - Input function error", QString::fromStdString(e.GetMsg()));
 	}
 	return Triple(x, y, z);
@@ -45,6 +45,7 @@ using namespace Qwt3D;
 class QTextDocument;
 class UserFunction;
 class UserParametricSurface;
+class MyParser;
 class ConstFunction;
 
 /*!\brief 3D graph widget.
@@ -457,6 +458,7 @@ class UserFunction : public Function
 {
 public:
 	UserFunction(const QString& s, Qwt3D::Curve *pw);
+	~UserFunction();
 
     double operator()(double x, double y);
 	QString function(){return formula;};
@@ -466,8 +468,15 @@ public:
 	void setMesh (unsigned int columns, unsigned int rows);
 
 private:
+	  //! The parser is owned by the function and bound to its variables, so it can't be copied
+	  Q_DISABLE_COPY(UserFunction)
+
 	  QString formula;
 	  unsigned int d_rows, d_columns;
+	  //! Parser reused for all the points of the mesh
+	  MyParser *d_parser;
+	  double d_x, d_y;
+	  bool d_error;
 };
 
 //! Class for user defined parametric surfaces
@@ -476,6 +485,7 @@ class UserParametricSurface : public ParametricSurface
 public:
     UserParametricSurface(const QString& xFormula, const QString& yFormula,
 						  const QString& zFormula, Qwt3D::Curve *pw);
+	~UserParametricSurface();
     Triple operator()(double u, double v);
 
 	unsigned int rows(){return d_rows;};
@@ -497,9 +507,16 @@ public:
 	QString zFormula(){return d_z_formula;};
 
 private:
+	//! The parsers are owned by the surface and bound to its variables, so it can't be copied
+	Q_DISABLE_COPY(UserParametricSurface)
+
 	QString d_x_formula, d_y_formula, d_z_formula;
 	unsigned int d_rows, d_columns;
 	bool d_u_periodic, d_v_periodic;
 	double d_ul, d_ur, d_vl, d_vr;
+	//! Parsers reused for all the points of the mesh
+	MyParser *d_x_parser, *d_y_parser, *d_z_parser;
+	double d_u, d_v;
+	bool d_error;
 };
 #endif // Plot3D_H
@@ -0,0 +1,1327 @@
+/***************************************************************************
+	File                 : CompiledExpression.cpp
+	Project              : QtiPlot
+	--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Compiled form of a muParser expression
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#include "CompiledExpression.h"
+
+#include <algorithm>
+#include <locale>
+#include <sstream>
+#include <cctype>
+#include <cstring>
+#include <math.h>
+
+// built-in functions of muParser, implemented the same way as in the muParser library
+static double mu_sin(double v){return sin(v);}
+static double mu_cos(double v){return cos(v);}
+static double mu_tan(double v){return tan(v);}
+static double mu_asin(double v){return asin(v);}
+static double mu_acos(double v){return acos(v);}
+static double mu_atan(double v){return atan(v);}
+static double mu_sinh(double v){return sinh(v);}
+static double mu_cosh(double v){return cosh(v);}
+static double mu_tanh(double v){return tanh(v);}
+static double mu_asinh(double v){return log(v + sqrt(v*v + 1));}
+static double mu_acosh(double v){return log(v + sqrt(v*v - 1));}
+static double mu_atanh(double v){return 0.5*log((1 + v)/(1 - v));}
+static double mu_log2(double v){return log(v)/log(2.0);}
+static double mu_log10(double v){return log10(v);}
+static double mu_ln(double v){return log(v);}
+static double mu_exp(double v){return exp(v);}
+static double mu_sqrt(double v){return sqrt(v);}
+static double mu_sign(double v){return (double)((v < 0) ? -1 : (v > 0) ? 1 : 0);}
+static double mu_rint(double v){return floor(v + 0.5);}
+static double mu_abs(double v){return fabs(v);}
+
+struct BuiltInFunction
+{
+	const char *name;
+	CompiledExpression::Function1 fun;
+	//! C source of the function body, see CompiledExpression::cFunctions()
+	const char *source;
+};
+
+static const BuiltInFunction builtin_functions[] = {
+	{"sin", mu_sin, "sin(v)"}, {"cos", mu_cos, "cos(v)"}, {"tan", mu_tan, "tan(v)"},
+	{"asin", mu_asin, "asin(v)"}, {"acos", mu_acos, "acos(v)"}, {"atan", mu_atan, "atan(v)"},
+	{"sinh", mu_sinh, "sinh(v)"}, {"cosh", mu_cosh, "cosh(v)"}, {"tanh", mu_tanh, "tanh(v)"},
+	{"asinh", mu_asinh, "log(v + sqrt(v*v + 1))"}, {"acosh", mu_acosh, "log(v + sqrt(v*v - 1))"},
+	{"atanh", mu_atanh, "0.5*log((1 + v)/(1 - v))"},
+	{"log2", mu_log2, "log(v)/log(2.0)"}, {"log10", mu_log10, "log10(v)"}, {"ln", mu_ln, "log(v)"},
+	{"exp", mu_exp, "exp(v)"}, {"sqrt", mu_sqrt, "sqrt(v)"}, {"sign", mu_sign, "(double)((v < 0) ? -1 : (v > 0) ? 1 : 0)"},
+	{"rint", mu_rint, "floor(v + 0.5)"}, {"abs", mu_abs, "fabs(v)"},
+	{0, 0, 0}
+};
+
+//! Functions of the C math library which can be called by the programs
+struct LibraryFunction
+{
+	const char *name;
+	CompiledExpression::Function1 fun;
+};
+
+static const LibraryFunction library_functions[] = {
+	{"floor", (CompiledExpression::Function1)floor}, {"ceil", (CompiledExpression::Function1)ceil},
+	{"erf", (CompiledExpression::Function1)erf}, {"erfc", (CompiledExpression::Function1)erfc},
+	{0, 0}
+};
+
+static bool isNameChar(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+CompiledExpression::CompiledExpression()
+: d_root(-1),
+d_stack_size(0),
+d_pos(0)
+{}
+
+void CompiledExpression::defineFunction(const std::string& name, Function1 f, bool optimizable)
+{
+	Callback c = {1, f, 0, 0, optimizable};
+	d_functions[name] = c;
+}
+
+void CompiledExpression::defineFunction(const std::string& name, Function2 f, bool optimizable)
+{
+	Callback c = {2, 0, f, 0, optimizable};
+	d_functions[name] = c;
+}
+
+void CompiledExpression::defineFunction(const std::string& name, Function3 f, bool optimizable)
+{
+	Callback c = {3, 0, 0, f, optimizable};
+	d_functions[name] = c;
+}
+
+void CompiledExpression::defineVariable(const std::string& name, int index)
+{
+	d_variables[name] = index;
+}
+
+void CompiledExpression::defineConstant(const std::string& name, double value)
+{
+	d_constants[name] = value;
+}
+
+void CompiledExpression::clearVariables()
+{
+	d_variables.clear();
+	d_constants.clear();
+}
+
+void CompiledExpression::clear()
+{
+	d_nodes.clear();
+	d_root = -1;
+	d_code.clear();
+	d_stack_size = 0;
+}
+
+bool CompiledExpression::compile(const std::string& formula, const Dialect& dialect)
+{
+	clear();
+
+	d_formula = formula;
+	d_pos = 0;
+	d_dialect = dialect;
+
+	int root = parseTernary();
+	skipSpaces();
+	if (root < 0 || d_pos != d_formula.size()){
+		clear();
+		return false;
+	}
+
+	root = fold(root);
+
+	std::vector<Instruction> code;
+	int depth = 0, maxDepth = 0;
+	if (!emit(root, code, depth, maxDepth)){
+		clear();
+		return false;
+	}
+
+	d_code = code;
+	d_stack_size = maxDepth;
+	d_root = root;
+	return true;
+}
+
+bool CompiledExpression::derivative(int variable, CompiledExpression& result) const
+{
+	result = *this;
+	result.d_code.clear();
+	if (d_code.empty() || d_root < 0)
+		return false;
+
+	int root = result.diff(d_root, variable);
+	if (root < 0){
+		result.clear();
+		return false;
+	}
+
+	root = result.fold(root);
+
+	std::vector<Instruction> code;
+	int depth = 0, maxDepth = 0;
+	if (!result.emit(root, code, depth, maxDepth)){
+		result.clear();
+		return false;
+	}
+
+	result.d_code = code;
+	result.d_stack_size = maxDepth;
+	result.d_root = root;
+	return true;
+}
+
+double CompiledExpression::run(const std::vector<Instruction>& code, const double * const *vars)
+{
+	double stack[MaxStackSize];
+	int top = -1;
+
+	const Instruction *begin = &code[0];
+	const Instruction *end = begin + code.size();
+	for (const Instruction *ins = begin; ins != end; ++ins){
+		switch(ins->code){
+			case Jump:
+				ins = begin + ins->arg - 1;
+				break;
+			case JumpIfZero:
+				if (stack[top--] == 0)
+					ins = begin + ins->arg - 1;
+				break;
+			case PushConst:
+				stack[++top] = ins->value;
+				break;
+			case PushVar:
+				stack[++top] = *vars[ins->arg];
+				break;
+			case Neg:
+				stack[top] = -stack[top];
+				break;
+			case Add:
+				--top;
+				stack[top] = stack[top] + stack[top + 1];
+				break;
+			case Sub:
+				--top;
+				stack[top] = stack[top] - stack[top + 1];
+				break;
+			case Mul:
+				--top;
+				stack[top] = stack[top] * stack[top + 1];
+				break;
+			case Div:
+				--top;
+				stack[top] = stack[top] / stack[top + 1];
+				break;
+			case Pow:
+				--top;
+				stack[top] = pow(stack[top], stack[top + 1]);
+				break;
+			case Less:
+				--top;
+				stack[top] = stack[top] < stack[top + 1];
+				break;
+			case Greater:
+				--top;
+				stack[top] = stack[top] > stack[top + 1];
+				break;
+			case LessEq:
+				--top;
+				stack[top] = stack[top] <= stack[top + 1];
+				break;
+			case GreaterEq:
+				--top;
+				stack[top] = stack[top] >= stack[top + 1];
+				break;
+			case Equal:
+				--top;
+				stack[top] = stack[top] == stack[top + 1];
+				break;
+			case NotEqual:
+				--top;
+				stack[top] = stack[top] != stack[top + 1];
+				break;
+			case And:
+				--top;
+				stack[top] = (stack[top] != 0) && (stack[top + 1] != 0);
+				break;
+			case Or:
+				--top;
+				stack[top] = (stack[top] != 0) || (stack[top + 1] != 0);
+				break;
+			case Xor:
+				--top;
+				stack[top] = (stack[top] != 0) ^ (stack[top + 1] != 0);
+				break;
+			case Call1:
+				stack[top] = ins->f1(stack[top]);
+				break;
+			case Call2:
+				--top;
+				stack[top] = ins->f2(stack[top], stack[top + 1]);
+				break;
+			case Call3:
+				top -= 2;
+				stack[top] = ins->f3(stack[top], stack[top + 1], stack[top + 2]);
+				break;
+			case Min:
+			case Max:
+			case Sum:
+			case Avg:
+			{
+				top -= ins->arg - 1;
+				double res = stack[top];
+				for (int i = 1; i < ins->arg; i++){
+					double v = stack[top + i];
+					if (ins->code == Min)
+						res = std::min(res, v);
+					else if (ins->code == Max)
+						res = std::max(res, v);
+					else
+						res += v;
+				}
+				if (ins->code == Avg)
+					res /= (double)ins->arg;
+				stack[top] = res;
+				break;
+			}
+		}
+	}
+	return stack[0];
+}
+
+bool CompiledExpression::hasJumps(const std::vector<Instruction>& code)
+{
+	for (int k = 0; k < (int)code.size(); k++){
+		if (code[k].code == Jump || code[k].code == JumpIfZero)
+			return true;
+	}
+	return false;
+}
+
+void CompiledExpression::evalBatch(const double * const *vars, const double * const *arrays, int n, double *out) const
+{
+	if (d_code.empty() || n <= 0)
+		return;
+
+	if (hasJumps(d_code)){
+		// only the selected branch of a conditional expression is evaluated, so the points are evaluated one by one
+		int count = 0;
+		for (int k = 0; k < (int)d_code.size(); k++){
+			if (d_code[k].code == PushVar)
+				count = std::max(count, d_code[k].arg + 1);
+		}
+		std::vector<double> values(count);
+		std::vector<const double *> pointers(count);
+		for (int k = 0; k < count; k++)
+			pointers[k] = arrays[k] ? &values[k] : vars[k];
+
+		for (int i = 0; i < n; i++){
+			for (int k = 0; k < count; k++){
+				if (arrays[k])
+					values[k] = arrays[k][i];
+			}
+			out[i] = run(d_code, count ? &pointers[0] : vars);
+		}
+		return;
+	}
+
+	std::vector<double> stack(d_stack_size*BlockSize);
+	for (int offset = 0; offset < n; offset += BlockSize)
+		runBlock(&stack[0], vars, arrays, offset, std::min((int)BlockSize, n - offset), out + offset);
+}
+
+void CompiledExpression::runBlock(double *stack, const double * const *vars, const double * const *arrays,
+								int offset, int size, double *out) const
+{
+	// each stack level holds a whole block of values
+	int top = -1;
+
+	const Instruction *end = &d_code[0] + d_code.size();
+	for (const Instruction *ins = &d_code[0]; ins != end; ++ins){
+		double *b = stack + std::max(top, 0)*BlockSize;
+		double *a = stack + std::max(top - 1, 0)*BlockSize;
+		switch(ins->code){
+			case PushConst:
+				b = stack + (++top)*BlockSize;
+				std::fill(b, b + size, ins->value);
+				break;
+			case PushVar:
+				b = stack + (++top)*BlockSize;
+				if (arrays[ins->arg])
+					memcpy(b, arrays[ins->arg] + offset, size*sizeof(double));
+				else
+					std::fill(b, b + size, *vars[ins->arg]);
+				break;
+			case Neg:
+				for (int i = 0; i < size; i++)
+					b[i] = -b[i];
+				break;
+			case Add:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] + b[i];
+				top--;
+				break;
+			case Sub:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] - b[i];
+				top--;
+				break;
+			case Mul:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] * b[i];
+				top--;
+				break;
+			case Div:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] / b[i];
+				top--;
+				break;
+			case Pow:
+				for (int i = 0; i < size; i++)
+					a[i] = pow(a[i], b[i]);
+				top--;
+				break;
+			case Less:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] < b[i];
+				top--;
+				break;
+			case Greater:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] > b[i];
+				top--;
+				break;
+			case LessEq:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] <= b[i];
+				top--;
+				break;
+			case GreaterEq:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] >= b[i];
+				top--;
+				break;
+			case Equal:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] == b[i];
+				top--;
+				break;
+			case NotEqual:
+				for (int i = 0; i < size; i++)
+					a[i] = a[i] != b[i];
+				top--;
+				break;
+			case And:
+				for (int i = 0; i < size; i++)
+					a[i] = (a[i] != 0) && (b[i] != 0);
+				top--;
+				break;
+			case Or:
+				for (int i = 0; i < size; i++)
+					a[i] = (a[i] != 0) || (b[i] != 0);
+				top--;
+				break;
+			case Xor:
+				for (int i = 0; i < size; i++)
+					a[i] = (a[i] != 0) ^ (b[i] != 0);
+				top--;
+				break;
+			case Call1:
+				for (int i = 0; i < size; i++)
+					b[i] = ins->f1(b[i]);
+				break;
+			case Call2:
+				for (int i = 0; i < size; i++)
+					a[i] = ins->f2(a[i], b[i]);
+				top--;
+				break;
+			case Call3:
+			{
+				double *c = stack + (top - 2)*BlockSize;
+				for (int i = 0; i < size; i++)
+					c[i] = ins->f3(c[i], a[i], b[i]);
+				top -= 2;
+				break;
+			}
+			case Min:
+			case Max:
+			case Sum:
+			case Avg:
+			{
+				top -= ins->arg - 1;
+				double *first = stack + top*BlockSize;
+				for (int k = 1; k < ins->arg; k++){
+					const double *v = first + k*BlockSize;
+					if (ins->code == Min){
+						for (int i = 0; i < size; i++)
+							first[i] = std::min(first[i], v[i]);
+					} else if (ins->code == Max){
+						for (int i = 0; i < size; i++)
+							first[i] = std::max(first[i], v[i]);
+					} else {
+						for (int i = 0; i < size; i++)
+							first[i] += v[i];
+					}
+				}
+				if (ins->code == Avg){
+					for (int i = 0; i < size; i++)
+						first[i] /= (double)ins->arg;
+				}
+				break;
+			}
+		}
+	}
+	memcpy(out, stack, size*sizeof(double));
+}
+
+std::string CompiledExpression::cFunctions()
+{
+	std::string source;
+	for (const BuiltInFunction *i = builtin_functions; i->name; i++)
+		source += std::string("static double mu_") + i->name + "(double v){return " + i->source + ";}\n";
+	source += "static double mu_min(double a, double b){return (b < a) ? b : a;}\n";
+	source += "static double mu_max(double a, double b){return (a < b) ? b : a;}\n";
+	return source;
+}
+
+bool CompiledExpression::writeC(const std::vector<std::string>& names, std::string& source) const
+{
+	if (d_code.empty() || d_root < 0)
+		return false;
+
+	std::ostringstream out;
+	out.imbue(std::locale::classic());
+	out.precision(17);
+	if (!writeNode(d_root, names, out))
+		return false;
+
+	source = out.str();
+	return true;
+}
+
+bool CompiledExpression::writeNode(int node, const std::vector<std::string>& names, std::ostringstream& out) const
+{
+	static const char *operators[] = {"", "", "", " + ", " - ", "*", "/", "",
+		" < ", " > ", " <= ", " >= ", " == ", " != "};
+
+	const Node& n = d_nodes[node];
+	const std::vector<int>& c = n.children;
+	switch(n.code){
+		case PushConst:
+			if (n.value != n.value || n.value - n.value != 0.0)
+				return false;// not finite
+			out << "(" << n.value << ")";
+			return true;
+		case PushVar:
+			if (n.arg < 0 || n.arg >= (int)names.size())
+				return false;
+			out << names[n.arg];
+			return true;
+		case Neg:
+			out << "(-";
+			if (!writeNode(c[0], names, out))
+				return false;
+			out << ")";
+			return true;
+		case Add:
+		case Sub:
+		case Mul:
+		case Div:
+		case Less:
+		case Greater:
+		case LessEq:
+		case GreaterEq:
+		case Equal:
+		case NotEqual:
+			out << (n.code >= Less ? "(double)(" : "(");
+			if (!writeNode(c[0], names, out))
+				return false;
+			out << operators[n.code];
+			if (!writeNode(c[1], names, out))
+				return false;
+			out << ")";
+			return true;
+		case And:
+		case Or:
+		case Xor:
+			out << "(double)(((";
+			if (!writeNode(c[0], names, out))
+				return false;
+			out << (n.code == And ? ") != 0) && ((" : (n.code == Or ? ") != 0) || ((" : ") != 0) != (("));
+			if (!writeNode(c[1], names, out))
+				return false;
+			out << ") != 0))";
+			return true;
+		case Select:
+			out << "((";
+			if (!writeNode(c[0], names, out))
+				return false;
+			out << ") != 0 ? ";
+			if (!writeNode(c[1], names, out))
+				return false;
+			out << " : ";
+			if (!writeNode(c[2], names, out))
+				return false;
+			out << ")";
+			return true;
+		case Pow:
+			out << "pow(";
+			if (!writeNode(c[0], names, out))
+				return false;
+			out << ", ";
+			if (!writeNode(c[1], names, out))
+				return false;
+			out << ")";
+			return true;
+		case Call1:
+		{
+			std::string name;
+			for (const BuiltInFunction *i = builtin_functions; i->name && name.empty(); i++){
+				if (i->fun == n.f1)
+					name = std::string("mu_") + i->name;
+			}
+			for (const LibraryFunction *i = library_functions; i->name && name.empty(); i++){
+				if (i->fun == n.f1)
+					name = i->name;
+			}
+			if (name.empty())
+				return false;
+
+			out << name << "(";
+			if (!writeNode(c[0], names, out))
+				return false;
+			out << ")";
+			return true;
+		}
+		case Call2:
+			if (n.f2 != (Function2)pow)
+				return false;
+
+			out << "pow(";
+			if (!writeNode(c[0], names, out))
+				return false;
+			out << ", ";
+			if (!writeNode(c[1], names, out))
+				return false;
+			out << ")";
+			return true;
+		case Min:
+		case Max:
+		{
+			// folded from the left, as done by run()
+			for (int i = 1; i < (int)c.size(); i++)
+				out << (n.code == Min ? "mu_min(" : "mu_max(");
+			if (!writeNode(c[0], names, out))
+				return false;
+			for (int i = 1; i < (int)c.size(); i++){
+				out << ", ";
+				if (!writeNode(c[i], names, out))
+					return false;
+				out << ")";
+			}
+			return true;
+		}
+		case Sum:
+		case Avg:
+			out << "((";
+			for (int i = 0; i < (int)c.size(); i++){
+				if (i)
+					out << " + ";
+				if (!writeNode(c[i], names, out))
+					return false;
+			}
+			out << ")";
+			if (n.code == Avg)
+				out << "/" << n.arg << ".0";
+			out << ")";
+			return true;
+		default:
+			return false;
+	}
+}
+
+int CompiledExpression::addNode(int code, int arg, double value)
+{
+	Node n;
+	n.code = code;
+	n.arg = arg;
+	n.value = value;
+	n.f1 = 0;
+	n.f2 = 0;
+	n.f3 = 0;
+	n.optimizable = true;
+	d_nodes.push_back(n);
+	return (int)d_nodes.size() - 1;
+}
+
+int CompiledExpression::addBinaryNode(int code, int left, int right)
+{
+	if (left < 0 || right < 0)
+		return -1;
+
+	int node = addNode(code);
+	d_nodes[node].children.push_back(left);
+	d_nodes[node].children.push_back(right);
+	return node;
+}
+
+bool CompiledExpression::emit(int node, std::vector<Instruction>& code, int& depth, int& maxDepth) const
+{
+	const Node& n = d_nodes[node];
+	if (n.code == Select){
+		// only the selected branch is evaluated, as done by muParser: "x > 0 ? sqrt(x) : 0" must not call sqrt(-1)
+		Instruction jump;
+		jump.code = JumpIfZero;
+		jump.arg = 0;
+		jump.value = 0.0;
+		jump.f3 = 0;
+
+		if (!emit(n.children[0], code, depth, maxDepth))
+			return false;
+		int jumpToElse = (int)code.size();
+		code.push_back(jump);
+		depth--;
+
+		if (!emit(n.children[1], code, depth, maxDepth))
+			return false;
+		int jumpToEnd = (int)code.size();
+		jump.code = Jump;
+		code.push_back(jump);
+		depth--;// the else branch starts from the same stack depth as the then branch
+
+		code[jumpToElse].arg = (int)code.size();
+		if (!emit(n.children[2], code, depth, maxDepth))
+			return false;
+		code[jumpToEnd].arg = (int)code.size();
+		return maxDepth <= MaxStackSize;
+	}
+
+	for (int i = 0; i < (int)n.children.size(); i++){
+		if (!emit(n.children[i], code, depth, maxDepth))
+			return false;
+	}
+
+	Instruction ins;
+	ins.code = n.code;
+	ins.arg = n.arg;
+	ins.value = n.value;
+	if (n.code == Call1)
+		ins.f1 = n.f1;
+	else if (n.code == Call2)
+		ins.f2 = n.f2;
+	else
+		ins.f3 = n.f3;
+	code.push_back(ins);
+
+	depth += 1 - (int)n.children.size();
+	maxDepth = std::max(maxDepth, depth);
+	return maxDepth <= MaxStackSize;
+}
+
+int CompiledExpression::fold(int node)
+{
+	bool constant = d_nodes[node].optimizable;
+	for (int i = 0; i < (int)d_nodes[node].children.size(); i++){
+		int child = fold(d_nodes[node].children[i]);
+		d_nodes[node].children[i] = child;
+		if (d_nodes[child].code != PushConst)
+			constant = false;
+	}
+
+	if (!constant || d_nodes[node].children.empty())
+		return node;
+
+	std::vector<Instruction> code;
+	int depth = 0, maxDepth = 0;
+	if (!emit(node, code, depth, maxDepth))
+		return node;
+
+	return addNode(PushConst, 0, run(code, 0));
+}
+
+bool CompiledExpression::isConstant(int node, double value) const
+{
+	return d_nodes[node].code == PushConst && d_nodes[node].value == value;
+}
+
+int CompiledExpression::negate(int a)
+{
+	if (d_nodes[a].code == PushConst)
+		return constant(-d_nodes[a].value);
+
+	int node = addNode(Neg);
+	d_nodes[node].children.push_back(a);
+	return node;
+}
+
+int CompiledExpression::add(int a, int b)
+{
+	if (isConstant(a, 0.0))
+		return b;
+	if (isConstant(b, 0.0))
+		return a;
+	return addBinaryNode(Add, a, b);
+}
+
+int CompiledExpression::subtract(int a, int b)
+{
+	if (isConstant(b, 0.0))
+		return a;
+	if (isConstant(a, 0.0))
+		return negate(b);
+	return addBinaryNode(Sub, a, b);
+}
+
+int CompiledExpression::multiply(int a, int b)
+{
+	if (isConstant(a, 0.0) || isConstant(b, 0.0))
+		return constant(0.0);
+	if (isConstant(a, 1.0))
+		return b;
+	if (isConstant(b, 1.0))
+		return a;
+	return addBinaryNode(Mul, a, b);
+}
+
+int CompiledExpression::divide(int a, int b)
+{
+	if (isConstant(a, 0.0))
+		return constant(0.0);
+	if (isConstant(b, 1.0))
+		return a;
+	return addBinaryNode(Div, a, b);
+}
+
+int CompiledExpression::call(Function1 f, int a)
+{
+	int node = addNode(Call1);
+	d_nodes[node].f1 = f;
+	d_nodes[node].children.push_back(a);
+	return node;
+}
+
+int CompiledExpression::diff(int node, int variable)
+{
+	// copy the node, d_nodes is reallocated when adding new nodes
+	const Node n = d_nodes[node];
+	if (n.code == PushConst)
+		return constant(0.0);
+	if (n.code == PushVar)
+		return constant(n.arg == variable ? 1.0 : 0.0);
+
+	std::vector<int> d;
+	bool constantChildren = true;
+	for (int i = 0; i < (int)n.children.size(); i++){
+		int child = diff(n.children[i], variable);
+		if (child < 0)
+			return -1;
+		if (!isConstant(child, 0.0))
+			constantChildren = false;
+		d.push_back(child);
+	}
+	if (constantChildren)
+		return constant(0.0);
+
+	int a = n.children.size() > 0 ? n.children[0] : -1;
+	int b = n.children.size() > 1 ? n.children[1] : -1;
+
+	switch(n.code){
+		case Neg:
+			return negate(d[0]);
+		case Add:
+			return add(d[0], d[1]);
+		case Sub:
+			return subtract(d[0], d[1]);
+		case Mul:
+			return add(multiply(d[0], b), multiply(a, d[1]));
+		case Div:
+			return subtract(divide(d[0], b), divide(multiply(a, d[1]), multiply(b, b)));
+		case Pow:
+		{
+			// d(a^b) = b*a^(b - 1)*da + a^b*ln(a)*db
+			int res = constant(0.0);
+			if (!isConstant(d[0], 0.0))
+				res = multiply(multiply(b, addBinaryNode(Pow, a, subtract(b, constant(1.0)))), d[0]);
+			if (!isConstant(d[1], 0.0))
+				res = add(res, multiply(multiply(node, call(mu_ln, a)), d[1]));
+			return res;
+		}
+		case Less:
+		case Greater:
+		case LessEq:
+		case GreaterEq:
+		case Equal:
+		case NotEqual:
+		case And:
+		case Or:
+		case Xor:
+			return constant(0.0);
+		case Select:
+		{
+			int res = addNode(Select);
+			d_nodes[res].children.push_back(a);
+			d_nodes[res].children.push_back(d[1]);
+			d_nodes[res].children.push_back(d[2]);
+			return res;
+		}
+		case Sum:
+		case Avg:
+		{
+			int res = d[0];
+			for (int i = 1; i < (int)d.size(); i++)
+				res = add(res, d[i]);
+			if (n.code == Avg)
+				res = divide(res, constant((double)n.arg));
+			return res;
+		}
+		case Call1:
+		{
+			Function1 f = n.f1;
+			int df = -1;
+			if (f == mu_sin)
+				df = call(mu_cos, a);
+			else if (f == mu_cos)
+				df = negate(call(mu_sin, a));
+			else if (f == mu_tan)
+				df = divide(constant(1.0), multiply(call(mu_cos, a), call(mu_cos, a)));
+			else if (f == mu_asin)
+				df = divide(constant(1.0), call(mu_sqrt, subtract(constant(1.0), multiply(a, a))));
+			else if (f == mu_acos)
+				df = negate(divide(constant(1.0), call(mu_sqrt, subtract(constant(1.0), multiply(a, a)))));
+			else if (f == mu_atan)
+				df = divide(constant(1.0), add(constant(1.0), multiply(a, a)));
+			else if (f == mu_sinh)
+				df = call(mu_cosh, a);
+			else if (f == mu_cosh)
+				df = call(mu_sinh, a);
+			else if (f == mu_tanh)
+				df = subtract(constant(1.0), multiply(node, node));
+			else if (f == mu_asinh)
+				df = divide(constant(1.0), call(mu_sqrt, add(multiply(a, a), constant(1.0))));
+			else if (f == mu_acosh)
+				df = divide(constant(1.0), call(mu_sqrt, subtract(multiply(a, a), constant(1.0))));
+			else if (f == mu_atanh)
+				df = divide(constant(1.0), subtract(constant(1.0), multiply(a, a)));
+			else if (f == mu_log2)
+				df = divide(constant(1.0), multiply(a, constant(log(2.0))));
+			else if (f == mu_log10)
+				df = divide(constant(1.0), multiply(a, constant(log(10.0))));
+			else if (f == mu_ln)
+				df = divide(constant(1.0), a);
+			else if (f == mu_exp)
+				df = node;
+			else if (f == mu_sqrt)
+				df = divide(constant(0.5), node);
+			else if (f == mu_abs)
+				df = call(mu_sign, a);
+			else if (f == mu_sign || f == mu_rint || f == (Function1)floor || f == (Function1)ceil)
+				df = constant(0.0);
+
+			if (df < 0)
+				return -1;
+			return multiply(df, d[0]);
+		}
+		case Call2:
+			if (n.f2 == (Function2)pow){
+				int res = addBinaryNode(Pow, a, b);
+				return diff(res, variable);
+			}
+			return -1;
+		default:
+			return -1;
+	}
+}
+
+void CompiledExpression::skipSpaces()
+{
+	while (d_pos < d_formula.size() && isspace((unsigned char)d_formula[d_pos]))
+		d_pos++;
+}
+
+bool CompiledExpression::match(const char *token)
+{
+	skipSpaces();
+	size_t length = strlen(token);
+	if (d_formula.compare(d_pos, length, token) != 0)
+		return false;
+
+	d_pos += length;
+	return true;
+}
+
+bool CompiledExpression::atWordOperator(const char *word)
+{
+	skipSpaces();
+	size_t length = strlen(word);
+	if (d_formula.compare(d_pos, length, word) != 0)
+		return false;
+	if (d_pos + length < d_formula.size() && isNameChar(d_formula[d_pos + length]))
+		return false;
+
+	d_pos += length;
+	return true;
+}
+
+int CompiledExpression::parseTernary()
+{
+	int condition = parseLogic();
+	if (condition < 0 || !match("?"))
+		return condition;
+
+	int first = parseTernary();
+	if (first < 0 || !match(":"))
+		return -1;
+
+	int second = parseTernary();
+	if (second < 0)
+		return -1;
+
+	int node = addNode(Select);
+	d_nodes[node].children.push_back(condition);
+	d_nodes[node].children.push_back(first);
+	d_nodes[node].children.push_back(second);
+	return node;
+}
+
+int CompiledExpression::parseLogic()
+{
+	int left = parseComparison();
+	// the precedence of the logical operators differs between muParser versions,
+	// therefore mixing them without parentheses is left to the interpreter
+	int kind = -1;
+	while (left >= 0){
+		int op;
+		if (match("&&") || atWordOperator("and"))
+			op = And;
+		else if (match("||") || atWordOperator("or"))
+			op = Or;
+		else if (atWordOperator("xor"))
+			op = Xor;
+		else
+			break;
+
+		if (kind >= 0 && op != kind)
+			return -1;
+
+		kind = op;
+		left = addBinaryNode(op, left, parseComparison());
+	}
+	return left;
+}
+
+int CompiledExpression::parseComparison()
+{
+	int left = parseSum();
+	while (left >= 0){
+		int op;
+		if (match("<="))
+			op = LessEq;
+		else if (match(">="))
+			op = GreaterEq;
+		else if (match("=="))
+			op = Equal;
+		else if (match("!="))
+			op = NotEqual;
+		else if (match("<"))
+			op = Less;
+		else if (match(">"))
+			op = Greater;
+		else
+			break;
+
+		left = addBinaryNode(op, left, parseSum());
+	}
+	return left;
+}
+
+int CompiledExpression::parseSum()
+{
+	int left = parseProduct();
+	while (left >= 0){
+		int op;
+		if (match("+"))
+			op = Add;
+		else if (match("-"))
+			op = Sub;
+		else
+			break;
+
+		left = addBinaryNode(op, left, parseProduct());
+	}
+	return left;
+}
+
+int CompiledExpression::parseProduct()
+{
+	int left = parseFactor();
+	while (left >= 0){
+		int op;
+		if (match("*"))
+			op = Mul;
+		else if (match("/"))
+			op = Div;
+		else
+			break;
+
+		left = addBinaryNode(op, left, parseFactor());
+	}
+	return left;
+}
+
+int CompiledExpression::parseFactor()
+{
+	if (!d_dialect.signBindsTighter){// -2^2 = -4
+		if (match("-")){
+			int arg = parseFactor();
+			if (arg < 0)
+				return -1;
+			int node = addNode(Neg);
+			d_nodes[node].children.push_back(arg);
+			return node;
+		} else if (match("+"))
+			return parseFactor();
+	}
+	return parsePower();
+}
+
+int CompiledExpression::parsePower()
+{
+	int base = d_dialect.signBindsTighter ? parseSignedPrimary() : parsePrimary();
+	if (base < 0)
+		return -1;
+
+	std::vector<int> operands(1, base);
+	bool signedExponent = false;
+	while (match("^")){
+		// 2^-3^2 is ambiguous unless the sign binds tighter than the power operator
+		if (signedExponent && !d_dialect.signBindsTighter)
+			return -1;
+
+		skipSpaces();
+		signedExponent = d_pos < d_formula.size() && (d_formula[d_pos] == '-' || d_formula[d_pos] == '+');
+		int exponent = parseSignedPrimary();
+		if (exponent < 0)
+			return -1;
+		operands.push_back(exponent);
+	}
+
+	int n = (int)operands.size();
+	if (d_dialect.rightAssociativePower){
+		int res = operands[n - 1];
+		for (int i = n - 2; i >= 0; i--)
+			res = addBinaryNode(Pow, operands[i], res);
+		return res;
+	}
+
+	int res = operands[0];
+	for (int i = 1; i < n; i++)
+		res = addBinaryNode(Pow, res, operands[i]);
+	return res;
+}
+
+int CompiledExpression::parseSignedPrimary()
+{
+	if (match("-")){
+		int arg = parseSignedPrimary();
+		if (arg < 0)
+			return -1;
+		int node = addNode(Neg);
+		d_nodes[node].children.push_back(arg);
+		return node;
+	} else if (match("+"))
+		return parseSignedPrimary();
+
+	return parsePrimary();
+}
+
+int CompiledExpression::parsePrimary()
+{
+	skipSpaces();
+	if (d_pos >= d_formula.size())
+		return -1;
+
+	char c = d_formula[d_pos];
+	if (c == '('){
+		d_pos++;
+		int node = parseTernary();
+		if (node < 0 || !match(")"))
+			return -1;
+		return node;
+	}
+
+	if (isdigit((unsigned char)c) || (c == d_dialect.decimalSeparator &&
+		d_pos + 1 < d_formula.size() && isdigit((unsigned char)d_formula[d_pos + 1])))
+		return parseNumber();
+
+	std::string name = parseName();
+	if (name.empty() || name == "and" || name == "or" || name == "xor")
+		return -1;
+
+	skipSpaces();
+	if (d_pos < d_formula.size() && d_formula[d_pos] == '(')
+		return parseCall(name);
+
+	// constants take precedence over variables, like in muParser
+	std::map<std::string, double>::const_iterator c_it = d_constants.find(name);
+	if (c_it != d_constants.end())
+		return addNode(PushConst, 0, c_it->second);
+
+	std::map<std::string, int>::const_iterator v_it = d_variables.find(name);
+	if (v_it != d_variables.end())
+		return addNode(PushVar, v_it->second);
+
+	return -1;
+}
+
+int CompiledExpression::parseCall(const std::string& name)
+{
+	d_pos++;// skip '('
+
+	std::vector<int> args;
+	if (match(")"))
+		return -1;
+
+	std::string separator(1, d_dialect.argumentSeparator);
+	while (true){
+		int arg = parseTernary();
+		if (arg < 0)
+			return -1;
+		args.push_back(arg);
+
+		if (match(separator.c_str()))
+			continue;
+		if (match(")"))
+			break;
+		return -1;
+	}
+
+	int argc = (int)args.size();
+	int node = -1;
+
+	std::map<std::string, Callback>::const_iterator it = d_functions.find(name);
+	if (it != d_functions.end()){
+		const Callback& f = it->second;
+		if (f.argc != argc)
+			return -1;
+
+		node = addNode(argc == 1 ? Call1 : (argc == 2 ? Call2 : Call3));
+		d_nodes[node].f1 = f.f1;
+		d_nodes[node].f2 = f.f2;
+		d_nodes[node].f3 = f.f3;
+		d_nodes[node].optimizable = f.optimizable;
+	} else if (name == "if"){
+		if (argc != 3)
+			return -1;
+		node = addNode(Select);
+	} else if (name == "min" || name == "max" || name == "sum" || name == "avg"){
+		int code = Avg;
+		if (name == "min")
+			code = Min;
+		else if (name == "max")
+			code = Max;
+		else if (name == "sum")
+			code = Sum;
+		node = addNode(code, argc);
+	} else {
+		if (argc != 1)
+			return -1;
+
+		Function1 f = 0;
+		if (name == "log")
+			f = d_dialect.naturalLog ? mu_ln : mu_log10;
+		for (const BuiltInFunction *i = builtin_functions; i->name && !f; i++){
+			if (name == i->name)
+				f = i->fun;
+		}
+		if (!f)
+			return -1;
+
+		node = addNode(Call1);
+		d_nodes[node].f1 = f;
+	}
+
+	d_nodes[node].children = args;
+	return node;
+}
+
+int CompiledExpression::parseNumber()
+{
+	std::string s;
+	while (d_pos < d_formula.size() && isdigit((unsigned char)d_formula[d_pos]))
+		s += d_formula[d_pos++];
+
+	if (d_pos < d_formula.size() && d_formula[d_pos] == d_dialect.decimalSeparator){
+		s += '.';
+		d_pos++;
+		while (d_pos < d_formula.size() && isdigit((unsigned char)d_formula[d_pos]))
+			s += d_formula[d_pos++];
+	}
+
+	if (d_pos < d_formula.size() && (d_formula[d_pos] == 'e' || d_formula[d_pos] == 'E')){
+		size_t pos = d_pos + 1;
+		std::string exponent = "e";
+		if (pos < d_formula.size() && (d_formula[pos] == '-' || d_formula[pos] == '+'))
+			exponent += d_formula[pos++];
+		if (pos < d_formula.size() && isdigit((unsigned char)d_formula[pos])){
+			while (pos < d_formula.size() && isdigit((unsigned char)d_formula[pos]))
+				exponent += d_formula[pos++];
+			s += exponent;
+			d_pos = pos;
+		}
+	}
+
+	// things like 2x or 0x1F are left to the interpreter
+	if (d_pos < d_formula.size() && isNameChar(d_formula[d_pos]))
+		return -1;
+
+	std::istringstream stream(s);
+	stream.imbue(std::locale::classic());
+	double value;
+	stream >> value;
+	if (stream.fail())
+		return -1;
+
+	return addNode(PushConst, 0, value);
+}
+
+std::string CompiledExpression::parseName()
+{
+	skipSpaces();
+	std::string name;
+	if (d_pos >= d_formula.size() || isdigit((unsigned char)d_formula[d_pos]))
+		return name;
+
+	while (d_pos < d_formula.size() && isNameChar(d_formula[d_pos]))
+		name += d_formula[d_pos++];
+	return name;
+}
@@ -0,0 +1,216 @@
+/***************************************************************************
+	File                 : CompiledExpression.h
+	Project              : QtiPlot
+	--------------------------------------------------------------------
+	Copyright            : (C) 2011 by Ion Vasilief
+	Email (use @ for *)  : ion_vasilief*yahoo.fr
+	Description          : Compiled form of a muParser expression
+
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *  This program is free software; you can redistribute it and/or modify   *
+ *  it under the terms of the GNU General Public License as published by   *
+ *  the Free Software Foundation; either version 2 of the License, or      *
+ *  (at your option) any later version.                                    *
+ *                                                                         *
+ *  This program is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the          *
+ *  GNU General Public License for more details.                           *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the Free Software           *
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor,                    *
+ *   Boston, MA  02110-1301  USA                                           *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef COMPILED_EXPRESSION_H
+#define COMPILED_EXPRESSION_H
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*!\brief Compiled form of a mathematical expression written in muParser syntax.
+ *
+ * The expression is parsed once into a syntax tree, constant sub-expressions are folded and
+ * the tree is flattened into a linear program calling the math functions directly.
+ * Evaluating the program avoids the token dispatch of the muParser interpreter.
+ *
+ * Variables are referenced by index: eval() receives an array of pointers to their current values,
+ * so that the same program can be evaluated with different variable bindings.
+ *
+ * compile() fails for any construct it doesn't understand (e.g. functions taking string arguments),
+ * in which case the caller should fall back to the muParser interpreter (see MyParser::Eval()).
+ */
+class CompiledExpression
+{
+public:
+	typedef double (*Function1)(double);
+	typedef double (*Function2)(double, double);
+	typedef double (*Function3)(double, double, double);
+
+	//! Syntax details depending on the muParser version and on the locale
+	struct Dialect
+	{
+		Dialect() : rightAssociativePower(false), signBindsTighter(false), naturalLog(false),
+		decimalSeparator('.'), argumentSeparator(','){};
+
+		//! True if 2^3^2 is evaluated as 2^(3^2)
+		bool rightAssociativePower;
+		//! True if -2^2 is evaluated as (-2)^2
+		bool signBindsTighter;
+		//! True if log() is the natural logarithm, false if it is the decimal logarithm
+		bool naturalLog;
+		char decimalSeparator;
+		char argumentSeparator;
+	};
+
+	CompiledExpression();
+
+	//! Registers a function, replacing any built-in function with the same name
+	void defineFunction(const std::string& name, Function1 f, bool optimizable = true);
+	void defineFunction(const std::string& name, Function2 f, bool optimizable = true);
+	void defineFunction(const std::string& name, Function3 f, bool optimizable = true);
+	//! Registers a variable, its value is read from vars[index] by eval()
+	void defineVariable(const std::string& name, int index);
+	void defineConstant(const std::string& name, double value);
+	//! Removes all variables and constants
+	void clearVariables();
+
+	//! Compiles the expression, returns false if it contains unsupported constructs
+	bool compile(const std::string& formula, const Dialect& dialect = Dialect());
+	//! Discards the compiled program
+	void clear();
+	bool isValid() const {return !d_code.empty();};
+
+	//! Evaluates the program, vars must point to the current values of the variables
+	double eval(const double * const *vars) const {return run(d_code, vars);};
+	//! Evaluates the program for n points, writing the results to out.
+	/**
+	 * Variable i takes the values arrays[i][0..n-1] if arrays[i] is not NULL, otherwise its value is *vars[i].
+	 * The program is run on blocks of values, each instruction processing a whole block at once.
+	 */
+	void evalBatch(const double * const *vars, const double * const *arrays, int n, double *out) const;
+
+	//! Computes the exact derivative of the expression with respect to the variable with the given index.
+	/**
+	 * The syntax tree is differentiated symbolically and the result is compiled into a new program.
+	 * Returns false if the expression contains functions without a known derivative.
+	 */
+	bool derivative(int variable, CompiledExpression& result) const;
+
+	//! Writes the expression as a C expression, the variable with index i being named names[i].
+	/**
+	 * The built-in functions of muParser are called through the definitions returned by cFunctions().
+	 * Returns false if the expression calls functions not available in the C math library.
+	 */
+	bool writeC(const std::vector<std::string>& names, std::string& source) const;
+	//! C definitions of the functions called by the expressions written by writeC()
+	static std::string cFunctions();
+
+	//! Maximum stack depth accepted by compile()
+	enum{MaxStackSize = 64};
+	//! Number of points processed at once by evalBatch()
+	enum{BlockSize = 128};
+
+private:
+	enum OpCode{PushConst, PushVar, Neg, Add, Sub, Mul, Div, Pow,
+		Less, Greater, LessEq, GreaterEq, Equal, NotEqual, And, Or, Xor,
+		Select, Call1, Call2, Call3, Min, Max, Sum, Avg, Jump, JumpIfZero};
+
+	struct Instruction
+	{
+		int code;
+		int arg;
+		double value;
+		union {
+			Function1 f1;
+			Function2 f2;
+			Function3 f3;
+		};
+	};
+
+	//! Node of the syntax tree
+	struct Node
+	{
+		int code;
+		int arg;
+		double value;
+		Function1 f1;
+		Function2 f2;
+		Function3 f3;
+		bool optimizable;
+		std::vector<int> children;
+	};
+
+	struct Callback
+	{
+		int argc;
+		Function1 f1;
+		Function2 f2;
+		Function3 f3;
+		bool optimizable;
+	};
+
+	static double run(const std::vector<Instruction>& code, const double * const *vars);
+	//! Returns true if the program contains the jumps of conditional expressions
+	static bool hasJumps(const std::vector<Instruction>& code);
+	void runBlock(double *stack, const double * const *vars, const double * const *arrays,
+				int offset, int size, double *out) const;
+
+	int addNode(int code, int arg = 0, double value = 0.0);
+	int addBinaryNode(int code, int left, int right);
+	bool emit(int node, std::vector<Instruction>& code, int& depth, int& maxDepth) const;
+	int fold(int node);
+	bool writeNode(int node, const std::vector<std::string>& names, std::ostringstream& out) const;
+
+	// helpers used by derivative()
+	int diff(int node, int variable);
+	bool isConstant(int node, double value) const;
+	int constant(double value){return addNode(PushConst, 0, value);};
+	int negate(int a);
+	int add(int a, int b);
+	int subtract(int a, int b);
+	int multiply(int a, int b);
+	int divide(int a, int b);
+	int call(Function1 f, int a);
+
+	// recursive descent parser
+	int parseTernary();
+	int parseLogic();
+	int parseComparison();
+	int parseSum();
+	int parseProduct();
+	int parseFactor();
+	int parsePower();
+	int parseSignedPrimary();
+	int parsePrimary();
+	int parseCall(const std::string& name);
+	int parseNumber();
+	std::string parseName();
+	void skipSpaces();
+	bool match(const char *token);
+	bool atWordOperator(const char *word);
+
+	std::map<std::string, Callback> d_functions;
+	std::map<std::string, int> d_variables;
+	std::map<std::string, double> d_constants;
+
+	std::vector<Node> d_nodes;
+	//! Root of the syntax tree
+	int d_root;
+	std::vector<Instruction> d_code;
+	//! Stack depth needed by the program
+	int d_stack_size;
+
+	//! Parser state
+	std::string d_formula;
+	size_t d_pos;
+	Dialect d_dialect;
+};
+
+#endif
@@ -33,24 +33,77 @@
 #include <QMessageBox>
 #include <QApplication>
 #include <QLocale>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <cstring>
+#include <locale>
+#include <map>
+#include <sstream>
 
 #include <gsl/gsl_const_mksa.h>
 #include <gsl/gsl_const_num.h>
 
+//! Compiled expressions shared by all parsers, see MyParser::cacheKey()
+static std::map<std::string, CompiledExpression> expression_cache;
+static QMutex expression_cache_mutex;
+//! The cache is emptied when it grows larger than this
+static const unsigned int max_cached_expressions = 1000;
+
+//! Guards the detection of the muParser syntax, parsers may be created by several threads
+static QMutex syntax_mutex;
+
+//! Detects the syntax details of the muParser library in use
+static bool muParserSyntax(CompiledExpression::Dialect& dialect)
+{
+	static bool initialized = false;
+	static bool supported = false;
+	static CompiledExpression::Dialect syntax;
+
+	QMutexLocker locker(&syntax_mutex);
+	if (!initialized){
+		initialized = true;
+		try {
+			Parser parser;
+			parser.SetExpr("2^3^2");
+			syntax.rightAssociativePower = (parser.Eval() == 512.0);
+			parser.SetExpr("-2^2");
+			syntax.signBindsTighter = (parser.Eval() == 4.0);
+			parser.SetExpr("log(100)");
+			syntax.naturalLog = (parser.Eval() != 2.0);
+			supported = true;
+		} catch (mu::ParserError &){}
+	}
+
+	dialect.rightAssociativePower = syntax.rightAssociativePower;
+	dialect.signBindsTighter = syntax.signBindsTighter;
+	dialect.naturalLog = syntax.naturalLog;
+	return supported;
+}
+
 MyParser::MyParser()
-:Parser()
+:Parser(),
+d_evaluations(0)
 {
+	d_compiler_enabled = muParserSyntax(d_dialect);
+
 	DefineConst("pi", M_PI);
 	DefineConst("Pi", M_PI);
 	DefineConst("PI", M_PI);
 
 	for (const muParserScripting::mathFunction *i=muParserScripting::math_functions; i->name; i++){
-		if (i->numargs == 1 && i->fun1 != NULL)
+		if (i->numargs == 1 && i->fun1 != NULL){
 			DefineFun(i->name, i->fun1);
-		else if (i->numargs == 2 && i->fun2 != NULL)
+			// random numbers depend on the generator of the evaluating thread, they must not be folded at compile time
+			bool random = (strcmp(i->name, "rnd") == 0 || strcmp(i->name, "normal") == 0);
+			d_program.defineFunction(i->name, i->fun1, !random);
+		} else if (i->numargs == 2 && i->fun2 != NULL){
 			DefineFun(i->name, i->fun2);
-		else if (i->numargs == 3 && i->fun3 != NULL)
+			d_program.defineFunction(i->name, i->fun2);
+		} else if (i->numargs == 3 && i->fun3 != NULL){
 			DefineFun(i->name, i->fun3);
+			d_program.defineFunction(i->name, i->fun3);
+		}
 	}
 	gsl_set_error_handler_off();
 
@@ -82,8 +135,140 @@ void MyParser::setLocale(const QLocale& locale)
 		SetDecSep(decPoint);
 		SetArgSep(';');
 		SetThousandsSep(locale.groupSeparator().toAscii());
-	} else
+		d_dialect.argumentSeparator = ';';
+	} else {
 		ResetLocale();// reset C locale
+		d_dialect.argumentSeparator = ',';
+	}
+	d_dialect.decimalSeparator = decPoint;
+	resetProgram();
+}
+
+void MyParser::SetExpr(const string_type& a_sExpr)
+{
+	Parser::SetExpr(a_sExpr);
+	resetProgram();
+}
+
+void MyParser::DefineVar(const string_type& a_sName, value_type *a_fVar)
+{
+	Parser::DefineVar(a_sName, a_fVar);
+	resetProgram();
+}
+
+void MyParser::DefineConst(const string_type& a_sName, value_type a_fVal)
+{
+	Parser::DefineConst(a_sName, a_fVal);
+	resetProgram();
+}
+
+void MyParser::setCompilerEnabled(bool on)
+{
+	d_compiler_enabled = on && muParserSyntax(d_dialect);
+	resetProgram();
+}
+
+void MyParser::resetProgram()
+{
+	d_program.clear();
+	d_variables.clear();
+	d_derivatives.clear();
+	d_cache_key.clear();
+	d_evaluations = 0;
+}
+
+const std::string& MyParser::cacheKey() const
+{
+	if (!d_cache_key.empty())
+		return d_cache_key;
+
+	std::ostringstream key;
+	key.imbue(std::locale::classic());
+	key.precision(17);
+
+	key << GetExpr() << '\n' << d_dialect.decimalSeparator << d_dialect.argumentSeparator << '\n';
+
+	const varmap_type& vars = GetVar();
+	for (varmap_type::const_iterator it = vars.begin(); it != vars.end(); ++it)
+		key << it->first << ';';
+	key << '\n';
+
+	const valmap_type& consts = GetConst();
+	for (valmap_type::const_iterator it = consts.begin(); it != consts.end(); ++it)
+		key << it->first << '=' << it->second << ';';
+
+	d_cache_key = key.str();
+	return d_cache_key;
+}
+
+void MyParser::bindVariables() const
+{
+	// the program refers to the variables by their index in the (sorted) variable map
+	d_variables.clear();
+	const varmap_type& vars = GetVar();
+	for (varmap_type::const_iterator it = vars.begin(); it != vars.end(); ++it)
+		d_variables.push_back(it->second);
+}
+
+bool MyParser::loadCachedProgram() const
+{
+	const std::string& key = cacheKey();
+
+	QMutexLocker locker(&expression_cache_mutex);
+	std::map<std::string, CompiledExpression>::const_iterator it = expression_cache.find(key);
+	if (it == expression_cache.end())
+		return false;
+
+	d_program = it->second;
+	locker.unlock();
+
+	bindVariables();
+	d_evaluations = 2;
+	return true;
+}
+
+bool MyParser::compile() const
+{
+	d_evaluations++;
+
+	d_program.clearVariables();
+	bindVariables();
+
+	const varmap_type& vars = GetVar();
+	int index = 0;
+	for (varmap_type::const_iterator it = vars.begin(); it != vars.end(); ++it)
+		d_program.defineVariable(it->first, index++);
+
+	const valmap_type& consts = GetConst();
+	for (valmap_type::const_iterator it = consts.begin(); it != consts.end(); ++it)
+		d_program.defineConstant(it->first, it->second);
+
+	if (!d_program.compile(GetExpr(), d_dialect))
+		return false;
+
+	const std::string& key = cacheKey();
+	QMutexLocker locker(&expression_cache_mutex);
+	if (expression_cache.size() >= max_cached_expressions)
+		expression_cache.clear();
+	expression_cache[key] = d_program;
+	return true;
+}
+
+double MyParser::Eval() const
+{
+	if (d_program.isValid())
+		return d_program.eval(d_variables.empty() ? 0 : &d_variables[0]);
+
+	// the first evaluation is left to muParser, which also validates the expression:
+	// callers setting the expression before each evaluation never pay for the cache lookup.
+	// When the expression is evaluated again, it is taken from the cache or compiled.
+	if (d_compiler_enabled && d_evaluations == 1 && (loadCachedProgram() || compile()))
+		return d_program.eval(d_variables.empty() ? 0 : &d_variables[0]);
+
+	double result = Parser::Eval();
+	if (d_evaluations < 2)
+		d_evaluations++;
+	return result;
 }
 
 void MyParser::addGSLConstants()
@@ -141,6 +326,200 @@ QString MyParser::explainFunction(int index)
 	return s;
 }
 
+bool MyParser::prepareBatch() const
+{
+	if (d_program.isValid())
+		return true;
+	if (!d_compiler_enabled || d_evaluations > 1)
+		return false;
+
+	if (!d_evaluations){
+		if (loadCachedProgram())
+			return true;
+		// let muParser validate the expression first
+		Parser::Eval();
+		d_evaluations++;
+	}
+	return compile();
+}
+
+void MyParser::EvalBatch(double * const *vars, const double * const *arrays, int count, double *y, int n) const
+{
+	if (n <= 0)
+		return;
+
+	std::vector<double> backup(count);
+	for (int k = 0; k < count; k++){
+		backup[k] = *vars[k];
+		*vars[k] = arrays[k][0];
+	}
+
+	try {
+		if (prepareBatch()){
+			std::vector<const double *> bound(d_variables.size(), (const double *)0);
+			for (int k = 0; k < count; k++){
+				for (int i = 0; i < (int)d_variables.size(); i++){
+					if (d_variables[i] == vars[k])
+						bound[i] = arrays[k];
+				}
+			}
+			if (d_variables.empty())
+				d_program.evalBatch(0, 0, n, y);
+			else
+				d_program.evalBatch(&d_variables[0], &bound[0], n, y);
+		} else {
+			for (int i = 0; i < n; i++){
+				for (int k = 0; k < count; k++)
+					*vars[k] = arrays[k][i];
+				y[i] = Eval();
+			}
+		}
+	} catch (...) {
+		for (int k = 0; k < count; k++)
+			*vars[k] = backup[k];
+		throw;
+	}
+
+	for (int k = 0; k < count; k++)
+		*vars[k] = backup[k];
+}
+
+void MyParser::EvalBatch(double *xvar, const double *x, double *y, int n) const
+{
+	EvalBatch(&xvar, &x, 1, y, n);
+}
+
+void MyParser::EvalBatchRemoveSingularity(double *xvar, const double *x, double *y, int n, bool noisy) const
+{
+	EvalBatch(xvar, x, y, n);
+
+	double backup = *xvar;
+	for (int i = 0; i < n; i++){
+		if (gsl_isinf(y[i]) || gsl_isnan(y[i])){
+			*xvar = x[i];
+			y[i] = EvalRemoveSingularity(xvar, noisy);
+		}
+	}
+	*xvar = backup;
+}
+
+int MyParser::variableIndex(double *var) const
+{
+	for (int i = 0; i < (int)d_variables.size(); i++){
+		if (d_variables[i] == var)
+			return i;
+	}
+	return -1;
+}
+
+const CompiledExpression* MyParser::derivativeProgram(double *var) const
+{
+	if (!prepareBatch())
+		return 0;
+
+	int index = variableIndex(var);
+	if (index < 0)
+		return 0;
+
+	std::map<int, CompiledExpression>::const_iterator it = d_derivatives.find(index);
+	if (it == d_derivatives.end()){
+		std::ostringstream key;
+		key << cacheKey() << "\nd/d" << index;
+
+		CompiledExpression program;
+		QMutexLocker locker(&expression_cache_mutex);
+		std::map<std::string, CompiledExpression>::const_iterator cached = expression_cache.find(key.str());
+		if (cached != expression_cache.end()){
+			program = cached->second;
+			locker.unlock();
+		} else {
+			locker.unlock();
+			// failures are cached as well, so that they are not repeated
+			d_program.derivative(index, program);
+
+			locker.relock();
+			if (expression_cache.size() >= max_cached_expressions)
+				expression_cache.clear();
+			expression_cache[key.str()] = program;
+			locker.unlock();
+		}
+		it = d_derivatives.insert(std::make_pair(index, program)).first;
+	}
+
+	return it->second.isValid() ? &it->second : 0;
+}
+
+void MyParser::DiffBatchRemoveSingularity(double *xvar, const double *x, double *a_Var, double a_fPos, double *y, int n, bool noisy) const
+{
+	if (n <= 0)
+		return;
+
+	const CompiledExpression *derivative = derivativeProgram(a_Var);
+	int xIndex = variableIndex(xvar);
+	if (derivative && xIndex >= 0){
+		double fBuf = *a_Var;
+		*a_Var = a_fPos;
+
+		std::vector<const double *> bound(d_variables.size(), (const double *)0);
+		bound[xIndex] = x;
+		derivative->evalBatch(&d_variables[0], &bound[0], n, y);
+
+		double xBuf = *xvar;
+		try {
+			for (int i = 0; i < n; i++){
+				if (gsl_isinf(y[i]) || gsl_isnan(y[i])){
+					*xvar = x[i];
+					y[i] = DiffRemoveSingularity(xvar, a_Var, a_fPos, noisy);
+				}
+			}
+		} catch (...) {
+			*a_Var = fBuf;
+			throw;
+		}
+		*xvar = xBuf;
+		*a_Var = fBuf;
+		return;
+	}
+
+	double fBuf(*a_Var),
+		a_fEpsilon( (a_fPos == 0) ? (double)1e-10 : 1e-7 * a_fPos );
+
+	std::vector<double> f(4*n);
+	try {
+		*a_Var = a_fPos+2 * a_fEpsilon;  EvalBatchRemoveSingularity(xvar, x, &f[0], n, noisy);
+		*a_Var = a_fPos+1 * a_fEpsilon;  EvalBatchRemoveSingularity(xvar, x, &f[n], n, noisy);
+		*a_Var = a_fPos-1 * a_fEpsilon;  EvalBatchRemoveSingularity(xvar, x, &f[2*n], n, noisy);
+		*a_Var = a_fPos-2 * a_fEpsilon;  EvalBatchRemoveSingularity(xvar, x, &f[3*n], n, noisy);
+	} catch (...) {
+		*a_Var = fBuf;
+		throw;
+	}
+	*a_Var = fBuf; // restore variable
+
+	for (int i = 0; i < n; i++)
+		y[i] = (-f[i] + 8*f[n + i] - 8*f[2*n + i] + f[3*n + i]) / (12*a_fEpsilon);
+}
+
+bool MyParser::compiledSource(const std::map<double *, std::string>& names, std::string& source, double *diffVar) const
+{
+	const CompiledExpression *program = 0;
+	if (diffVar)
+		program = derivativeProgram(diffVar);
+	else if (prepareBatch())
+		program = &d_program;
+	if (!program)
+		return false;
+
+	std::vector<std::string> variables;
+	for (int i = 0; i < (int)d_variables.size(); i++){
+		std::map<double *, std::string>::const_iterator it = names.find(d_variables[i]);
+		if (it == names.end())
+			return false;
+		variables.push_back(it->second);
+	}
+	return program->writeC(variables, source);
+}
+
 double MyParser::EvalRemoveSingularity(double *xvar, bool noisy) const
 {
 	try {
@@ -181,17 +560,17 @@ double MyParser::EvalRemoveSingularity(double *xvar, bool noisy) const
 
 //almost verbatim copy from Parser::Diff, adapted to use EvalRemoveSingularity()
 
-double MyParser::DiffRemoveSingularity(double *xvar, double *a_Var, double a_fPos) const
+double MyParser::DiffRemoveSingularity(double *xvar, double *a_Var, double a_fPos, bool noisy) const
 {
     double fRes(0),
 		   fBuf(*a_Var),
            f[4] = {0,0,0,0},
 	       a_fEpsilon( (a_fPos == 0) ? (double)1e-10 : 1e-7 * a_fPos );
 
-    *a_Var = a_fPos+2 * a_fEpsilon;  f[0] = EvalRemoveSingularity(xvar);
-    *a_Var = a_fPos+1 * a_fEpsilon;  f[1] = EvalRemoveSingularity(xvar);
-    *a_Var = a_fPos-1 * a_fEpsilon;  f[2] = EvalRemoveSingularity(xvar);
-    *a_Var = a_fPos-2 * a_fEpsilon;  f[3] = EvalRemoveSingularity(xvar);
+    *a_Var = a_fPos+2 * a_fEpsilon;  f[0] = EvalRemoveSingularity(xvar, noisy);
+    *a_Var = a_fPos+1 * a_fEpsilon;  f[1] = EvalRemoveSingularity(xvar, noisy);
+    *a_Var = a_fPos-1 * a_fEpsilon;  f[2] = EvalRemoveSingularity(xvar, noisy);
+    *a_Var = a_fPos-2 * a_fEpsilon;  f[3] = EvalRemoveSingularity(xvar, noisy);
     *a_Var = fBuf; // restore variable
 
     fRes = (-f[0] + 8*f[1] - 8*f[2] + f[3]) / (12*a_fEpsilon);
@@ -31,6 +31,9 @@
 
 #include <muParser.h>
 #include <qstringlist.h>
+#include "CompiledExpression.h"
+
+#include <map>
 
 using namespace mu;
 
@@ -43,6 +46,16 @@ class QLocale;
  * This will allow you to use e.g. Python's global variables and functions everywhere.
  * Before this happens, a cleaner and more generic solution for accessing the current ScriptingEnv
  * should be implemented (maybe by making it a property of Project; see ApplicationWindow).
+ *
+ * \section compiler Compiled evaluation
+ * When an expression is evaluated repeatedly, Eval() compiles it into a CompiledExpression
+ * and evaluates the compiled program instead of the muParser bytecode. Expressions which can't be
+ * compiled (e.g. using functions with string arguments) are still evaluated by muParser.
+ * EvalBatch() evaluates a compiled expression for a whole array of values at once.
+ *
+ * Compiled programs are kept in a thread-safe cache shared by all parsers: a parser created
+ * for an expression which was already compiled with the same variables and constants
+ * skips the muParser parsing and uses the cached program from the first evaluation.
  */
 class MyParser : public Parser
 {
@@ -56,12 +69,69 @@ public:
 	const static QStringList functionNamesList();
 	static QString explainFunction(int index);
 
+	void SetExpr(const string_type& a_sExpr);
+	void DefineVar(const string_type& a_sName, value_type *a_fVar);
+	void DefineConst(const string_type& a_sName, value_type a_fVal);
+	double Eval() const;
+
+	//! Enables/disables the compiled evaluation of expressions (enabled by default)
+	void setCompilerEnabled(bool on = true);
+	//! Returns true if the current expression is evaluated by a compiled program
+	bool isCompiled() const {return d_program.isValid();};
+
 	double EvalRemoveSingularity(double *xvar, bool noisy = true) const;
-	double DiffRemoveSingularity(double *xvar, double *a_Var,double a_fPos) const;
+	double DiffRemoveSingularity(double *xvar, double *a_Var,double a_fPos, bool noisy = true) const;
+
+	//! Evaluates the expression for n points, the variable bound to vars[k] takes the values arrays[k][0..n-1]
+	void EvalBatch(double * const *vars, const double * const *arrays, int count, double *y, int n) const;
+	//! Evaluates the expression for the n values x of the variable bound to xvar
+	void EvalBatch(double *xvar, const double *x, double *y, int n) const;
+	//! Same as EvalBatch(), points where the result is not finite are evaluated using EvalRemoveSingularity()
+	void EvalBatchRemoveSingularity(double *xvar, const double *x, double *y, int n, bool noisy = true) const;
+	//! Computes the derivative with respect to a_Var at the n points x.
+	/**
+	 * The exact derivative of the compiled expression is used whenever it is available,
+	 * otherwise (and at the points where the exact derivative is not finite) the derivative
+	 * is approximated numerically by DiffRemoveSingularity().
+	 */
+	void DiffBatchRemoveSingularity(double *xvar, const double *x, double *a_Var, double a_fPos, double *y, int n, bool noisy = true) const;
+	//! Writes the expression, or its exact derivative with respect to diffVar, as a C expression.
+	/**
+	 * The variables are named according to names, indexed by their addresses (see CompiledExpression::writeC()).
+	 * Returns false if the expression can't be compiled or if it calls functions not available in C.
+	 */
+	bool compiledSource(const std::map<double *, std::string>& names, std::string& source, double *diffVar = 0) const;
 	static void SingularityErrorMessage(double xvar);
 
 	class Singularity {};
 	class Pole {};
+
+private:
+	bool compile() const;
+	bool prepareBatch() const;
+	void bindVariables() const;
+	//! Identifies an expression together with its variables, constants and locale in the cache of compiled expressions
+	const std::string& cacheKey() const;
+	//! Loads the compiled program from the cache shared by all parsers, returns false if not found
+	bool loadCachedProgram() const;
+	//! Returns the index of the variable bound to var in the compiled program or -1
+	int variableIndex(double *var) const;
+	//! Returns the compiled exact derivative with respect to var or NULL if not available
+	const CompiledExpression* derivativeProgram(double *var) const;
+	void resetProgram();
+
+	//! Compiled form of the current expression
+	mutable CompiledExpression d_program;
+	//! Addresses of the variables used by the compiled program
+	mutable std::vector<double *> d_variables;
+	//! Compiled derivatives of the current expression, by variable index
+	mutable std::map<int, CompiledExpression> d_derivatives;
+	//! Number of evaluations performed by muParser since the expression was last changed
+	mutable int d_evaluations;
+	//! Cache key of the current expression, computed at most once, see cacheKey()
+	mutable std::string d_cache_key;
+	bool d_compiler_enabled;
+	CompiledExpression::Dialect d_dialect;
 };
 
 #endif
@@ -39,9 +39,134 @@
 #include <QObject>
 #include <QVariant>
 #include <QMessageBox>
+#include <QCoreApplication>
+#include <QMetaObject>
+
+//! A Python call executed in the GUI thread on behalf of a script running in the background
+struct PythonMainThreadCall
+{
+	PyObject *callable, *args, *result;
+	PyObject *exception, *value, *traceback;
+	//! Set by the GUI thread when it starts and ends the call, protected by PythonScript::d_call_mutex
+	bool running, done;
+};
+
+/* Helpers of the scripts running in the background, loaded once in their own namespace.
+ * install() replaces the QtiPlot objects found in a script namespace by proxies forwarding
+ * all attribute accesses and method calls to the GUI thread, restore() puts the original
+ * objects back. QObjects returned by the proxies are wrapped as well, also inside lists,
+ * tuples and dictionaries; proxies passed as arguments are unwrapped. The qti and __main__
+ * modules are proxied too, including when a worker thread imports them.
+ */
+static const char *main_thread_proxies =
+	"import qti, thread, __builtin__\n"
+	"from PyQt4.QtCore import QObject\n"
+	"_workers = set()\n"
+	"class _MainThreadProxy(object):\n"
+	"\tdef __init__(self, obj):\n"
+	"\t\tobject.__setattr__(self, '_obj', obj)\n"
+	"\tdef __getattr__(self, name):\n"
+	"\t\tvalue = qti.runInMainThread(getattr, self._obj, name)\n"
+	"\t\tif callable(value):\n"
+	"\t\t\treturn _proxyFunction(value)\n"
+	"\t\treturn _proxy(value)\n"
+	"\tdef __setattr__(self, name, value):\n"
+	"\t\tqti.runInMainThread(setattr, self._obj, name, _unproxy(value))\n"
+	"\tdef __repr__(self):\n"
+	"\t\treturn qti.runInMainThread(repr, self._obj)\n"
+	"class _ModuleProxy(object):\n"
+	"\tdef __init__(self, module):\n"
+	"\t\tobject.__setattr__(self, '_module', module)\n"
+	"\tdef __getattr__(self, name):\n"
+	"\t\treturn _wrap(getattr(self._module, name))\n"
+	"\tdef __setattr__(self, name, value):\n"
+	"\t\tsetattr(self._module, name, _unproxy(value))\n"
+	"\tdef __repr__(self):\n"
+	"\t\treturn repr(self._module)\n"
+	"def _wrap(value):\n"
+	"\tif isinstance(value, QObject):\n"
+	"\t\treturn _MainThreadProxy(value)\n"
+	"\tif isinstance(value, type(qti)) and value.__name__ in ('qti', '__main__'):\n"
+	"\t\treturn _ModuleProxy(value)\n"
+	"\tif isinstance(getattr(value, '__self__', None), QObject):\n"
+	"\t\treturn _proxyFunction(value)\n"
+	"\treturn value\n"
+	"def _proxy(value):\n"
+	"\tif isinstance(value, list):\n"
+	"\t\treturn [_proxy(v) for v in value]\n"
+	"\tif isinstance(value, tuple):\n"
+	"\t\treturn tuple([_proxy(v) for v in value])\n"
+	"\tif isinstance(value, dict):\n"
+	"\t\treturn dict([(k, _proxy(v)) for k, v in value.items()])\n"
+	"\treturn _wrap(value)\n"
+	"def _unproxy(value):\n"
+	"\tif isinstance(value, _MainThreadProxy):\n"
+	"\t\treturn value._obj\n"
+	"\tif isinstance(value, _ModuleProxy):\n"
+	"\t\treturn value._module\n"
+	"\tif isinstance(value, list):\n"
+	"\t\treturn [_unproxy(v) for v in value]\n"
+	"\tif isinstance(value, tuple):\n"
+	"\t\treturn tuple([_unproxy(v) for v in value])\n"
+	"\tif isinstance(value, dict):\n"
+	"\t\treturn dict([(k, _unproxy(v)) for k, v in value.items()])\n"
+	"\treturn value\n"
+	"def _proxyFunction(f):\n"
+	"\tdef call(*args):\n"
+	"\t\treturn _proxy(qti.runInMainThread(f, *[_unproxy(a) for a in args]))\n"
+	"\treturn call\n"
+	"_import = __builtin__.__import__\n"
+	"def _threadImport(*args, **kwargs):\n"
+	"\tmodule = _import(*args, **kwargs)\n"
+	"\tif thread.get_ident() in _workers:\n"
+	"\t\treturn _wrap(module)\n"
+	"\treturn module\n"
+	"__builtin__.__import__ = _threadImport\n"
+	"def install(namespace):\n"
+	"\treplaced = {}\n"
+	"\tfor name, value in namespace.items():\n"
+	"\t\tif name.startswith('_'):\n"
+	"\t\t\tcontinue\n"
+	"\t\tproxy = _wrap(value)\n"
+	"\t\tif proxy is not value:\n"
+	"\t\t\tnamespace[name] = proxy\n"
+	"\t\t\treplaced[name] = (value, proxy)\n"
+	"\treturn replaced\n"
+	"def restore(namespace, replaced):\n"
+	"\tfor name, (value, proxy) in replaced.items():\n"
+	"\t\tif namespace.get(name) is proxy:\n"
+	"\t\t\tnamespace[name] = value\n"
+	"def enter():\n"
+	"\t_workers.add(thread.get_ident())\n"
+	"def leave():\n"
+	"\t_workers.discard(thread.get_ident())\n";
+
+//! Calls one of the functions defined by main_thread_proxies, the helpers are loaded by the first call
+static PyObject* callProxyHelper(const char *name, PyObject *args)
+{
+	static PyObject *helpers = NULL;
+	if (!helpers){
+		PyObject *dict = PyDict_New();
+		if (!dict)
+			return NULL;
+		PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins());
+		PyObject *ret = PyRun_String(main_thread_proxies, Py_file_input, dict, dict);
+		if (!ret){
+			Py_DECREF(dict);
+			return NULL;
+		}
+		Py_DECREF(ret);
+		helpers = dict;
+	}
+	return PyObject_CallObject(PyDict_GetItemString(helpers, name), args);
+}
+
+PythonScript *PythonScript::current = NULL;
+PythonScript *PythonScript::output = NULL;
 
 PythonScript::PythonScript(PythonScripting *env, const QString &code, QObject *context, const QString &name)
-: Script(env, code, context, name)
+: Script(env, code, context, name), d_previous_output(NULL), d_thread(NULL), d_thread_id(0), d_background_success(false),
+d_proxied_globals(NULL), d_pending_call(NULL)
 {
 	PyGILState_STATE state = PyGILState_Ensure();
 	PyCode = NULL;
@@ -79,6 +204,12 @@ PythonScript::PythonScript(PythonScripting *env, const QString &code, QObject *c
 
 PythonScript::~PythonScript()
 {
+	if (isRunning()){
+		// a canceled worker thread stops waiting for the calls it posted to the GUI thread
+		cancel();
+		d_thread->wait();
+	}
+
 	PyGILState_STATE state = PyGILState_Ensure();
 	Py_DECREF(modLocalDict);
 	Py_DECREF(modGlobalDict);
@@ -275,6 +406,159 @@ QVariant PythonScript::eval()
 	}
 }
 
+//! Returns true if \a code only uses the table access functions, the row/column variables and NumPy ufuncs.
+/**
+ * Such expressions have no side effects, so that they may be evaluated again row by row.
+ */
+static bool isVectorizable(PyCodeObject *code, PyObject *local, PyObject *global, PyObject *ufunc)
+{
+	static const char *allowed[] = {"col", "tablecol", "cell", "i", "j", "sr", "er", 0};
+	for (int k = 0; k < PyTuple_Size(code->co_names); k++){
+		PyObject *name = PyTuple_GET_ITEM(code->co_names, k);
+		const char *str = PyString_AsString(name);
+		if (!str)
+			return false;
+		bool known = false;
+		for (int l = 0; allowed[l] && !known; l++)
+			known = (strcmp(str, allowed[l]) == 0);
+		if (known)
+			continue;
+
+		PyObject *obj = PyDict_GetItem(local, name);
+		if (!obj)
+			obj = PyDict_GetItem(global, name);
+		if (!obj || PyObject_IsInstance(obj, ufunc) != 1)
+			return false;
+	}
+	for (int k = 0; k < PyTuple_Size(code->co_consts); k++){
+		PyObject *c = PyTuple_GET_ITEM(code->co_consts, k);
+		if (PyCode_Check(c) && !isVectorizable((PyCodeObject *)c, local, global, ufunc))
+			return false;
+	}
+	return true;
+}
+
+bool PythonScript::evalArray(double first, int size, double *values)
+{
+	if (!Context->inherits("Table") || size <= 0)
+		return false;
+
+	PyGILState_STATE state = PyGILState_Ensure();
+	PyObject *numpy = PyImport_ImportModule("numpy");
+	if (!numpy){
+		PyErr_Clear();
+		PyGILState_Release(state);
+		return false;
+	}
+
+	// compilation errors are reported by the row by row evaluation
+	bool emitErrors = EmitErrors;
+	EmitErrors = false;
+	bool compiledOk = compile(true);
+	EmitErrors = emitErrors;
+
+	PyObject *topLevelGlobal = hasOldGlobals ? env()->globalDict() : modGlobalDict;
+	PyObject *topLevelLocal = hasOldGlobals ? modLocalDict : modGlobalDict;
+
+	// only single expressions without side effects (e.g. no random numbers, no output) are evaluated
+	// on whole columns, since their rows may have to be evaluated once more by the caller
+	PyObject *ufunc = PyObject_GetAttrString(numpy, "ufunc");
+	bool vectorizable = compiledOk && ufunc && PyCode_Check(PyCode) &&
+			isVectorizable((PyCodeObject *)PyCode, topLevelLocal, topLevelGlobal, ufunc);
+	Py_XDECREF(ufunc);
+
+	// "i" becomes the array of row indices
+	PyObject *rows = vectorizable ? PyObject_CallMethod(numpy, (char *)"arange", (char *)"dd", first, first + size) : 0;
+	if (!rows || PyDict_SetItemString(modLocalDict, "i", rows) < 0 || PyDict_SetItemString(modGlobalDict, "i", rows) < 0){
+		Py_XDECREF(rows);
+		Py_DECREF(numpy);
+		PyErr_Clear();
+		compiled = notCompiled;
+		PyGILState_Release(state);
+		return false;
+	}
+	Py_DECREF(rows);
+
+	// col() and tablecol() return whole columns, col(c, r) still returns a single cell;
+	// empty cells make the whole evaluation fail, so that they are handled row by row as before
+	PyObject *pyret = PyRun_String(
+			"def col(c,*arg):\n"
+			"\tif arg: return self.cell(c,arg[0])\n"
+			"\treturn _no_empty_cells_(self.colArray(c,int(sr),int(er)))\n"
+			"def tablecol(t,c):\n"
+			"\treturn _no_empty_cells_(table(t).colArray(c,int(sr),int(er)))\n"
+			"def _no_empty_cells_(a):\n"
+			"\timport numpy\n"
+			"\tif numpy.isnan(a).any(): raise ValueError('Empty table cell')\n"
+			"\treturn a\n",
+			Py_file_input, topLevelLocal, topLevelLocal);
+	if (pyret){
+		Py_DECREF(pyret);
+		// non-finite results are evaluated again by the caller, so NumPy warnings are not needed
+		PyObject *errors = PyObject_CallMethod(numpy, (char *)"seterr", (char *)"s", "ignore");
+		pyret = PyEval_EvalCode((PyCodeObject*)PyCode, topLevelGlobal, topLevelLocal);
+		if (errors){
+			PyObject *err_type, *err_value, *err_traceback;
+			PyErr_Fetch(&err_type, &err_value, &err_traceback);
+			PyObject *empty_tuple = PyTuple_New(0);
+			PyObject *seterr = PyObject_GetAttrString(numpy, "seterr");
+			if (empty_tuple && seterr)
+				Py_XDECREF(PyObject_Call(seterr, empty_tuple, errors));
+			Py_XDECREF(seterr);
+			Py_XDECREF(empty_tuple);
+			Py_DECREF(errors);
+			PyErr_Restore(err_type, err_value, err_traceback);
+		}
+	}
+
+	// only a one-dimensional floating point array with one value per row is accepted,
+	// other types (e.g. integers or booleans) are formatted differently by the row by row evaluation
+	bool success = false;
+	if (pyret){
+		PyObject *kind = PyObject_GetAttrString(pyret, "dtype");
+		if (kind){
+			PyObject *dtype = kind;
+			kind = PyObject_GetAttrString(dtype, "kind");
+			Py_DECREF(dtype);
+		}
+		if (!kind || !PyString_Check(kind) || strcmp(PyString_AsString(kind), "f") != 0){
+			Py_DECREF(pyret);
+			pyret = 0;
+		}
+		Py_XDECREF(kind);
+	}
+	if (pyret){
+		PyObject *array = PyObject_CallMethod(numpy, (char *)"ascontiguousarray", (char *)"Os", pyret, "float64");
+		Py_DECREF(pyret);
+		if (array){
+			PyObject *shape = PyObject_GetAttrString(array, "shape");
+			if (shape && PyTuple_Check(shape) && PyTuple_Size(shape) == 1 &&
+				PyInt_AsLong(PyTuple_GET_ITEM(shape, 0)) == size){
+				const void *buffer;
+#if PY_VERSION_HEX >= 0x02050000
+				Py_ssize_t length;
+#else
+				int length;
+#endif
+				if (PyObject_AsReadBuffer(array, &buffer, &length) == 0 && length == (int)(size*sizeof(double))){
+					memcpy(values, buffer, length);
+					success = true;
+				}
+			}
+			Py_XDECREF(shape);
+			Py_DECREF(array);
+		}
+	}
+	Py_DECREF(numpy);
+
+	// the expression has no side effects and is evaluated again row by row in case of failure,
+	// where errors are reported as usual
+	PyErr_Clear();
+	compiled = notCompiled;
+	PyGILState_Release(state);
+	return success;
+}
+
 bool PythonScript::exec()
 {
 	if (isFunction) compiled = notCompiled;
@@ -284,10 +568,14 @@ bool PythonScript::exec()
 	PyObject *topLevelGlobal = hasOldGlobals ? env()->globalDict() : modGlobalDict;
 	PyObject *topLevelLocal = hasOldGlobals ? modLocalDict : modGlobalDict;
 	PyObject *pyret;
+	PythonScript *previous = current;
+	current = this;
 	beginStdoutRedirect();
 	if (PyCallable_Check(PyCode)){
 		PyObject *empty_tuple = PyTuple_New(0);
 		if (!empty_tuple) {
+			endStdoutRedirect();
+			current = previous;
 			emit_error(env()->errorMsg(), 0);
 			PyGILState_Release(state);
 			return false;
@@ -299,6 +587,7 @@ bool PythonScript::exec()
 	}
 
 	endStdoutRedirect();
+	current = previous;
 	if (pyret) {
 		Py_DECREF(pyret);
 		PyGILState_Release(state);
@@ -309,28 +598,250 @@ bool PythonScript::exec()
 	return false;
 }
 
-void PythonScript::beginStdoutRedirect()
+bool PythonScript::execInBackground()
+{
+	if (isRunning())
+		return false;
+
+	if (isFunction) compiled = notCompiled;
+	if (compiled != Script::isCompiled && !compile(false)){
+		emit finished(false);
+		return false;
+	}
+
+	// scripts using "global" run with the interpreter wide dictionary as globals: it is shared
+	// with the GUI thread and holds no proxies, so these scripts are executed in the GUI thread
+	if (hasOldGlobals){
+		bool success = exec();
+		emit finished(success);
+		return success;
+	}
+
+	if (!installMainThreadProxies()){
+		emit finished(false);
+		return false;
+	}
+
+	d_canceled = 0;
+	d_background_success = false;
+	d_background_error = QString::null;
+	if (!d_thread){
+		d_thread = new PythonScriptThread(this);
+		connect(d_thread, SIGNAL(finished()), this, SLOT(backgroundExecutionFinished()));
+	}
+	d_thread->start();
+	return true;
+}
+
+bool PythonScript::installMainThreadProxies()
 {
 	PyGILState_STATE state = PyGILState_Ensure();
-	stdoutSave = PyDict_GetItemString(env()->sysDict(), "stdout");
-	Py_XINCREF(stdoutSave);
-	stderrSave = PyDict_GetItemString(env()->sysDict(), "stderr");
-	Py_XINCREF(stderrSave);
-	env()->setQObject(this, "stdout", env()->sysDict());
-	env()->setQObject(this, "stderr", env()->sysDict());
+	PyObject *args = Py_BuildValue("(O)", modGlobalDict);
+	d_proxied_globals = args ? callProxyHelper("install", args) : NULL;
+	Py_XDECREF(args);
+	if (!d_proxied_globals)
+		emit_error(env()->errorMsg(), 0);
 	PyGILState_Release(state);
+	return d_proxied_globals != NULL;
 }
 
-void PythonScript::endStdoutRedirect()
+void PythonScript::restoreGlobals()
+{
+	PyObject *args = Py_BuildValue("(OO)", modGlobalDict, d_proxied_globals);
+	PyObject *ret = args ? callProxyHelper("restore", args) : NULL;
+	Py_XDECREF(args);
+	if (ret)
+		Py_DECREF(ret);
+	else
+		PyErr_Print();
+	Py_DECREF(d_proxied_globals);
+	d_proxied_globals = NULL;
+}
+
+void PythonScript::runInBackgroundThread()
+{
+	// creates a Python thread state for the worker thread; the interpreter lock
+	// is released periodically and during the calls executed by the GUI thread
+	PyGILState_STATE state = PyGILState_Ensure();
+	// modules imported by the script are proxied while the thread is registered
+	PyObject *ret = callProxyHelper("enter", NULL);
+	if (!ret){
+		d_background_success = false;
+		d_background_error = env()->errorMsg();
+		restoreGlobals();
+		PyGILState_Release(state);
+		return;
+	}
+	Py_DECREF(ret);
+	d_thread_id = PyThreadState_Get()->thread_id;
+
+	// the output of the worker thread is sent to this script by PythonScripting::write()
+	PyObject *pyret;
+	if (PyCallable_Check(PyCode)){
+		PyObject *empty_tuple = PyTuple_New(0);
+		pyret = PyObject_Call(PyCode, empty_tuple, modGlobalDict);
+		Py_DECREF(empty_tuple);
+	} else
+		pyret = PyEval_EvalCode((PyCodeObject*)PyCode, modGlobalDict, modGlobalDict);
+	d_thread_id = 0;
+	// drops an interruption requested by cancel() after the end of the script
+	PyThreadState_SetAsyncExc(PyThreadState_Get()->thread_id, NULL);
+
+	d_background_success = (pyret != NULL);
+	if (pyret)
+		Py_DECREF(pyret);
+	else if (d_canceled && PyErr_ExceptionMatches(PyExc_KeyboardInterrupt))
+		PyErr_Clear();
+	else
+		d_background_error = env()->errorMsg();
+
+	ret = callProxyHelper("leave", NULL);
+	if (ret)
+		Py_DECREF(ret);
+	else
+		PyErr_Print();
+	restoreGlobals();
+
+	PyGILState_Release(state);
+}
+
+void PythonScript::backgroundExecutionFinished()
+{
+	if (!d_background_error.isEmpty())
+		emit_error(d_background_error, 0);
+	emit finished(d_background_success);
+}
+
+void PythonScript::cancel()
 {
+	if (!isRunning())
+		return;
+
+	// wakes up the worker thread if it waits for a call executed by the GUI thread
+	d_call_mutex.lock();
+	d_canceled = 1;
+	d_call_done.wakeAll();
+	d_call_mutex.unlock();
+
 	PyGILState_STATE state = PyGILState_Ensure();
-	PyDict_SetItemString(env()->sysDict(), "stdout", stdoutSave);
-	Py_XDECREF(stdoutSave);
-	PyDict_SetItemString(env()->sysDict(), "stderr", stderrSave);
-	Py_XDECREF(stderrSave);
+	if (d_thread_id)
+		PyThreadState_SetAsyncExc(d_thread_id, PyExc_KeyboardInterrupt);
 	PyGILState_Release(state);
 }
 
+bool PythonScript::isRunning() const
+{
+	return d_thread && d_thread->isRunning();
+}
+
+PythonScript* PythonScript::currentScript()
+{
+	PythonScriptThread *thread = qobject_cast<PythonScriptThread *>(QThread::currentThread());
+	if (thread)
+		return thread->script();
+	if (QThread::currentThread() == QCoreApplication::instance()->thread())
+		return current;
+	return NULL;
+}
+
+void PythonScript::reportProgress(int value, int maximum, const QString& text)
+{
+	PythonScript *script = currentScript();
+	if (script)
+		emit script->progressChanged(value, maximum, text);
+}
+
+bool PythonScript::isCanceled()
+{
+	PythonScript *script = currentScript();
+	return script && script->d_canceled;
+}
+
+PyObject* PythonScript::runInMainThread(PyObject *callable, PyObject *args)
+{
+	PythonScriptThread *thread = qobject_cast<PythonScriptThread *>(QThread::currentThread());
+	if (!thread)
+		return PyObject_Call(callable, args, NULL);
+
+	PythonScript *script = thread->script();
+	PythonMainThreadCall call = {callable, args, NULL, NULL, NULL, NULL, false, false};
+	Py_BEGIN_ALLOW_THREADS
+	script->d_call_mutex.lock();
+	if (!script->d_canceled){
+		script->d_pending_call = &call;
+		QMetaObject::invokeMethod(script, "executeCall", Qt::QueuedConnection);
+		// once canceled, the call is dropped unless the GUI thread already started it
+		while (!call.done && (call.running || !script->d_canceled))
+			script->d_call_done.wait(&script->d_call_mutex);
+		script->d_pending_call = NULL;
+	}
+	script->d_call_mutex.unlock();
+	Py_END_ALLOW_THREADS
+
+	if (!call.done){
+		PyErr_SetNone(PyExc_KeyboardInterrupt);
+		return NULL;
+	}
+	if (!call.result)
+		PyErr_Restore(call.exception, call.value, call.traceback);
+	return call.result;
+}
+
+void PythonScript::executeCall()
+{
+	// the call may have been dropped by a canceled worker thread or already executed
+	d_call_mutex.lock();
+	PythonMainThreadCall *call = d_pending_call;
+	if (call && call->running)
+		call = NULL;
+	if (call)
+		call->running = true;
+	d_call_mutex.unlock();
+	if (!call)
+		return;
+
+	PyGILState_STATE state = PyGILState_Ensure();
+	call->result = PyObject_Call(call->callable, call->args, NULL);
+	if (!call->result)
+		PyErr_Fetch(&call->exception, &call->value, &call->traceback);
+	PyGILState_Release(state);
+
+	d_call_mutex.lock();
+	call->done = true;
+	d_call_done.wakeAll();
+	d_call_mutex.unlock();
+}
+
+PythonScript* PythonScript::outputScript()
+{
+	PythonScriptThread *thread = qobject_cast<PythonScriptThread *>(QThread::currentThread());
+	if (thread)
+		return thread->script();
+	if (QThread::currentThread() == QCoreApplication::instance()->thread())
+		return output;
+	return NULL;
+}
+
+// sys.stdout and sys.stderr are never swapped: they dispatch on the calling thread, so only
+// the script receiving the output of the GUI thread is changed here
+void PythonScript::beginStdoutRedirect()
+{
+	if (QThread::currentThread() != QCoreApplication::instance()->thread())
+		return;
+
+	d_previous_output = output;
+	output = this;
+}
+
+void PythonScript::endStdoutRedirect()
+{
+	if (QThread::currentThread() != QCoreApplication::instance()->thread())
+		return;
+
+	output = d_previous_output;
+	d_previous_output = NULL;
+}
+
 bool PythonScript::setQObject(QObject *val, const char *name)
 {
 	PyGILState_STATE state = PyGILState_Ensure();
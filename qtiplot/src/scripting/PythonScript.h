@@ -31,13 +31,34 @@
 
 #include "Script.h"
 
+#include <QThread>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+
 class QObject;
 class QString;
 
 typedef struct _object PyObject;
 class PythonScripting;
+class PythonScriptThread;
+struct PythonMainThreadCall;
 class ScriptingEnv;
 
+//! Python implementation of Script.
+/**
+ * \section background Background execution
+ * execInBackground() runs the code in a PythonScriptThread. The worker thread holds the Python
+ * interpreter lock only while executing Python code, so that the GUI thread can evaluate
+ * table formulas or other scripts in the meantime.
+ * QtiPlot objects (app, self, the qti module and the functions imported from app into the global
+ * namespace) are replaced by proxies forwarding all calls to the GUI thread via qti.runInMainThread().
+ * The original objects are put back in the namespace when the execution ends.
+ * Scripts can report their progress with qti.setProgress() and should poll qti.isCanceled()
+ * in long loops; cancel() also interrupts the script with a KeyboardInterrupt exception.
+ * Scripts declaring "global" variables share the interpreter wide namespace with the GUI thread
+ * and are therefore executed synchronously.
+ */
 class PythonScript : public Script
 {
 	Q_OBJECT
@@ -47,24 +68,89 @@ class PythonScript : public Script
 		~PythonScript();
 
 		void write(const QString &text) { emit print(text); }
+		bool isRunning() const;
+
+		//! Implementation of qti.setProgress(): reports the progress of the script executed by the calling thread
+		static void reportProgress(int value, int maximum, const QString& text);
+		//! Implementation of qti.isCanceled(): true if the user asked the script executed by the calling thread to stop
+		static bool isCanceled();
+		//! Implementation of qti.runInMainThread(): calls callable(*args) in the GUI thread and returns a new reference
+		static PyObject* runInMainThread(PyObject *callable, PyObject *args);
+		//! Returns the script the output of the calling thread is sent to, see PythonScripting::write()
+		static PythonScript* outputScript();
 
 		public slots:
 		bool compile(bool for_eval=true);
 		QVariant eval();
 		bool exec();
+		bool execInBackground();
+		void cancel();
+		bool evalArray(double first, int size, double *values);
 		bool setQObject(QObject *val, const char *name);
 		bool setInt(int val, const char* name);
 		bool setDouble(double val, const char* name);
 		void setContext(QObject *context);
 
+	private slots:
+		void backgroundExecutionFinished();
+		//! Executes the call posted by runInMainThread() from the worker thread
+		void executeCall();
+
 	private:
+		friend class PythonScriptThread;
+
 		PythonScripting *env() { return (PythonScripting*)Env; }
 		void beginStdoutRedirect();
 		void endStdoutRedirect();
+		//! Replaces the QtiPlot objects in the script namespace by proxies safe to use from the worker thread
+		bool installMainThreadProxies();
+		//! Puts back the objects replaced by installMainThreadProxies(), called by the worker thread
+		void restoreGlobals();
+		//! Executes the compiled code in the worker thread
+		void runInBackgroundThread();
+		//! Returns the script executed by the calling thread
+		static PythonScript* currentScript();
 
-		PyObject *PyCode, *modLocalDict, *modGlobalDict, *stdoutSave, *stderrSave;
+		PyObject *PyCode, *modLocalDict, *modGlobalDict;
+		//! Script receiving the output of the GUI thread before beginStdoutRedirect()
+		PythonScript *d_previous_output;
 		bool isFunction, hasOldGlobals;
+
+		PythonScriptThread *d_thread;
+		//! Python id of the worker thread, used to interrupt it
+		long d_thread_id;
+		QAtomicInt d_canceled;
+		bool d_background_success;
+		QString d_background_error;
+		//! Objects replaced by proxies during the background execution, with their proxies
+		PyObject *d_proxied_globals;
+
+		//! Call waiting to be executed by the GUI thread, see runInMainThread()
+		PythonMainThreadCall *d_pending_call;
+		//! Protects d_pending_call, the state of the call and the cancellation
+		QMutex d_call_mutex;
+		QWaitCondition d_call_done;
+
+		//! Script being executed synchronously in the GUI thread
+		static PythonScript *current;
+		//! Script receiving the output written by the GUI thread
+		static PythonScript *output;
 };
 
+//! Thread executing a PythonScript in the background, see PythonScript::execInBackground()
+class PythonScriptThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		PythonScriptThread(PythonScript *script) : QThread(script), d_script(script){};
+		PythonScript *script(){return d_script;};
+
+	protected:
+		void run(){d_script->runInBackgroundThread();};
+
+	private:
+		PythonScript *d_script;
+};
 
 #endif
@@ -284,6 +284,15 @@ bool PythonScripting::initialize()
 	return initialized;
 }
 
+void PythonScripting::write(const QString &text)
+{
+	PythonScript *script = PythonScript::outputScript();
+	if (script)
+		script->write(text);
+	else
+		emit print(text);
+}
+
 PythonScripting::~PythonScripting()
 {
 	PyGILState_STATE state = PyGILState_Ensure();
@@ -48,7 +48,12 @@ class PythonScripting: public ScriptingEnv
 		static ScriptingEnv *constructor(ApplicationWindow *parent) { return new PythonScripting(parent); }
 		bool initialize();
 
-		void write(const QString &text) { emit print(text); }
+		//! Implementation of sys.stdout and sys.stderr
+		/**
+		 * Both are set once to this object. The text is sent to the script executed by the
+		 * calling thread (see PythonScript::outputScript()), or to print() if there is none.
+		 */
+		void write(const QString &text);
 
 		//! like str(object) in Python
 		/**
@@ -75,6 +75,8 @@ class Script : public QObject
     void setName(const QString &name) { Name = name; compiled = notCompiled; }
     //! Set whether errors / exceptions are to be emitted or silently ignored
     void setEmitErrors(bool yes) { EmitErrors = yes; }
+    //! Return whether the Code is being executed in the background
+    virtual bool isRunning() const { return false; }
     ScriptingEnv *scriptingEnv(){return Env;};
 
   public slots:
@@ -84,6 +86,21 @@ class Script : public QObject
     virtual QVariant eval();
     //! Execute the Code, returning false on an error / exception.
     virtual bool exec();
+    //! Start executing the Code without blocking the caller; finished() is emitted when done.
+    /**
+     * Implementations that don't support background execution run the Code synchronously.
+     */
+    virtual bool execInBackground() { bool success = exec(); emit finished(success); return success; }
+    //! Ask a background execution to stop as soon as possible.
+    virtual void cancel() {}
+    //! Evaluate the Code once for \a size consecutive rows starting at row index \a first, writing the results to \a values.
+    /**
+     * Returns false if the implementation or the Code doesn't support array evaluation,
+     * in which case the caller has to fall back on eval() for each row.
+     * Only Code without side effects is evaluated this way: rows with non-finite results
+     * must be evaluated again with eval(), which reports errors as usual.
+     */
+    virtual bool evalArray(double first, int size, double *values) { Q_UNUSED(first); Q_UNUSED(size); Q_UNUSED(values); return false; }
 
     // local variables
     virtual bool setQObject(const QObject*, const char*) { return false; }
@@ -97,6 +114,10 @@ class Script : public QObject
     void error(const QString & message, const QString & scriptName, int lineNumber);
     //! output generated by the code
     void print(const QString & output);
+    //! emitted when an execution started by execInBackground() is over
+    void finished(bool success);
+    //! progress reported by the code, \a maximum is zero if the amount of work is unknown
+    void progressChanged(int value, int maximum, const QString & text);
 
   protected:
     ScriptingEnv *Env;
@@ -47,14 +47,14 @@
 #include <QStringListModel>
 #include <QShortcut>
 #include <QDockWidget>
+#include <QProgressDialog>
 
 ScriptEdit::ScriptEdit(ScriptingEnv *env, QWidget *parent, const char *name)
   : QTextEdit(parent, name), scripted(env), d_error(false), d_completer(0), d_highlighter(0),
-  d_file_name(QString::null), d_search_string(QString::null), d_output_widget(NULL)
+  d_file_name(QString::null), d_search_string(QString::null), d_output_widget(NULL), d_progress_dialog(NULL)
 {
 	myScript = scriptEnv->newScript("", this, name);
-	connect(myScript, SIGNAL(error(const QString&, const QString&, int)), this, SLOT(insertErrorMsg(const QString&)));
-	connect(myScript, SIGNAL(print(const QString&)), this, SLOT(scriptPrint(const QString&)));
+	connectScript();
 	connect(myScript, SIGNAL(error(const QString&, const QString&, int)),
 			this, SIGNAL(error(const QString&, const QString&, int)));
 
@@ -88,6 +88,10 @@ ScriptEdit::ScriptEdit(ScriptingEnv *env, QWidget *parent, const char *name)
 	actionExecuteAll->setShortcut( tr("Ctrl+Shift+J") );
 	connect(actionExecuteAll, SIGNAL(activated()), this, SLOT(executeAll()));
 
+	actionExecuteInBackground = new QAction(tr("Execute in &Background"), this);
+	actionExecuteInBackground->setShortcut( tr("Ctrl+Alt+J") );
+	connect(actionExecuteInBackground, SIGNAL(activated()), this, SLOT(executeInBackground()));
+
 	actionEval = new QAction(tr("&Evaluate Expression"), this);
 	actionEval->setShortcut( tr("Ctrl+Return") );
 	connect(actionEval, SIGNAL(activated()), this, SLOT(evaluate()));
@@ -153,15 +157,24 @@ void ScriptEdit::enableShortcuts()
 	connect(accelEval, SIGNAL(activated()), this, SLOT(evaluate()));
 }
 
+void ScriptEdit::connectScript()
+{
+	connect(myScript, SIGNAL(error(const QString&, const QString&, int)), this, SLOT(insertErrorMsg(const QString&)));
+	connect(myScript, SIGNAL(print(const QString&)), this, SLOT(scriptPrint(const QString&)));
+	connect(myScript, SIGNAL(progressChanged(int, int, const QString&)), this, SLOT(scriptProgress(int, int, const QString&)));
+	connect(myScript, SIGNAL(finished(bool)), this, SLOT(backgroundExecutionFinished()));
+}
+
 void ScriptEdit::customEvent(QEvent *e)
 {
 	if (e->type() == SCRIPTING_CHANGE_EVENT)
 	{
 		scriptingChangeEvent((ScriptingChangeEvent*)e);
+		if (myScript->isRunning())
+			myScript->cancel();
 		delete myScript;
 		myScript = scriptEnv->newScript("", this, name());
-		connect(myScript, SIGNAL(error(const QString&, const QString&, int)), this, SLOT(insertErrorMsg(const QString&)));
-		connect(myScript, SIGNAL(print(const QString&)), this, SLOT(scriptPrint(const QString&)));
+		connectScript();
 
 		rehighlight();
 	}
@@ -276,6 +289,7 @@ void ScriptEdit::contextMenuEvent(QContextMenuEvent *e)
 		if (python){
 			menu->addAction(actionExecute);
 			menu->addAction(actionExecuteAll);
+			menu->addAction(actionExecuteInBackground);
 		}
 		menu->addAction(actionEval);
 	}
@@ -406,6 +420,9 @@ int ScriptEdit::lineNumber(int pos) const
 
 void ScriptEdit::execute()
 {
+	if (checkRunningScript())
+		return;
+
 	clearErrorHighlighting();
 
 	QString fname = "<%1:%2>";
@@ -430,6 +447,9 @@ void ScriptEdit::execute()
 
 void ScriptEdit::executeAll()
 {
+	if (checkRunningScript())
+		return;
+
 	clearErrorHighlighting();
 
 	QString fname = "<%1>";
@@ -438,12 +458,80 @@ void ScriptEdit::executeAll()
 	myScript->setCode(text());
 	myScript->exec();
 
+	// the error flag is kept until the next execution, see error()
+	highlightErrorLine(0);
+}
+
+void ScriptEdit::executeInBackground()
+{
+	if (checkRunningScript())
+		return;
+
+	clearErrorHighlighting();
+
+	QString fname = "<%1>";
+	fname = fname.arg(name());
+	myScript->setName(fname);
+	myScript->setCode(text());
+
+	d_progress_dialog = new QProgressDialog(this);
+	d_progress_dialog->setWindowTitle(tr("QtiPlot") + " - " + tr("Executing script..."));
+	d_progress_dialog->setLabelText(fname);
+	d_progress_dialog->setWindowModality(Qt::NonModal);
+	d_progress_dialog->setAutoClose(false);
+	d_progress_dialog->setAutoReset(false);
+	d_progress_dialog->setRange(0, 0);
+	connect(d_progress_dialog, SIGNAL(canceled()), this, SLOT(cancelExecution()));
+
+	// scripting languages without background execution emit finished() before returning
+	if (myScript->execInBackground() && myScript->isRunning())
+		d_progress_dialog->show();
+}
+
+void ScriptEdit::cancelExecution()
+{
+	if (myScript->isRunning())
+		myScript->cancel();
+}
+
+void ScriptEdit::scriptProgress(int value, int maximum, const QString& text)
+{
+	if (!d_progress_dialog)
+		return;
+
+	if (!text.isEmpty())
+		d_progress_dialog->setLabelText(text);
+	d_progress_dialog->setRange(0, qMax(maximum, 0));
+	d_progress_dialog->setValue(value);
+}
+
+void ScriptEdit::backgroundExecutionFinished()
+{
+	if (!d_progress_dialog)
+		return;
+
+	d_progress_dialog->deleteLater();
+	d_progress_dialog = NULL;
+
 	highlightErrorLine(0);
 	d_error = false;
 }
 
+bool ScriptEdit::checkRunningScript()
+{
+	if (!myScript->isRunning())
+		return false;
+
+	QMessageBox::warning(this, tr("QtiPlot") + " - " + tr("Warning"),
+	tr("The script is still being executed in the background, please wait until it finishes or stop it!"));
+	return true;
+}
+
 void ScriptEdit::evaluate()
 {
+	if (checkRunningScript())
+		return;
+
 	clearErrorHighlighting();
 
 	QString fname = "<%1:%2>";
@@ -787,6 +875,8 @@ void ScriptEdit::findPrevious()
 
 void ScriptEdit::clearErrorHighlighting()
 {
+	d_error = false;
+
 	QTextCursor codeCursor = textCursor();
 	codeCursor.movePosition(QTextCursor::Start, QTextCursor::MoveAnchor);
 	codeCursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
@@ -934,6 +1024,8 @@ void ScriptEdit::createParenthesisSelection(int pos)
 
 ScriptEdit::~ScriptEdit()
 {
+	if (myScript->isRunning())
+		myScript->cancel();
 	if (d_highlighter)
 		delete d_highlighter;
 	if (d_completer){
@@ -38,6 +38,7 @@
 class QAction;
 class QMenu;
 class QCompleter;
+class QProgressDialog;
 
 class SyntaxHighlighter;
 
@@ -69,6 +70,10 @@ class ScriptEdit: public QTextEdit, public scripted
   public slots:
     void execute();
     void executeAll();
+    //! Executes the whole text in a background thread, keeping the user interface responsive
+    void executeInBackground();
+    //! Stops a background execution started by executeInBackground()
+    void cancelExecution();
     void evaluate();
     void print();
     void print(QPrinter*);
@@ -104,9 +109,12 @@ class ScriptEdit: public QTextEdit, public scripted
   private:
 	void clearErrorHighlighting();
 	void highlightErrorLine(int offset);
+	//! Returns true and warns the user if the script is still being executed in the background
+	bool checkRunningScript();
+	void connectScript();
 
     Script *myScript;
-    QAction *actionExecute, *actionExecuteAll, *actionEval, *actionPrint, *actionImport, *actionSave, *actionExport;
+    QAction *actionExecute, *actionExecuteAll, *actionExecuteInBackground, *actionEval, *actionPrint, *actionImport, *actionSave, *actionExport;
     QAction *actionFind, *actionReplace, *actionFindNext, *actionFindPrevious;
   	//! Submenu of context menu with mathematical functions.
   	QMenu *functionsMenu;
@@ -126,6 +134,8 @@ class ScriptEdit: public QTextEdit, public scripted
 	QString d_search_string;
 	QTextDocument::FindFlags d_search_flags;
 	QTextEdit *d_output_widget;
+	//! Displays the progress of a background execution
+	QProgressDialog *d_progress_dialog;
 
   private slots:
 	  //! Insert an error message from the scripting system at printCursor.
@@ -136,6 +146,8 @@ class ScriptEdit: public QTextEdit, public scripted
     void insertErrorMsg(const QString &message);
 	void insertCompletion(const QString &completion);
 	void matchParentheses();
+	void scriptProgress(int value, int maximum, const QString& text);
+	void backgroundExecutionFinished();
 
   private:
     QString textUnderCursor() const;
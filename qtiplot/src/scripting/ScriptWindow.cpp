@@ -217,6 +217,15 @@ void ScriptWindow::initActions()
 	connect(actionExecuteAll, SIGNAL(activated()), te, SLOT(executeAll()));
 	run->addAction(actionExecuteAll);
 
+	actionExecuteInBackground = new QAction(tr("Execute in &Background"), this);
+	actionExecuteInBackground->setShortcut( tr("CTRL+ALT+J") );
+	connect(actionExecuteInBackground, SIGNAL(activated()), te, SLOT(executeInBackground()));
+	run->addAction(actionExecuteInBackground);
+
+	actionStopExecution = new QAction(tr("&Stop Execution"), this);
+	connect(actionStopExecution, SIGNAL(activated()), te, SLOT(cancelExecution()));
+	run->addAction(actionStopExecution);
+
 	actionEval = new QAction(tr("&Evaluate Expression"), this);
 	actionEval->setShortcut( tr("CTRL+Return") );
 	connect(actionEval, SIGNAL(activated()), te, SLOT(evaluate()));
@@ -310,6 +319,11 @@ void ScriptWindow::languageChange()
 	actionExecuteAll->setText(tr("Execute &All"));
 	actionExecuteAll->setShortcut(tr("CTRL+SHIFT+J"));
 
+	actionExecuteInBackground->setText(tr("Execute in &Background"));
+	actionExecuteInBackground->setShortcut(tr("CTRL+ALT+J"));
+
+	actionStopExecution->setText(tr("&Stop Execution"));
+
 	actionEval->setText(tr("&Evaluate Expression"));
 	actionEval->setShortcut(tr("CTRL+Return"));
 
@@ -482,5 +496,6 @@ void ScriptWindow::enableActions()
 	actionReplace->setEnabled(hasText);
 	actionExecute->setEnabled(hasText);
 	actionExecuteAll->setEnabled(hasText);
+	actionExecuteInBackground->setEnabled(hasText);
 	actionEval->setEnabled(hasText);
 }
@@ -94,6 +94,7 @@ private:
 		QMenu *file, *edit, *run, *windowMenu;
 		QAction *actionNew, *actionUndo, *actionRedo, *actionCut, *actionCopy, *actionPaste;
 		QAction *actionExecute, *actionExecuteAll, *actionEval, *actionPrint, *actionOpen;
+		QAction *actionExecuteInBackground, *actionStopExecution;
 		QAction *actionSave, *actionSaveAs;
 		QAction *actionAlwaysOnTop, *actionHide, *actionShowLineNumbers;
 		QAction *actionShowConsole, *actionRedirectOutput, *actionPrintPreview;
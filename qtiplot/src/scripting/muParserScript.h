@@ -57,6 +57,7 @@ class muParserScript: public Script
     bool setDouble(double val, const char* name);
     double* defineVariable(const char *name, double val = 0.0);
     int codeLines(){return muCode.size();};
+    QString codeLine(int line){return muCode.value(line);};
 
   private:
 	double avg(const QString &arg, int start = 0, int end = -1);
@@ -32,11 +32,66 @@
 
 #include <qstringlist.h>
 #include <QLocale>
+#include <QThreadStorage>
+
+#include <time.h>
 
 using namespace mu;
 
 const char* muParserScripting::langName = "muParser";
 
+//! Random number generator of a thread, used by rnd() and normal()
+struct RandomGenerator
+{
+	RandomGenerator() : rng(gsl_rng_alloc(gsl_rng_default)), seed(0), block(0){};
+	~RandomGenerator(){if (rng) gsl_rng_free(rng);};
+
+	gsl_rng *rng;
+	//! Master seed, zero if the current time is used
+	unsigned long seed;
+	int block;
+};
+
+static QThreadStorage<RandomGenerator *> random_generators;
+
+static RandomGenerator *randomGenerator()
+{
+	if (!random_generators.hasLocalData())
+		random_generators.setLocalData(new RandomGenerator);
+	return random_generators.localData();
+}
+
+//! Returns the generator of the calling thread, seeded for the argument x of rnd() and normal()
+static gsl_rng *seededGenerator(double x)
+{
+	RandomGenerator *g = randomGenerator();
+	if (!g->rng)
+		return 0;
+
+	unsigned long seed = g->seed ? g->seed : (unsigned long)time(NULL);
+	gsl_rng_set(g->rng, (unsigned long)x*seed + g->block);
+	return g->rng;
+}
+
+void muParserScripting::setRandomSeed(unsigned long seed, int block)
+{
+	RandomGenerator *g = randomGenerator();
+	g->seed = seed;
+	g->block = block;
+}
+
+double muParserScripting::rnd(double x)
+{
+	gsl_rng *r = seededGenerator(x);
+	return r ? gsl_rng_uniform(r) : 0.0;
+}
+
+double muParserScripting::normal(double x)
+{
+	gsl_rng *r = seededGenerator(x);
+	return r ? gsl_ran_ugaussian(r) : 0.0;
+}
+
 const muParserScripting::mathFunction muParserScripting::math_functions[] = {
   { "abs", 1, NULL,NULL,NULL, QObject::tr("abs(x):\n Absolute value of x.") },
   { "acos", 1, NULL,NULL,NULL, QObject::tr("acos(x):\n Inverse cos function.") },
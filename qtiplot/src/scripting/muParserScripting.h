@@ -71,6 +71,13 @@ class muParserScripting: public ScriptingEnv
 	const static QStringList functionsList(bool tableContext = false);
 	const static QString explainFunction(const QString &name);
 
+	//! Sets the master seed of rnd() and normal() for the calling thread, each thread having its own generator.
+	/**
+	 * Threads evaluating different blocks of the same calculation use the same master seed and their block index.
+	 * A zero seed restores the default: the current time is used as master seed.
+	 */
+	static void setRandomSeed(unsigned long seed, int block = 0);
+
     struct mathFunction
     {
       char *name;
@@ -83,25 +90,8 @@ class muParserScripting: public ScriptingEnv
     static const mathFunction math_functions[];
 
   private:
-	static double rnd(double x){
-		gsl_rng_default_seed = (unsigned int)x*time(NULL);
-		const gsl_rng_type * T = gsl_rng_default;
-		gsl_rng * r = gsl_rng_alloc (T);
-		double u = gsl_rng_uniform (r);
-		gsl_rng_free (r);
-		return u;
-	}
-
-	static double normal(double x){
-		const gsl_rng_type * T = gsl_rng_default;
-		gsl_rng * r = gsl_rng_alloc (T);
-		if (!r)
-			return 0.0;
-		gsl_rng_set(r, (unsigned int)x*time(NULL));
-		double u = gsl_ran_ugaussian(r);
-		gsl_rng_free (r);
-		return u;
-	}
+	static double rnd(double x);
+	static double normal(double x);
 
 	static double mod(double x, double y){ return fmod(x,y);};
 	static double bessel_I0(double x){ return gsl_sf_bessel_I0 (x);};
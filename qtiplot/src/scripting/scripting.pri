@@ -5,6 +5,7 @@
 INCLUDEPATH += src/scripting/
 
 HEADERS  += src/scripting/customevents.h\
+            src/scripting/CompiledExpression.h\
             src/scripting/FindReplaceDialog.h\
             src/scripting/MyParser.h\
             src/scripting/Note.h\
@@ -15,7 +16,8 @@ HEADERS  += src/scripting/customevents.h\
             src/scripting/ScriptingLangDialog.h\
             src/scripting/ScriptWindow.h\
 
-SOURCES  += src/scripting/FindReplaceDialog.cpp\
+SOURCES  += src/scripting/CompiledExpression.cpp\
+            src/scripting/FindReplaceDialog.cpp\
             src/scripting/MyParser.cpp\
             src/scripting/Note.cpp\
             src/scripting/PythonSyntaxHighlighter.cpp\
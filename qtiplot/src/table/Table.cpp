@@ -47,6 +47,7 @@ Description          : Table worksheet class
 #include <QProgressDialog>
 #include <QFile>
 #include <QRegion>
+#include <QCryptographicHash>
 #if QT_VERSION >= 0x040500
 #include <QTextDocumentWriter>
 #endif
@@ -703,7 +704,19 @@ bool Table::calculate(int col, int startRow, int endRow, bool forceMuParser, boo
 		char f;
 		columnNumericFormat(col, &f, &prec);
 
+		int rows = endRow - startRow + 1;
+		QVector<double> values(rows > 0 ? rows : 0);
+		bool array = rows > 0 && colscript->evalArray(startRow + 1.0, rows, values.data());//the whole column at once
+
 		for (int i = startRow; i <= endRow; i++){
+			if (array){
+				double val = values[i - startRow];
+				if (finite(val)){
+					d_table->setText(i, col, loc.toString(val, f, prec));
+					continue;
+				}
+			}// non-finite values are evaluated again, in order to report errors as for the other rows
+
 			colscript->setDouble(i + 1.0, "i");
 			QVariant ret = colscript->eval();
 			if (ret.type() == QVariant::Double)
@@ -936,29 +949,80 @@ void Table::save(const QString& fn, const QString& geometry, bool saveAsTemplate
 
 	if (!saveAsTemplate){
         t << "WindowLabel\t" + windowLabel() + "\t" + QString::number(captionPolicy()) + "\n";
-        t << "<data>\n";
-		int cols = d_table->numCols() - 1;
+
+		int cols = d_table->numCols();
+		QVector<bool> sharedCols(cols, false);
+		ApplicationWindow *app = applicationWindow();
+		if (app){//identical column data blocks are only written once per project file
+			QString hashes = "ColumnHash", shared = "SharedColumn";
+			bool hasSharedCols = false;
+			for (int j = 0; j < cols; j++){
+				QString key, source;
+				if (!isEmptyColumn(j)){
+					key = columnBlockHash(j);
+					if (app->d_saved_column_blocks.contains(key)){
+						source = app->d_saved_column_blocks.value(key);
+						sharedCols[j] = true;
+						hasSharedCols = true;
+					} else
+						app->d_saved_column_blocks.insert(key, objectName());
+				}
+				hashes += "\t" + key;
+				shared += "\t" + source;
+			}
+			t << hashes + "\n";
+			if (hasSharedCols)
+				t << shared + "\n";
+		}
+
+		t << "<data>\n";
 		int rows = d_table->numRows();
-		for (int i=0; i<rows; i++){
-			if (!isEmptyRow(i)){
-				t << QString::number(i) + "\t";
-				for (int j=0; j<cols; j++){
-			    	if (colTypes[j] == Numeric && !d_table->text(i, j).isEmpty())
-						t << QString::number(cell(i, j), 'g', 14) + "\t";
-					else
-						t << d_table->text(i, j) + "\t";
+		for (int i = 0; i < rows; i++){
+			QString row;
+			bool emptyRow = true;
+			for (int j = 0; j < cols; j++){
+				if (!sharedCols[j]){
+					QString s = d_table->text(i, j);
+					if (!s.isEmpty()){
+						emptyRow = false;
+						if (colTypes[j] == Numeric)
+							s = QString::number(cell(i, j), 'g', 14);
+					}
+					row += s;
 				}
-            	if (colTypes[cols] == Numeric && !d_table->text(i, cols).isEmpty())
-					t << QString::number(cell(i, cols), 'g', 14) + "\n";
-				else
-					t << d_table->text(i, cols) + "\n";
+				row += (j < cols - 1) ? "\t" : "\n";
 			}
+			if (!emptyRow)
+				t << QString::number(i) + "\t" + row;
 		}
 		t << "</data>\n";
 	}
 	t << "</table>\n";
 }
 
+QStringList Table::columnBlock(int col)
+{
+	QStringList lst;
+	for (int i = 0; i < d_table->numRows(); i++){
+		QString s = d_table->text(i, col);
+		if (!s.isEmpty() && colTypes[col] == Numeric)
+			s = QString::number(cell(i, col), 'g', 14);
+		lst << s;
+	}
+	return lst;
+}
+
+QString Table::columnBlockHash(int col)
+{
+	QStringList block = columnBlock(col);
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	for (int i = 0; i < block.size(); i++){
+		if (!block[i].isEmpty())
+			hash.addData((QString::number(i) + "\t" + block[i] + "\n").toUtf8());
+	}
+	return QString(hash.result().toHex());
+}
+
 int Table::firstXCol()
 {
 	int xcol = -1;
@@ -2150,6 +2214,20 @@ void Table::setCell(int row, int col, double val)
     d_table->setText(row, col, locale().toString(val, format, prec));
 }
 
+void Table::setColumnValues(int col, const double *values, int n, int startRow)
+{
+	if (col < 0 || col >= d_table->numCols() || startRow < 0)
+		return;
+
+	int endRow = qMin(startRow + n, d_table->numRows());
+	char format;
+	int prec;
+	columnNumericFormat(col, &format, &prec);
+	QLocale l = locale();
+	for (int i = startRow; i < endRow; i++)
+		d_table->setText(i, col, l.toString(values[i - startRow], format, prec));
+}
+
 QString Table::text(int row, int col)
 {
 	return d_table->text(row, col);
@@ -101,6 +101,8 @@ public slots:
 	//! Return the value of the cell as a double
 	double cell(int row, int col);
 	void setCell(int row, int col, double val);
+	//! Writes n values to the column col starting at startRow, without notifying the changes
+	void setColumnValues(int col, const double *values, int n, int startRow = 0);
 
 	QString text(int row, int col);
 	QStringList columnsList();
@@ -330,6 +332,10 @@ public slots:
 	QString saveColumnTypes();
 	QString saveReadOnlyInfo();
 	QString saveHiddenColumnsInfo();
+	//! Returns the cells of column \a col as written in project files, one string per row
+	QStringList columnBlock(int col);
+	//! Returns a SHA-1 key identifying the data of column \a col, used to store identical columns only once in project files
+	QString columnBlockHash(int col);
 
 	void setBackgroundColor(const QColor& col);
 	void setTextColor(const QColor& col);